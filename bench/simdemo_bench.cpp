@@ -0,0 +1,1865 @@
+/// Headless scale benchmark for the DataStore -> ECS adapter pipeline.
+///
+/// Builds synthetic scenarios of N platforms (each hosting beams, each beam hosting
+/// gates) in a MemoryDataStore, connects a DataStoreAdapter to a bare registry with
+/// no window or Vulkan device, and reports listener callback cost, per-frame update
+/// latency percentiles and memory use.
+///
+/// Usage: simdemo-bench [--platforms N,N,...] [--threads N,N,...] [--beams N] [--gates N]
+///                      [--icons N] [--samples N] [--frames N] [--dt seconds]
+///                      [--sim-thread N] [--budget N] [--stress N] [--readers N]
+///                      [--gate-batch N] [--recording N] [--recording-seconds N]
+///                      [--ingest N] [--geo N] [--stats N] [--stats-out file]
+///                      [--spatial N] [--declutter N] [--tracks N]
+///                      [--schedule N] [--frame-budget ms] [--churn N]
+///                      [--lazy N] [--hidden fraction] [--check]
+///
+/// --check runs only the correctness checks and exits nonzero if any fails.
+
+#include <simCore/Calc/Angle.h>
+#include <simData/MemoryDataStore.h>
+#include "BulkIngest.h"
+#include "DataStoreAdapter.h"
+#include "GateGeometry.h"
+#include "GeoBatch.h"
+#include "LabelDeclutter.h"
+#include "Recording.h"
+#include "SimulationThread.h"
+#include "SpatialIndex.h"
+#include "SpscRing.h"
+#include "TrackHistory.h"
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <vsg/maths/transform.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    double micros_since(Clock::time_point start)
+    {
+        return 1e-3 * (double)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    }
+
+    /// resident set size of this process, in bytes (0 if unavailable)
+    std::size_t resident_bytes()
+    {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS pmc;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+            return pmc.WorkingSetSize;
+        return 0;
+#else
+        std::ifstream statm("/proc/self/statm");
+        std::size_t size = 0, resident = 0;
+        if (statm >> size >> resident)
+            return resident * (std::size_t)sysconf(_SC_PAGESIZE);
+        return 0;
+#endif
+    }
+
+    double percentile(std::vector<double> values, double p)
+    {
+        if (values.empty())
+            return 0.0;
+        std::sort(values.begin(), values.end());
+        auto index = (std::size_t)std::min((double)(values.size() - 1), std::round(p * (double)(values.size() - 1)));
+        return values[index];
+    }
+
+    std::vector<unsigned> parse_list(const std::string& arg)
+    {
+        std::vector<unsigned> result;
+        std::size_t start = 0;
+        while (start < arg.size())
+        {
+            auto end = arg.find(',', start);
+            if (end == std::string::npos) end = arg.size();
+            result.push_back((unsigned)std::strtoul(arg.substr(start, end - start).c_str(), nullptr, 10));
+            start = end + 1;
+        }
+        return result;
+    }
+
+    struct Options
+    {
+        std::vector<unsigned> platforms = { 10, 100, 1000, 10000, 100000 };
+        std::vector<unsigned> threads = { 1 };
+        unsigned beams_per_platform = 1;
+        unsigned gates_per_beam = 1;
+        unsigned icons = 4;
+        unsigned samples = 20;
+        unsigned frames = 200;
+        double dt = 0.1;
+        unsigned gate_batch = 10000;
+        unsigned sim_thread = 10000;
+        unsigned budget = 20000;
+        unsigned stress = 10000;
+        unsigned readers = 4;
+        unsigned recording = 1000;
+        unsigned recording_seconds = 3600;
+        unsigned ingest = 1000000;
+        unsigned geo = 1000000;
+        unsigned stats = 10000;
+        std::string stats_out;
+        unsigned spatial = 100000;
+        unsigned declutter = 20000;
+        unsigned tracks = 10000;
+        unsigned schedule = 20000;
+        double frame_budget = 4.0;
+        unsigned churn = 10000;
+        unsigned lazy = 100000;
+        double hidden = 0.9;
+        bool check = false;
+    };
+
+    /// Forwards DataStore notifications to the adapter and accumulates the time
+    /// spent inside each kind of callback.
+    class TimedListener : public simData::DataStore::DefaultListener
+    {
+    public:
+        std::shared_ptr<DataStoreAdapter> adapter;
+        double add_us = 0.0, props_us = 0.0, prefs_us = 0.0, time_us = 0.0;
+        unsigned callbacks = 0;
+
+        TimedListener(std::shared_ptr<DataStoreAdapter> adapter_) : adapter(adapter_) { }
+
+        void onAddEntity(simData::DataStore* ds, simData::ObjectId id, simData::ObjectType type) override
+        {
+            auto start = Clock::now();
+            adapter->onAddEntity(ds, id, type);
+            add_us += micros_since(start), ++callbacks;
+        }
+
+        void onPropertiesChange(simData::DataStore* ds, simData::ObjectId id) override
+        {
+            auto start = Clock::now();
+            adapter->onPropertiesChange(ds, id);
+            props_us += micros_since(start), ++callbacks;
+        }
+
+        void onPrefsChange(simData::DataStore* ds, simData::ObjectId id) override
+        {
+            auto start = Clock::now();
+            adapter->onPrefsChange(ds, id);
+            prefs_us += micros_since(start), ++callbacks;
+        }
+
+        void onTimeChange(simData::DataStore* ds) override
+        {
+            auto start = Clock::now();
+            adapter->onTimeChange(ds);
+            time_us += micros_since(start);
+        }
+
+        double total_us() const
+        {
+            return add_us + props_us + prefs_us;
+        }
+    };
+
+    /// Populates the data store with platforms, beams and gates on a lat/long grid,
+    /// each with 'samples' time-stamped updates one second apart.
+    ///@return every object id created, in creation order
+    std::vector<simData::ObjectId> build_scenario(simData::DataStore& ds, unsigned num_platforms, const Options& options)
+    {
+        std::vector<simData::ObjectId> ids;
+        ids.reserve(num_platforms * (1 + options.beams_per_platform * (1 + options.gates_per_beam)));
+
+        auto geo_to_ecef = rocky::SRS::WGS84.to(rocky::SRS::ECEF);
+        auto columns = (unsigned)std::ceil(std::sqrt((double)num_platforms));
+
+        for (unsigned p = 0; p < num_platforms; ++p)
+        {
+            simData::DataStore::Transaction x;
+            auto props = ds.addPlatform(&x);
+            auto plat_id = props->id();
+            x.complete(&props);
+            ids.push_back(plat_id);
+
+            auto prefs = ds.mutable_platformPrefs(plat_id, &x);
+            prefs->mutable_commonprefs()->set_name("P" + std::to_string(p));
+            prefs->mutable_commonprefs()->set_draw(true);
+            prefs->set_scale(1.0f);
+            if (options.icons > 0)
+                prefs->set_icon("icon" + std::to_string(p % options.icons) + ".png");
+            x.complete(&prefs);
+
+            auto lon = -60.0 + 120.0 * (double)(p % columns) / (double)columns;
+            auto lat = -60.0 + 120.0 * (double)(p / columns) / (double)columns;
+            simCore::Vec3 ecef;
+            for (unsigned s = 0; s < options.samples; ++s)
+            {
+                auto LLA = vsg::dvec3{ lon + 0.001 * s, lat, 10000.0 };
+                geo_to_ecef.transform(LLA, ecef);
+                auto update = ds.addPlatformUpdate(plat_id, &x);
+                update->set_time((double)s);
+                update->setPosition(ecef);
+                x.complete(&update);
+            }
+
+            for (unsigned b = 0; b < options.beams_per_platform; ++b)
+            {
+                auto beam_props = ds.addBeam(&x);
+                auto beam_id = beam_props->id();
+                beam_props->set_hostid(plat_id);
+                x.complete(&beam_props);
+                ids.push_back(beam_id);
+
+                auto beam_prefs = ds.mutable_beamPrefs(beam_id, &x);
+                beam_prefs->set_verticalwidth(simCore::DEG2RAD * 25.0);
+                beam_prefs->set_horizontalwidth(simCore::DEG2RAD * 30.0);
+                x.complete(&beam_prefs);
+
+                for (unsigned s = 0; s < options.samples; ++s)
+                {
+                    auto update = ds.addBeamUpdate(beam_id, &x);
+                    update->set_time((double)s);
+                    update->set_azimuth(0.5 * sin((double)(s + b)));
+                    update->set_elevation(0.1);
+                    update->set_range(20000.0 + 100.0 * s);
+                    x.complete(&update);
+                }
+
+                for (unsigned g = 0; g < options.gates_per_beam; ++g)
+                {
+                    auto gate_props = ds.addGate(&x);
+                    auto gate_id = gate_props->id();
+                    gate_props->set_hostid(beam_id);
+                    x.complete(&gate_props);
+                    ids.push_back(gate_id);
+
+                    for (unsigned s = 0; s < options.samples; ++s)
+                    {
+                        auto update = ds.addGateUpdate(gate_id, &x);
+                        update->set_time((double)s);
+                        update->set_azimuth(0.5 * sin((double)(s + b)));
+                        update->set_elevation(0.1);
+                        update->set_width(simCore::DEG2RAD * 5.0);
+                        update->set_height(simCore::DEG2RAD * 5.0);
+                        update->set_minrange(5000.0 + 100.0 * g);
+                        update->set_maxrange(6000.0 + 100.0 * g);
+                        x.complete(&update);
+                    }
+                }
+            }
+        }
+        return ids;
+    }
+
+    void run_scale(unsigned num_platforms, unsigned num_threads, const Options& options)
+    {
+        auto rss_start = resident_bytes();
+
+        auto ecs = rocky::ecs::Registry::create();
+        simData::MemoryDataStore data_store;
+        auto adapter = std::make_shared<DataStoreAdapter>(rocky::VSGContext{}, ecs);
+        adapter->setThreads(num_threads);
+        auto listener = std::make_shared<TimedListener>(adapter);
+        data_store.addListener(listener);
+
+        auto build_start = Clock::now();
+        auto ids = build_scenario(data_store, num_platforms, options);
+        auto build_ms = 1e-3 * micros_since(build_start);
+
+        // listener events are queued; apply them all under one write lock
+        auto flush_start = Clock::now();
+        adapter->flushEvents(&data_store);
+        auto flush_ms = 1e-3 * micros_since(flush_start);
+        auto events = adapter->eventStats();
+        auto rss_built = resident_bytes();
+
+        std::vector<double> store_us, update_us;
+        store_us.reserve(options.frames);
+        update_us.reserve(options.frames);
+        std::size_t updated = 0;
+
+        double time = 0.0;
+        for (unsigned frame = 0; frame < options.frames; ++frame)
+        {
+            // includes the adapter's onTimeChange dirty-set collection
+            auto t0 = Clock::now();
+            data_store.update(time);
+            store_us.push_back(micros_since(t0));
+
+            auto t1 = Clock::now();
+            updated += adapter->update(&data_store);
+            update_us.push_back(micros_since(t1));
+
+            time = std::fmod(time + options.dt, (double)options.samples);
+        }
+
+        // re-apply unchanged prefs to every platform; the diff should find
+        // nothing to do, so this measures the no-change cost per entity.
+        std::size_t reapplied = 0;
+        for (auto id : ids)
+        {
+            if (data_store.objectType(id) == simData::PLATFORM)
+            {
+                simData::DataStore::Transaction x;
+                auto prefs = data_store.mutable_platformPrefs(id, &x);
+                prefs->set_scale(1.0f);
+                x.complete(&prefs);
+                ++reapplied;
+            }
+        }
+        auto reprefs_start = Clock::now();
+        adapter->flushEvents(&data_store);
+        auto reprefs_us = micros_since(reprefs_start);
+
+        // raw iteration throughput over the hot components
+        double iterate_rate = 0.0;
+        const unsigned passes = 20;
+        double checksum = 0.0;
+        std::size_t iterated = 0;
+        auto iterate_start = Clock::now();
+        IconStats icons;
+        {
+            auto [lock, registry] = ecs.read();
+            for (unsigned pass = 0; pass < passes; ++pass)
+            {
+                for (auto [entity, platform] : registry.view<Platform>().each())
+                    checksum += platform.x, ++iterated;
+                for (auto [entity, beam] : registry.view<Beam>().each())
+                    checksum += beam.range, ++iterated;
+                for (auto [entity, gate] : registry.view<Gate>().each())
+                    checksum += gate.maxrange, ++iterated;
+            }
+            auto iterate_us = micros_since(iterate_start);
+            iterate_rate = iterate_us > 0.0 ? (double)iterated / iterate_us : 0.0;
+            icons = adapter->platforms.iconStats(registry);
+        }
+
+        auto dirty_per_frame = (double)updated / (double)options.frames;
+        printf("%7u %9u %9zu %9.0f %10.1f %8u %11.1f %9.1f %9.1f %9llu %9.1f %9.1f %9.1f %9.1f %8.1f %9.1f %9.1f %8.1f %8.1f %7zu/%zu\n",
+            num_threads,
+            num_platforms,
+            ids.size(),
+            dirty_per_frame,
+            build_ms,
+            listener->callbacks,
+            1e-3 * listener->total_us(),
+            listener->callbacks > 0 ? 1e3 * listener->total_us() / listener->callbacks : 0.0,
+            flush_ms,
+            (unsigned long long)events.coalesced(),
+            percentile(store_us, 0.5),
+            percentile(update_us, 0.5),
+            percentile(update_us, 0.9),
+            percentile(update_us, 0.99),
+            dirty_per_frame > 0.0 ? 1e3 * percentile(update_us, 0.5) / dirty_per_frame : 0.0,
+            reapplied > 0 ? 1e3 * reprefs_us / (double)reapplied : 0.0,
+            iterate_rate,
+            (double)(rss_built - std::min(rss_built, rss_start)) / 1048576.0,
+            (double)resident_bytes() / 1048576.0,
+            icons.unique_images,
+            icons.references);
+        fflush(stdout);
+
+        // keep the iteration loop from being optimized away
+        if (checksum == 42.0)
+            printf(" ");
+
+        data_store.removeListener(listener);
+    }
+
+    /// Changes the prefs of every platform, as when a large scenario is re-styled
+    /// or a burst of new data arrives.
+    void prefs_burst(simData::DataStore& ds, float scale)
+    {
+        simData::DataStore::IdList ids;
+        ds.idList(&ids, simData::PLATFORM);
+        for (auto id : ids)
+        {
+            simData::DataStore::Transaction x;
+            auto prefs = ds.mutable_platformPrefs(id, &x);
+            prefs->set_scale(scale);
+            x.complete(&prefs);
+        }
+    }
+
+    /// Render-thread frame time through a prefs burst halfway through the run,
+    /// with the DataStore updated inline on the render thread and then on a
+    /// SimulationThread (applying at most options.budget deltas per frame).
+    void run_sim_thread(const Options& options)
+    {
+        printf("\nrender frame time, %u platforms, prefs burst at frame %u:\n", options.sim_thread, options.frames / 2);
+        printf("%8s %9s %9s %9s\n", "mode", "p50(us)", "p99(us)", "max(us)");
+
+        for (int threaded = 0; threaded < 2; ++threaded)
+        {
+            auto ecs = rocky::ecs::Registry::create();
+            simData::MemoryDataStore data_store;
+            auto adapter = std::make_shared<DataStoreAdapter>(rocky::VSGContext{}, ecs);
+            adapter->setThreads(1);
+
+            std::shared_ptr<SimulationThread> simulation;
+            if (threaded)
+                simulation = SimulationThread::create(data_store);
+            else
+                data_store.addListener(adapter);
+
+            auto ids = build_scenario(data_store, options.sim_thread, options);
+
+            std::vector<double> frame_us;
+            if (threaded)
+            {
+                std::atomic<unsigned> frame = { 0u };
+                unsigned burst_tick = ~0u;
+                simulation->start([&](simData::DataStore& ds)
+                    {
+                        auto f = frame.load();
+                        if (f >= options.frames / 2 && burst_tick == ~0u)
+                        {
+                            burst_tick = f;
+                            prefs_burst(ds, 2.0f);
+                        }
+                        ds.update(options.dt * (double)f);
+                    }, std::chrono::milliseconds(1));
+
+                // let the initial scenario through before timing
+                while (adapter->sim.entities.size() < ids.size())
+                {
+                    simulation->apply(*adapter);
+                    std::this_thread::yield();
+                }
+
+                for (unsigned f = 0; f < options.frames; ++f)
+                {
+                    frame = f;
+                    auto start = Clock::now();
+                    simulation->apply(*adapter, options.budget);
+                    frame_us.push_back(micros_since(start));
+                    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+                }
+                simulation->stop();
+                data_store.removeListener(simulation);
+            }
+            else
+            {
+                adapter->update(&data_store);
+                for (unsigned f = 0; f < options.frames; ++f)
+                {
+                    if (f == options.frames / 2)
+                        prefs_burst(data_store, 2.0f);
+                    auto start = Clock::now();
+                    data_store.update(options.dt * (double)f);
+                    adapter->update(&data_store);
+                    frame_us.push_back(micros_since(start));
+                }
+                data_store.removeListener(adapter);
+            }
+
+            printf("%8s %9.1f %9.1f %9.1f\n", threaded ? "thread" : "inline",
+                percentile(frame_us, 0.5), percentile(frame_us, 0.99), percentile(frame_us, 1.0));
+        }
+    }
+
+    /// Mixed read/write stress: reader threads look up random platforms while the
+    /// main thread runs frames of updates plus a prefs change every frame. Readers
+    /// go through the registry read lock, then through the published snapshot.
+    void run_snapshot_stress(const Options& options)
+    {
+        printf("\nreaders vs ingest, %u platforms, %u reader threads:\n", options.stress, options.readers);
+        printf("%9s %12s %12s %12s %12s\n", "mode", "reads/s", "wait99(us)", "frame50(us)", "frame99(us)");
+
+        const unsigned lookups = 64;
+
+        // keeps the sample count bounded on fast readers
+        auto record = [](std::vector<double>& samples, double value)
+            {
+                if (samples.size() < (1u << 20))
+                    samples.push_back(value);
+            };
+
+        for (int snapshot = 0; snapshot < 2; ++snapshot)
+        {
+            auto ecs = rocky::ecs::Registry::create();
+            simData::MemoryDataStore data_store;
+            auto adapter = std::make_shared<DataStoreAdapter>(rocky::VSGContext{}, ecs);
+            adapter->setThreads(1);
+            data_store.addListener(adapter);
+
+            auto ids = build_scenario(data_store, options.stress, options);
+            data_store.update(0.0);
+            adapter->update(&data_store);
+
+            simData::DataStore::IdList platform_ids;
+            data_store.idList(&platform_ids, simData::PLATFORM);
+
+            std::atomic<bool> done = { false };
+            std::atomic<std::uint64_t> reads = { 0u };
+            std::vector<std::vector<double>> waits(options.readers);
+            std::vector<std::thread> readers;
+
+            for (unsigned r = 0; r < options.readers; ++r)
+            {
+                readers.emplace_back([&, r]()
+                    {
+                        std::uint64_t seed = 1234567u + r;
+                        double checksum = 0.0;
+                        while (!done)
+                        {
+                            auto start = Clock::now();
+                            if (snapshot)
+                            {
+                                auto view = adapter->snapshots.acquire();
+                                record(waits[r], micros_since(start));
+                                for (unsigned i = 0; i < lookups; ++i)
+                                {
+                                    seed = seed * 6364136223846793005u + 1442695040888963407u;
+                                    auto* state = view->find(platform_ids[(seed >> 33) % platform_ids.size()]);
+                                    if (state)
+                                        checksum += state->position.x;
+                                }
+                            }
+                            else
+                            {
+                                auto [lock, registry] = ecs.read();
+                                record(waits[r], micros_since(start));
+                                for (unsigned i = 0; i < lookups; ++i)
+                                {
+                                    seed = seed * 6364136223846793005u + 1442695040888963407u;
+                                    auto entity = adapter->sim.entities[platform_ids[(seed >> 33) % platform_ids.size()]];
+                                    if (entity != entt::null)
+                                        checksum += registry.get<Platform>(entity).x;
+                                }
+                            }
+                            reads += lookups;
+                        }
+                        if (checksum == 42.0)
+                            printf(" ");
+                    });
+            }
+
+            std::vector<double> frame_us;
+            auto run_start = Clock::now();
+            for (unsigned f = 0; f < options.frames; ++f)
+            {
+                prefs_burst(data_store, (f & 1) ? 2.0f : 1.0f);
+                auto start = Clock::now();
+                data_store.update(options.dt * (double)f);
+                adapter->update(&data_store);
+                frame_us.push_back(micros_since(start));
+            }
+            auto run_us = micros_since(run_start);
+
+            done = true;
+            for (auto& reader : readers)
+                reader.join();
+
+            std::vector<double> all_waits;
+            for (auto& w : waits)
+                all_waits.insert(all_waits.end(), w.begin(), w.end());
+
+            printf("%9s %12.0f %12.1f %12.1f %12.1f\n", snapshot ? "snapshot" : "lock",
+                run_us > 0.0 ? 1e6 * (double)reads / run_us : 0.0,
+                percentile(all_waits, 0.99),
+                percentile(frame_us, 0.5),
+                percentile(frame_us, 0.99));
+
+            data_store.removeListener(adapter);
+        }
+    }
+
+    /// Backfills options.ingest platform samples (1000 platforms, samples given
+    /// in time order across platforms, as a feed would deliver them), once with
+    /// a Transaction per sample and once through BulkIngest.
+    void run_bulk_ingest(const Options& options)
+    {
+        const unsigned num_platforms = 1000;
+        const std::size_t per_platform = std::max(1u, options.ingest / num_platforms);
+
+        printf("\nbulk ingest, %u platforms x %zu samples:\n", num_platforms, per_platform);
+        printf("%12s %12s %14s\n", "mode", "time(ms)", "samples/s");
+
+        for (int bulk = 0; bulk < 2; ++bulk)
+        {
+            simData::MemoryDataStore data_store;
+            std::vector<simData::ObjectId> ids;
+            for (unsigned p = 0; p < num_platforms; ++p)
+            {
+                simData::DataStore::Transaction x;
+                auto props = data_store.addPlatform(&x);
+                ids.push_back(props->id());
+                x.complete(&props);
+            }
+
+            PlatformSamples samples;
+            samples.reserve(per_platform * num_platforms);
+            for (std::size_t s = 0; s < per_platform; ++s)
+            {
+                for (auto id : ids)
+                    samples.add(id, (double)s, 6378137.0 + (double)s, (double)id, 0.0);
+            }
+
+            auto start = Clock::now();
+            std::size_t inserted = 0;
+            if (bulk)
+            {
+                BulkIngest ingest(data_store);
+                inserted = ingest.insert(samples);
+            }
+            else
+            {
+                for (std::size_t i = 0; i < samples.size(); ++i)
+                {
+                    simData::DataStore::Transaction x;
+                    auto update = data_store.addPlatformUpdate(samples.ids[i], &x);
+                    update->set_time(samples.times[i]);
+                    update->set_x(samples.x[i]);
+                    update->set_y(samples.y[i]);
+                    update->set_z(samples.z[i]);
+                    x.complete(&update);
+                    ++inserted;
+                }
+            }
+            auto us = micros_since(start);
+
+            printf("%12s %12.1f %14.0f\n", bulk ? "bulk" : "transaction", 1e-3 * us, us > 0.0 ? 1e6 * (double)inserted / us : 0.0);
+        }
+    }
+
+    /// Runs the same frames with FrameStats off and on to measure its overhead,
+    /// then prints the mean time of each stage and the mean counters, and
+    /// optionally exports the frames (options.stats_out: .csv, .trace.json or .json).
+    void run_stats(const Options& options)
+    {
+        printf("\nframe stats, %u platforms:\n", options.stats);
+
+        std::vector<FrameStats::Frame> frames;
+        double p50[2] = { 0.0, 0.0 };
+        for (int enabled = 0; enabled < 2; ++enabled)
+        {
+            auto ecs = rocky::ecs::Registry::create();
+            simData::MemoryDataStore data_store;
+            auto adapter = std::make_shared<DataStoreAdapter>(rocky::VSGContext{}, ecs);
+            adapter->setThreads(1);
+            data_store.addListener(adapter);
+            build_scenario(data_store, options.stats, options);
+            adapter->stats.setEnabled(enabled != 0);
+
+            std::vector<double> frame_us;
+            double time = 0.0;
+            for (unsigned frame = 0; frame < options.frames; ++frame)
+            {
+                auto start = Clock::now();
+                {
+                    ScopedTimer timer(adapter->stats, FrameStats::DATASTORE_UPDATE);
+                    data_store.update(time);
+                }
+                adapter->update(&data_store);
+                frame_us.push_back(micros_since(start));
+                time = std::fmod(time + options.dt, (double)options.samples);
+            }
+            p50[enabled] = percentile(frame_us, 0.5);
+
+            if (enabled)
+            {
+                frames = adapter->stats.history();
+                if (!options.stats_out.empty())
+                {
+                    auto ends_with = [&](const std::string& suffix)
+                        {
+                            auto& path = options.stats_out;
+                            return path.size() >= suffix.size() && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+                        };
+                    std::ofstream out(options.stats_out);
+                    if (ends_with(".csv"))
+                        adapter->stats.writeCSV(out);
+                    else if (ends_with(".trace.json"))
+                        adapter->stats.writeChromeTrace(out);
+                    else
+                        adapter->stats.writeJSON(out);
+                }
+            }
+            data_store.removeListener(adapter);
+        }
+
+        printf("  frame p50: %.1f us off, %.1f us on (%+.1f%%)\n", p50[0], p50[1], p50[0] > 0.0 ? 100.0 * (p50[1] - p50[0]) / p50[0] : 0.0);
+
+        // skip the first frame, which creates every entity
+        if (frames.size() > 1)
+            frames.erase(frames.begin());
+        auto n = (double)std::max<std::size_t>(1u, frames.size());
+        for (unsigned i = 0; i < FrameStats::STAGE_COUNT; ++i)
+        {
+            double total = 0.0;
+            for (auto& frame : frames)
+                total += 1e-3 * (double)frame.stage_ns[i];
+            printf("  %-20s %10.1f us\n", FrameStats::name((FrameStats::Stage)i), total / n);
+        }
+        for (unsigned i = 0; i < FrameStats::COUNTER_COUNT; ++i)
+        {
+            double total = 0.0;
+            for (auto& frame : frames)
+                total += (double)frame.counters[i];
+            printf("  %-20s %10.1f\n", FrameStats::name((FrameStats::Counter)i), total / n);
+        }
+    }
+
+    /// Frame time with every entity moving each frame and a prefs burst on all
+    /// platforms every 50 frames, applied all at once and then within
+    /// options.frame_budget, with a view over the middle of the scenario so
+    /// about a tenth of the platforms are in view.
+    void run_schedule(const Options& options)
+    {
+        printf("\nframe budget, %u platforms, prefs burst every 50 frames:\n", options.schedule);
+        printf("%8s %9s %9s %9s %11s %9s\n", "budget", "p50(us)", "p99(us)", "max(us)", "stddev(us)", "deferred");
+
+        auto view = vsg::lookAt(vsg::dvec3(2.0e7, 0.0, 0.0), vsg::dvec3(0.0, 0.0, 0.0), vsg::dvec3(0.0, 0.0, 1.0));
+        auto projection = vsg::perspective(simCore::DEG2RAD * 15.0, 16.0 / 9.0, 1000.0, 3.0e7);
+
+        double stddev[2] = { 0.0, 0.0 };
+        for (int budgeted = 0; budgeted < 2; ++budgeted)
+        {
+            auto ecs = rocky::ecs::Registry::create();
+            simData::MemoryDataStore data_store;
+            auto adapter = std::make_shared<DataStoreAdapter>(rocky::VSGContext{}, ecs);
+            adapter->setThreads(1);
+            data_store.addListener(adapter);
+            build_scenario(data_store, options.schedule, options);
+
+            // create everything before timing
+            data_store.update(0.0);
+            adapter->update(&data_store);
+
+            if (budgeted)
+            {
+                adapter->frame_budget = options.frame_budget;
+                adapter->setView(projection * view);
+            }
+
+            std::vector<double> frame_us;
+            double time = 0.0, deferred = 0.0;
+            for (unsigned frame = 1; frame <= options.frames; ++frame)
+            {
+                if (frame % 50u == 0)
+                    prefs_burst(data_store, (frame / 50u) % 2u ? 2.0f : 1.0f);
+
+                time = std::fmod(time + options.dt, (double)options.samples);
+                auto start = Clock::now();
+                data_store.update(time);
+                adapter->update(&data_store);
+                frame_us.push_back(micros_since(start));
+                deferred += (double)adapter->deferred();
+            }
+            data_store.removeListener(adapter);
+
+            double mean = 0.0, variance = 0.0;
+            for (auto t : frame_us)
+                mean += t / (double)frame_us.size();
+            for (auto t : frame_us)
+                variance += (t - mean) * (t - mean) / (double)frame_us.size();
+            stddev[budgeted] = std::sqrt(variance);
+
+            char label[32];
+            snprintf(label, sizeof(label), budgeted ? "%.1fms" : "none", options.frame_budget);
+            printf("%8s %9.1f %9.1f %9.1f %11.1f %9.1f\n", label, percentile(frame_us, 0.5), percentile(frame_us, 0.99),
+                percentile(frame_us, 1.0), stddev[budgeted], deferred / (double)options.frames);
+        }
+
+        if (stddev[0] > 0.0)
+            printf("  frame time variance reduced by %.1f%%\n", 100.0 * (1.0 - (stddev[1] * stddev[1]) / (stddev[0] * stddev[0])));
+    }
+
+    /// Loads options.lazy platforms and runs a few frames, once with every
+    /// entity drawn and no view (so every entity is materialized), and once
+    /// with options.hidden of the platforms not drawn and a view over a small
+    /// part of the scenario. Reports the time to the first frame, visual
+    /// components created and resident memory growth for each.
+    void run_lazy(const Options& options)
+    {
+        printf("\nlazy visuals, %u platforms:\n", options.lazy);
+        printf("%-28s %12s %10s %10s %10s %10s %10s\n", "", "startup(ms)", "frame(us)", "lines", "labels", "icons", "rss(MB)");
+
+        auto run = [&](const char* name, double hidden, bool with_view)
+            {
+                auto rss_start = resident_bytes();
+                auto ecs = rocky::ecs::Registry::create();
+                simData::MemoryDataStore data_store;
+                auto adapter = std::make_shared<DataStoreAdapter>(rocky::VSGContext{}, ecs);
+                adapter->setThreads(1);
+                data_store.addListener(adapter);
+
+                auto ids = build_scenario(data_store, options.lazy, options);
+                unsigned p = 0;
+                for (auto id : ids)
+                {
+                    if (data_store.objectType(id) != simData::PLATFORM)
+                        continue;
+                    // the first 'hidden' of every hundred platforms are not drawn
+                    if ((double)(p++ % 100u) < 100.0 * hidden)
+                    {
+                        simData::DataStore::Transaction x;
+                        auto prefs = data_store.mutable_platformPrefs(id, &x);
+                        prefs->mutable_commonprefs()->set_draw(false);
+                        x.complete(&prefs);
+                    }
+                }
+
+                // looking down at (0, 0) from 6000 km up, over a small part of the grid
+                if (with_view)
+                {
+                    auto radius = 6378137.0;
+                    auto view = vsg::lookAt(vsg::dvec3(radius + 6.0e6, 0.0, 0.0), vsg::dvec3(radius, 0.0, 0.0), vsg::dvec3(0.0, 0.0, 1.0));
+                    auto projection = vsg::perspective(simCore::DEG2RAD * 30.0, 16.0 / 9.0, 1000.0, 2.0e7);
+                    adapter->setView(projection * view);
+                }
+
+                // the first frame creates the entities and their visuals
+                auto start = Clock::now();
+                data_store.update(0.0);
+                adapter->update(&data_store);
+                auto startup_ms = 1e-3 * micros_since(start);
+
+                std::vector<double> frame_us;
+                double time = 0.0;
+                for (unsigned frame = 0; frame < options.frames; ++frame)
+                {
+                    time = std::fmod(time + options.dt, (double)options.samples);
+                    auto frame_start = Clock::now();
+                    data_store.update(time);
+                    adapter->update(&data_store);
+                    frame_us.push_back(micros_since(frame_start));
+                }
+
+                auto rss = resident_bytes();
+                {
+                    auto [lock, registry] = ecs.read();
+                    printf("%-28s %12.1f %10.1f %10zu %10zu %10zu %10.1f\n", name, startup_ms, percentile(frame_us, 0.5),
+                        registry.storage<rocky::Line>().size(), registry.storage<rocky::Label>().size(),
+                        registry.storage<rocky::Icon>().size(), (double)(rss - std::min(rss, rss_start)) / 1048576.0);
+                }
+                data_store.removeListener(adapter);
+            };
+
+        // lazy first, so the eager run can't reuse memory it freed
+        char lazy_name[64];
+        std::snprintf(lazy_name, sizeof(lazy_name), "%.0f%% hidden, in view only", 100.0 * options.hidden);
+        run(lazy_name, options.hidden, true);
+        run("all drawn, no view", 0.0, false);
+    }
+
+    /// Soak test: options.churn platforms (with their beams and gates) live at
+    /// any time, and every frame the oldest 1% are removed from the DataStore
+    /// and as many new ones added, for ten times options.frames frames.
+    /// Resident memory should level off once the first generation is gone.
+    void run_churn(const Options& options)
+    {
+        auto ecs = rocky::ecs::Registry::create();
+        simData::MemoryDataStore data_store;
+        auto adapter = std::make_shared<DataStoreAdapter>(rocky::VSGContext{}, ecs);
+        adapter->setThreads(1);
+        data_store.addListener(adapter);
+
+        std::deque<simData::ObjectId> live;
+        auto add_platforms = [&](unsigned count)
+            {
+                for (auto id : build_scenario(data_store, count, options))
+                {
+                    if (data_store.objectType(id) == simData::PLATFORM)
+                        live.push_back(id);
+                }
+            };
+        add_platforms(options.churn);
+
+        auto turnover = std::max(1u, options.churn / 100u);
+        auto frames = 10u * options.frames;
+        std::vector<double> frame_us;
+        std::size_t rss_start = 0u, rss_peak = 0u;
+        double time = 0.0;
+        printf("\nentity churn, %u platforms live, %u replaced per frame:\n", options.churn, turnover);
+        printf("%8s %10s %10s %10s %10s\n", "frame", "rss(MB)", "entities", "records", "reused");
+
+        for (unsigned frame = 0; frame < frames; ++frame)
+        {
+            // removing a platform removes its beams and gates with it
+            for (unsigned i = 0; i < turnover; ++i)
+            {
+                data_store.removeEntity(live.front());
+                live.pop_front();
+            }
+            add_platforms(turnover);
+
+            time = std::fmod(time + options.dt, (double)options.samples);
+            auto start = Clock::now();
+            data_store.update(time);
+            adapter->update(&data_store);
+            frame_us.push_back(micros_since(start));
+
+            auto rss = resident_bytes();
+            rss_peak = std::max(rss_peak, rss);
+            // the first generation is gone after 100 frames
+            if (frame == 100u)
+                rss_start = rss;
+            if (frame % (frames / 10u) == 0u || frame + 1u == frames)
+            {
+                auto [lock, registry] = ecs.read();
+                printf("%8u %10.1f %10zu %10zu %10zu\n", frame, (double)rss / 1048576.0, adapter->sim.entities.size(),
+                    registry.storage<entt::entity>().size(), adapter->sim.components.reused());
+            }
+        }
+        data_store.removeListener(adapter);
+
+        auto rss_end = resident_bytes();
+        printf("  frame p50 %.1f us, p99 %.1f us; rss %.1f MB after the first generation, %.1f MB at the end (peak %.1f MB)\n",
+            percentile(frame_us, 0.5), percentile(frame_us, 0.99), (double)rss_start / 1048576.0,
+            (double)rss_end / 1048576.0, (double)rss_peak / 1048576.0);
+    }
+
+    /// Scatters options.spatial platforms around the globe at altitudes up to
+    /// 20 km, moves a tenth of them each frame (about 250 m), and times the
+    /// SpatialIndex maintenance and its radius and nearest queries against a
+    /// linear scan of the same positions.
+    void run_spatial(const Options& options)
+    {
+        const std::size_t n = options.spatial;
+        std::uint64_t seed = 7u;
+        auto random = [&seed]()
+            {
+                seed = seed * 6364136223846793005u + 1442695040888963407u;
+                return (double)(seed >> 11) / 9007199254740992.0;
+            };
+        auto on_globe = [&]()
+            {
+                double lon = simCore::DEG2RAD * 360.0 * random(), lat = std::asin(2.0 * random() - 1.0);
+                double r = 6378137.0 + 20000.0 * random();
+                return vsg::dvec3(r * cos(lat) * cos(lon), r * cos(lat) * sin(lon), r * sin(lat));
+            };
+
+        SpatialIndex index;
+        std::vector<vsg::dvec3> positions(n);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            positions[i] = on_globe();
+            index.move(entt::entity((std::uint32_t)i), (simData::ObjectId)i + 1u, positions[i]);
+        }
+        auto start = Clock::now();
+        index.apply();
+        auto build_us = micros_since(start);
+
+        std::vector<double> apply_ns;
+        for (unsigned frame = 0; frame < options.frames; ++frame)
+        {
+            std::size_t moved = 0;
+            for (std::size_t i = frame % 10u; i < n; i += 10u, ++moved)
+            {
+                positions[i] = positions[i] + vsg::dvec3(250.0 * (random() - 0.5), 250.0 * (random() - 0.5), 250.0 * (random() - 0.5));
+                index.move(entt::entity((std::uint32_t)i), (simData::ObjectId)i + 1u, positions[i]);
+            }
+            start = Clock::now();
+            index.apply();
+            if (moved > 0)
+                apply_ns.push_back(1e3 * micros_since(start) / (double)moved);
+        }
+
+        const unsigned queries = 1000;
+        const double radius = 100000.0;
+        const std::size_t k = 10;
+        std::vector<SpatialIndex::Hit> hits;
+        std::vector<std::pair<double, std::size_t>> scan;
+        std::size_t radius_hits = 0, mismatches = 0;
+        std::vector<vsg::dvec3> centers;
+        for (unsigned q = 0; q < queries; ++q)
+            centers.push_back(on_globe());
+
+        start = Clock::now();
+        for (auto& center : centers)
+        {
+            index.radius(center, radius, hits);
+            radius_hits += hits.size();
+        }
+        auto radius_us = micros_since(start) / queries;
+
+        start = Clock::now();
+        for (auto& center : centers)
+            index.nearest(center, k, hits);
+        auto nearest_us = micros_since(start) / queries;
+
+        start = Clock::now();
+        for (auto& center : centers)
+        {
+            scan.clear();
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                auto d = positions[i] - center;
+                auto d2 = d.x * d.x + d.y * d.y + d.z * d.z;
+                if (d2 <= radius * radius)
+                    scan.emplace_back(d2, i);
+            }
+            std::sort(scan.begin(), scan.end());
+            radius_hits -= scan.size();
+        }
+        auto scan_us = micros_since(start) / queries;
+
+        // spot check the nearest results against the scan
+        for (unsigned q = 0; q < 10 && q < queries; ++q)
+        {
+            scan.clear();
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                auto d = positions[i] - centers[q];
+                scan.emplace_back(d.x * d.x + d.y * d.y + d.z * d.z, i);
+            }
+            auto count = std::min(k, scan.size());
+            std::partial_sort(scan.begin(), scan.begin() + count, scan.end());
+            index.nearest(centers[q], k, hits);
+            for (std::size_t i = 0; i < count && i < hits.size(); ++i)
+                mismatches += (std::size_t)entt::to_integral(hits[i].entity) != scan[i].second;
+        }
+
+        printf("\nspatial index, %zu platforms:\n", n);
+        printf("  build %.1f ms, apply %.1f ns/moved platform (p50), %.1f (p99)\n", 1e-3 * build_us, percentile(apply_ns, 0.5), percentile(apply_ns, 0.99));
+        printf("  radius %.0f km: %.1f us/query (linear scan %.1f us), nearest %zu: %.1f us/query\n",
+            1e-3 * radius, radius_us, scan_us, k, nearest_us);
+        if (radius_hits != 0 || mismatches != 0)
+            printf("  MISMATCH: %zu radius hits, %zu nearest\n", radius_hits, mismatches);
+    }
+
+    /// Converts options.geo random geodetic points to ECEF one at a time through
+    /// rocky::SRS, then in batches with the scalar and (if available) AVX2
+    /// kernels, reporting throughput and the largest difference from rocky.
+    void run_geo_batch(const Options& options)
+    {
+        const std::size_t n = options.geo;
+        std::vector<double> lon(n), lat(n), alt(n);
+        std::uint64_t seed = 42u;
+        auto random = [&seed]()
+            {
+                seed = seed * 6364136223846793005u + 1442695040888963407u;
+                return (double)(seed >> 11) / 9007199254740992.0;
+            };
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            lon[i] = -180.0 + 360.0 * random();
+            lat[i] = -90.0 + 180.0 * random();
+            alt[i] = -500.0 + 500000.0 * random();
+        }
+
+        printf("\ngeodetic to ECEF, %zu points (simd %s):\n", n, GeoBatch::simd() ? "avx2" : "unavailable");
+        printf("%12s %10s %14s\n", "mode", "ns/point", "max err(m)");
+
+        std::vector<double> rx(n), ry(n), rz(n);
+        auto geo_to_ecef = rocky::SRS::WGS84.to(rocky::SRS::ECEF);
+        auto start = Clock::now();
+        simCore::Vec3 ecef;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            geo_to_ecef.transform(vsg::dvec3{ lon[i], lat[i], alt[i] }, ecef);
+            rx[i] = ecef[0], ry[i] = ecef[1], rz[i] = ecef[2];
+        }
+        printf("%12s %10.1f %14s\n", "rocky::SRS", 1e3 * micros_since(start) / (double)n, "-");
+
+        std::vector<double> x(n), y(n), z(n);
+        auto report = [&](const char* mode, double us)
+            {
+                double error = 0.0;
+                for (std::size_t i = 0; i < n; ++i)
+                    error = std::max({ error, std::abs(x[i] - rx[i]), std::abs(y[i] - ry[i]), std::abs(z[i] - rz[i]) });
+                printf("%12s %10.1f %14.3g\n", mode, 1e3 * us / (double)n, error);
+            };
+
+        start = Clock::now();
+        GeoBatch::scalar::geodeticToECEF(n, lon.data(), lat.data(), alt.data(), x.data(), y.data(), z.data());
+        report("scalar", micros_since(start));
+
+        if (GeoBatch::simd())
+        {
+            start = Clock::now();
+            GeoBatch::geodeticToECEF(n, lon.data(), lat.data(), alt.data(), x.data(), y.data(), z.data());
+            report("avx2", micros_since(start));
+        }
+    }
+
+    /// Records options.recording platforms (with their beams and gates) for
+    /// options.recording_seconds at 1 Hz, then replays the file: reports the
+    /// recording rate and size, replay startup time, per-frame load cost and
+    /// resident memory while playing through the whole recording.
+    void run_recording(const Options& options)
+    {
+        auto path = std::string("simdemo-bench-recording.bin");
+        printf("\nrecording, %u platforms x %u s:\n", options.recording, options.recording_seconds);
+
+        std::size_t file_bytes = 0;
+        std::uint64_t recorded = 0;
+        double record_s = 0.0;
+        {
+            simData::MemoryDataStore data_store;
+            auto recorder = std::make_shared<Recorder>(path);
+            data_store.addListener(recorder);
+
+            // the recorder learns of entities as they are added
+            auto scenario = options;
+            scenario.samples = 0;
+            auto ids = build_scenario(data_store, options.recording, scenario);
+
+            // keep only the newest samples in the source DataStore
+            data_store.setDataLimiting(true);
+            for (auto id : ids)
+            {
+                simData::DataStore::Transaction x;
+                auto prefs = data_store.mutable_commonPrefs(id, &x);
+                if (prefs)
+                    prefs->set_datalimitpoints(2);
+                x.complete(&prefs);
+            }
+
+            auto start = Clock::now();
+            for (unsigned s = 0; s < options.recording_seconds; ++s)
+            {
+                auto time = (double)s;
+                for (auto id : ids)
+                {
+                    simData::DataStore::Transaction x;
+                    auto type = data_store.objectType(id);
+                    if (type == simData::PLATFORM)
+                    {
+                        auto update = data_store.addPlatformUpdate(id, &x);
+                        update->set_time(time);
+                        update->set_x(6378137.0 + 10.0 * s), update->set_y((double)id), update->set_z(0.0);
+                        x.complete(&update);
+                    }
+                    else if (type == simData::BEAM)
+                    {
+                        auto update = data_store.addBeamUpdate(id, &x);
+                        update->set_time(time);
+                        update->set_azimuth(0.5 * sin(time)), update->set_elevation(0.1), update->set_range(20000.0);
+                        x.complete(&update);
+                    }
+                    else if (type == simData::GATE)
+                    {
+                        auto update = data_store.addGateUpdate(id, &x);
+                        update->set_time(time);
+                        update->set_azimuth(0.5 * sin(time)), update->set_elevation(0.1);
+                        update->set_width(0.1), update->set_height(0.1);
+                        update->set_minrange(5000.0), update->set_maxrange(6000.0);
+                        x.complete(&update);
+                    }
+                }
+                data_store.update(time);
+            }
+            data_store.removeListener(recorder);
+            recorded = recorder->samples();
+            if (!recorder->close())
+                return;
+            record_s = 1e-6 * micros_since(start);
+
+            std::ifstream file(path, std::ios::binary | std::ios::ate);
+            file_bytes = (std::size_t)file.tellg();
+        }
+
+        printf("  recorded %llu samples in %.1f s (%.0f samples/s), file %.1f MB\n",
+            (unsigned long long)recorded, record_s, record_s > 0.0 ? (double)recorded / record_s : 0.0, (double)file_bytes / 1048576.0);
+
+        {
+            simData::MemoryDataStore data_store;
+            auto rss_start = resident_bytes();
+
+            auto start = Clock::now();
+            auto replayer = Replayer::open(path, data_store);
+            if (!replayer)
+                return;
+            auto open_ms = 1e-3 * micros_since(start);
+            auto rss_open = resident_bytes();
+
+            std::vector<double> load_us;
+            std::size_t rss_peak = rss_open;
+            std::size_t loaded = 0;
+            for (double time = replayer->firstTime(); time <= replayer->lastTime(); time += 10.0 * options.dt)
+            {
+                auto t0 = Clock::now();
+                loaded += replayer->update(time);
+                load_us.push_back(micros_since(t0));
+                data_store.update(time);
+                rss_peak = std::max(rss_peak, resident_bytes());
+            }
+
+            printf("  replay: open %.1f ms (+%.1f MB), load p50 %.1f us, p99 %.1f us, max %.1f us, %zu samples loaded, peak +%.1f MB rss\n",
+                open_ms,
+                (double)(rss_open - std::min(rss_open, rss_start)) / 1048576.0,
+                percentile(load_us, 0.5), percentile(load_us, 0.99), percentile(load_us, 1.0),
+                loaded,
+                (double)(rss_peak - std::min(rss_peak, rss_start)) / 1048576.0);
+        }
+
+        std::remove(path.c_str());
+    }
+
+    /// Declutters options.declutter labels spread over a 4000 km square seen
+    /// from 6000 km up in a 1920x1080 view, moving every label a little each
+    /// frame, and reports the time per pass and how many labels it switches.
+    void run_declutter(const Options& options)
+    {
+        const double width = 1920.0, height = 1080.0;
+        std::uint64_t seed = 11u;
+        auto random = [&seed]()
+            {
+                seed = seed * 6364136223846793005u + 1442695040888963407u;
+                return (double)(seed >> 11) / 9007199254740992.0;
+            };
+
+        // looking down at 0 N, 0 E
+        const double radius = 6378137.0;
+        auto view = vsg::lookAt(vsg::dvec3(radius + 6.0e6, 0.0, 0.0), vsg::dvec3(radius, 0.0, 0.0), vsg::dvec3(0.0, 0.0, 1.0));
+        auto projection = vsg::perspective(simCore::DEG2RAD * 30.0, width / height, 1000.0, 2.0e7);
+        auto view_projection = projection * view;
+
+        entt::registry registry;
+        std::vector<entt::entity> entities;
+        for (unsigned i = 0; i < options.declutter; ++i)
+        {
+            auto entity = registry.create();
+            auto& label = registry.emplace<rocky::Label>(entity);
+            label.text = "TRK-" + std::to_string(10000 + i);
+            label.style.pointSize = 14.0f;
+            label.style.horizontalAlignment = vsg::StandardLayout::LEFT_ALIGNMENT;
+            label.style.verticalAlignment = vsg::StandardLayout::CENTER_ALIGNMENT;
+            registry.emplace<DeclutterLabel>(entity).priority = (double)(i % 4u);
+            auto& transform = registry.emplace<rocky::Transform>(entity);
+            transform.position = rocky::GeoPoint(rocky::SRS::ECEF, radius, 4.0e6 * (random() - 0.5), 4.0e6 * (random() - 0.5));
+            entities.push_back(entity);
+        }
+
+        LabelDeclutter declutter;
+        std::vector<double> pass_us;
+        double changed = 0.0;
+        for (unsigned frame = 0; frame < options.frames; ++frame)
+        {
+            for (auto entity : entities)
+            {
+                auto& transform = registry.get<rocky::Transform>(entity);
+                transform.position.y += 500.0 * (random() - 0.5);
+                transform.position.z += 500.0 * (random() - 0.5);
+            }
+
+            auto start = Clock::now();
+            declutter.apply(registry, view_projection, width, height);
+            pass_us.push_back(micros_since(start));
+            if (frame > 0)
+                changed += (double)declutter.changed();
+        }
+
+        printf("\nlabel declutter, %u labels: %.1f us/pass (p50), %.1f (p99), %zu shown, %zu hidden, %.1f switched/frame\n",
+            options.declutter, percentile(pass_us, 0.5), percentile(pass_us, 0.99), declutter.shown(), declutter.hidden(),
+            changed / (double)std::max(1u, options.frames - 1u));
+    }
+
+    /// Appends a point to every track each frame, with the track count doubling
+    /// halfway through so the budget forces the rings to shrink.
+    void run_tracks(const Options& options)
+    {
+        entt::registry registry;
+        TrackHistory tracks;
+        ComponentPool components;
+        std::vector<entt::entity> entities;
+        auto add_tracks = [&](unsigned count)
+            {
+                for (unsigned i = 0; i < count; ++i)
+                {
+                    auto entity = registry.create();
+                    tracks.enable(entity, 0.0, vsg::vec4{ 1, 1, 1, 1 }, 2.0f, registry);
+                    tracks.show(entity, components, registry);
+                    entities.push_back(entity);
+                }
+            };
+        add_tracks(options.tracks);
+
+        std::vector<double> append_ns, apply_us;
+        double appended = 0.0, copied = 0.0;
+        std::size_t peak_reserved = 0u;
+        auto frames = std::max(options.frames, 2u);
+        for (unsigned frame = 0; frame < frames; ++frame)
+        {
+            if (frame == frames / 2u)
+                add_tracks(options.tracks);
+
+            auto start = Clock::now();
+            for (std::size_t i = 0; i < entities.size(); ++i)
+            {
+                double angle = 0.001 * (double)(frame + i);
+                registry.get<Track>(entities[i]).append((double)frame,
+                    vsg::dvec3(7.0e6 * cos(angle), 7.0e6 * sin(angle), 1000.0 * (double)i));
+            }
+            append_ns.push_back(1000.0 * micros_since(start) / (double)entities.size());
+
+            start = Clock::now();
+            tracks.apply(registry);
+            apply_us.push_back(micros_since(start));
+
+            appended += (double)entities.size();
+            copied += (double)tracks.copied();
+            peak_reserved = std::max(peak_reserved, tracks.reserved());
+        }
+
+        std::size_t held = 0u;
+        for (auto [entity, track] : registry.view<Track>().each())
+            held += track.count;
+
+        printf("\ntrack history, %zu tracks, budget %zu points: append %.1f ns/point (p50), apply %.1f us/frame (p50), %.1f (p99)\n",
+            tracks.size(), tracks.point_budget, percentile(append_ns, 0.5), percentile(apply_us, 0.5), percentile(apply_us, 0.99));
+        printf("  %.2f points copied to lines per point appended; %zu points held, %zu reserved (peak %zu), %zu pooled\n",
+            copied / appended, held, tracks.reserved(), peak_reserved, tracks.pooled());
+    }
+
+    /// Times the batch gate geometry generator alone: every gate changes every
+    /// frame, as with a scanning sensor.
+    void run_gate_geometry(const Options& options)
+    {
+        GateGeometryBatch batch;
+        std::vector<double> generate_us;
+        double checksum = 0.0;
+
+        for (unsigned f = 0; f < options.frames; ++f)
+        {
+            for (unsigned g = 0; g < options.gate_batch; ++g)
+            {
+                double t = 0.01 * (double)(f + g);
+                batch.add(entt::entity(g), 0.5 * sin(t), 0.1 * cos(t), simCore::DEG2RAD * 5.0, simCore::DEG2RAD * 3.0,
+                    1000.0 + 10.0 * g, 1500.0 + 10.0 * g);
+            }
+
+            auto start = Clock::now();
+            batch.generate();
+            generate_us.emplace_back(micros_since(start));
+
+            checksum += batch.points(batch.size() - 1)->x;
+            batch.clear();
+        }
+
+        auto us = percentile(generate_us, 0.5);
+        printf("\ngate geometry: %u gates/batch, %.1f us/batch (p50), %.0f gates/ms\n",
+            options.gate_batch, us, us > 0.0 ? 1e3 * (double)options.gate_batch / us : 0.0);
+
+        if (checksum == 42.0)
+            printf(" ");
+    }
+
+    /// Counts and reports a failed check.
+    struct Checks
+    {
+        unsigned failed = 0;
+
+        void expect(bool ok, const char* what)
+        {
+            if (!ok)
+            {
+                printf("  FAILED: %s\n", what);
+                ++failed;
+            }
+        }
+    };
+
+    /// parallel_for visits every index exactly once, with or without a pool.
+    void check_parallel_for(Checks& checks)
+    {
+        WorkerPool pool(3);
+        for (auto* p : { (WorkerPool*)nullptr, &pool })
+        {
+            for (std::size_t count : { 0, 1, 7, 1000, 100000 })
+            {
+                for (std::size_t grain : { 1, 64, 1024, 200000 })
+                {
+                    std::vector<std::atomic<unsigned>> visits(count);
+                    parallel_for(p, count, grain, [&](std::size_t begin, std::size_t end)
+                        {
+                            for (auto i = begin; i < end; ++i)
+                                visits[i].fetch_add(1u, std::memory_order_relaxed);
+                        });
+                    bool once = std::all_of(visits.begin(), visits.end(), [](const std::atomic<unsigned>& v) { return v.load() == 1u; });
+                    checks.expect(once, "parallel_for visits every index once");
+                }
+            }
+        }
+    }
+
+    /// An SpscRing smaller than the stream hands every value over, in order.
+    void check_spsc_ring(Checks& checks)
+    {
+        const std::uint64_t n = 1000000u;
+        SpscRing<std::uint64_t> ring(1024u);
+
+        std::thread producer([&]()
+            {
+                for (std::uint64_t i = 0; i < n; ++i)
+                {
+                    auto value = i;
+                    while (!ring.push(std::move(value)))
+                        std::this_thread::yield();
+                }
+            });
+
+        std::uint64_t expected = 0u, out_of_order = 0u;
+        while (expected < n)
+        {
+            std::uint64_t value;
+            if (!ring.pop(value))
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            out_of_order += value != expected;
+            ++expected;
+        }
+        producer.join();
+
+        checks.expect(out_of_order == 0u, "SpscRing delivers values in order");
+        checks.expect(ring.empty(), "SpscRing is empty once drained");
+    }
+
+    /// Radius and frustum queries of the SpatialIndex find the same entities
+    /// as a linear scan, including after entities move and are erased.
+    void check_spatial_index(Checks& checks)
+    {
+        const std::size_t n = 20000;
+        std::uint64_t seed = 11u;
+        auto random = [&seed]()
+            {
+                seed = seed * 6364136223846793005u + 1442695040888963407u;
+                return (double)(seed >> 11) / 9007199254740992.0;
+            };
+        auto on_globe = [&]()
+            {
+                double lon = simCore::DEG2RAD * 360.0 * random(), lat = std::asin(2.0 * random() - 1.0);
+                double r = 6378137.0 + 20000.0 * random();
+                return vsg::dvec3(r * cos(lat) * cos(lon), r * cos(lat) * sin(lon), r * sin(lat));
+            };
+
+        SpatialIndex index;
+        std::vector<vsg::dvec3> positions(n);
+        std::vector<bool> indexed(n, true);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            positions[i] = on_globe();
+            index.move(entt::entity((std::uint32_t)i), (simData::ObjectId)i + 1u, positions[i]);
+        }
+        index.apply();
+        for (std::size_t i = 0; i < n; i += 3u)
+        {
+            positions[i] = on_globe();
+            index.move(entt::entity((std::uint32_t)i), (simData::ObjectId)i + 1u, positions[i]);
+        }
+        for (std::size_t i = 1; i < n; i += 7u)
+        {
+            indexed[i] = false;
+            index.erase(entt::entity((std::uint32_t)i));
+        }
+        index.apply();
+
+        auto sorted = [](const std::vector<SpatialIndex::Hit>& hits)
+            {
+                std::vector<std::size_t> result;
+                for (auto& hit : hits)
+                    result.push_back((std::size_t)entt::to_integral(hit.entity));
+                std::sort(result.begin(), result.end());
+                return result;
+            };
+
+        std::vector<SpatialIndex::Hit> hits;
+        std::vector<std::size_t> scan;
+        std::size_t radius_mismatches = 0, frustum_mismatches = 0;
+        for (unsigned q = 0; q < 100; ++q)
+        {
+            auto center = on_globe();
+            double r = 20000.0 + 500000.0 * random();
+
+            scan.clear();
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                auto d = positions[i] - center;
+                if (indexed[i] && d.x * d.x + d.y * d.y + d.z * d.z <= r * r)
+                    scan.push_back(i);
+            }
+            index.radius(center, r, hits);
+            radius_mismatches += sorted(hits) != scan;
+
+            // a box around the center, cut by an oblique plane through it
+            std::vector<SpatialIndex::Plane> planes = {
+                { 1, 0, 0, r - center.x }, { -1, 0, 0, r + center.x },
+                { 0, 1, 0, r - center.y }, { 0, -1, 0, r + center.y },
+                { 0, 0, 1, r - center.z }, { 0, 0, -1, r + center.z } };
+            vsg::dvec3 normal(random() - 0.5, random() - 0.5, random() - 0.5);
+            planes.emplace_back(normal.x, normal.y, normal.z, -vsg::dot(normal, center));
+
+            scan.clear();
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                auto& p = positions[i];
+                bool inside = indexed[i] && std::all_of(planes.begin(), planes.end(),
+                    [&](const SpatialIndex::Plane& plane) { return plane.x * p.x + plane.y * p.y + plane.z * p.z + plane.w >= 0.0; });
+                if (inside)
+                    scan.push_back(i);
+            }
+            index.frustum(planes, hits);
+            frustum_mismatches += sorted(hits) != scan;
+        }
+
+        checks.expect(index.size() == (std::size_t)std::count(indexed.begin(), indexed.end(), true), "SpatialIndex counts its entities");
+        checks.expect(radius_mismatches == 0u, "SpatialIndex radius queries match a linear scan");
+        checks.expect(frustum_mismatches == 0u, "SpatialIndex frustum queries match a linear scan");
+    }
+
+    /// A gate queued several times in one batch is generated once, with its
+    /// latest extents, including when the batch is generated in parallel
+    /// chunks; and the adapter rebuilds each gate once in a frame where its
+    /// draw mode and its update both change.
+    void check_gate_batch(Checks& checks, const Options& options)
+    {
+        const std::size_t n = 5000;
+        auto extents = [](std::size_t g, unsigned round, double (&e)[6])
+            {
+                double t = 0.1 * (double)(g + 7u * round);
+                e[0] = 0.5 * sin(t), e[1] = 0.1 * cos(t);
+                e[2] = simCore::DEG2RAD * (5.0 + (double)((g + round) % 40u) * 9.0);
+                e[3] = simCore::DEG2RAD * (3.0 + (double)round);
+                e[4] = 1000.0 + (double)g, e[5] = 1500.0 + (double)(g + round);
+            };
+
+        GateGeometryBatch batch, expected;
+        double e[6];
+        for (unsigned round = 0; round < 3; ++round)
+        {
+            for (std::size_t g = 0; g < n; ++g)
+            {
+                extents(g, round, e);
+                batch.add(entt::entity((std::uint32_t)g), e[0], e[1], e[2], e[3], e[4], e[5]);
+            }
+        }
+        for (std::size_t g = 0; g < n; ++g)
+        {
+            extents(g, 2u, e);
+            expected.add(entt::entity((std::uint32_t)g), e[0], e[1], e[2], e[3], e[4], e[5]);
+        }
+        checks.expect(batch.size() == n, "a gate queued several times is in the batch once");
+
+        WorkerPool pool(3);
+        batch.reserve();
+        parallel_for(&pool, batch.size(), 64u, [&](std::size_t begin, std::size_t end) { batch.generate(begin, end); });
+        expected.generate();
+
+        std::size_t mismatches = 0;
+        for (std::size_t i = 0; i < batch.size() && i < expected.size(); ++i)
+        {
+            bool same = batch.entity(i) == expected.entity(i) && batch.count(i) == expected.count(i) &&
+                std::equal(batch.points(i), batch.points(i) + batch.count(i), expected.points(i),
+                    [](const vsg::dvec3& a, const vsg::dvec3& b) { return a.x == b.x && a.y == b.y && a.z == b.z; });
+            mismatches += !same;
+        }
+        checks.expect(mismatches == 0u, "a gate queued several times is generated with its latest extents");
+
+        // through the adapter: materializing, a draw mode change and an update
+        // all queue the gate
+        auto ecs = rocky::ecs::Registry::create();
+        simData::MemoryDataStore data_store;
+        auto adapter = std::make_shared<DataStoreAdapter>(rocky::VSGContext{}, ecs);
+        adapter->setThreads(4);
+        data_store.addListener(adapter);
+        auto scenario = options;
+        scenario.beams_per_platform = 1, scenario.gates_per_beam = 3, scenario.samples = 2;
+        auto ids = build_scenario(data_store, 500, scenario);
+        adapter->stats.setEnabled(true);
+
+        std::uint64_t gates = 0u;
+        for (auto id : ids)
+            gates += data_store.objectType(id) == simData::GATE;
+
+        data_store.update(0.0);
+        adapter->update(&data_store);
+        auto frames = adapter->stats.history();
+        checks.expect(!frames.empty() && frames.back().counters[FrameStats::GEOMETRY_REBUILDS] == gates,
+            "the adapter builds each new gate once");
+
+        for (auto id : ids)
+        {
+            if (data_store.objectType(id) != simData::GATE)
+                continue;
+            simData::DataStore::Transaction x;
+            auto prefs = data_store.mutable_gatePrefs(id, &x);
+            prefs->set_gatedrawmode(simData::GatePrefs::SECTOR);
+            x.complete(&prefs);
+        }
+        data_store.update(1.0);
+        adapter->update(&data_store);
+        frames = adapter->stats.history();
+        checks.expect(!frames.empty() && frames.back().counters[FrameStats::GEOMETRY_REBUILDS] == gates,
+            "the adapter rebuilds a gate once when its draw mode and update change together");
+
+        data_store.removeListener(adapter);
+    }
+
+    /// A recording replays the samples it recorded: records a few platforms,
+    /// beams and gates for long enough to write several chunks of each,
+    /// removing one platform part way, then replays the file into a new
+    /// DataStore and compares each entity's current update with what was
+    /// recorded at that time, playing forward and after seeking back.
+    void check_recording(Checks& checks, const Options& options)
+    {
+        auto path = std::string("simdemo-bench-check.bin");
+        const unsigned seconds = 2u * Recorder::chunk_size + 500u;
+        const unsigned removed_at = Recorder::chunk_size + 100u;
+
+        // the recorded values at second s of the entity recorded as 'id'
+        auto platform_at = [](simData::ObjectId id, unsigned s) { return vsg::dvec3(6378137.0 + 10.0 * s, (double)id, 0.5 * s); };
+        auto beam_at = [](unsigned s) { return vsg::dvec3(0.5 * sin((double)s), 0.1, 20000.0 + s); };
+        auto gate_at = [](unsigned s) { return vsg::dvec3(0.5 * sin((double)s), 5000.0 + s, 6000.0 + s); };
+
+        std::vector<simData::ObjectId> ids;
+        simData::ObjectId removed = 0;
+        std::vector<simData::ObjectId> removed_ids;
+        {
+            simData::MemoryDataStore data_store;
+            auto recorder = std::make_shared<Recorder>(path);
+            data_store.addListener(recorder);
+
+            auto scenario = options;
+            scenario.beams_per_platform = 1, scenario.gates_per_beam = 1, scenario.samples = 0;
+            ids = build_scenario(data_store, 3, scenario);
+            removed = ids[0];
+            removed_ids.assign(ids.begin(), ids.begin() + 3);
+
+            for (unsigned s = 0; s < seconds; ++s)
+            {
+                if (s == removed_at)
+                    data_store.removeEntity(removed);
+
+                auto time = (double)s;
+                for (auto id : ids)
+                {
+                    simData::DataStore::Transaction x;
+                    auto type = data_store.objectType(id);
+                    if (type == simData::PLATFORM)
+                    {
+                        auto v = platform_at(id, s);
+                        auto update = data_store.addPlatformUpdate(id, &x);
+                        update->set_time(time);
+                        update->set_x(v.x), update->set_y(v.y), update->set_z(v.z);
+                        x.complete(&update);
+                    }
+                    else if (type == simData::BEAM)
+                    {
+                        auto v = beam_at(s);
+                        auto update = data_store.addBeamUpdate(id, &x);
+                        update->set_time(time);
+                        update->set_azimuth(v.x), update->set_elevation(v.y), update->set_range(v.z);
+                        x.complete(&update);
+                    }
+                    else if (type == simData::GATE)
+                    {
+                        auto v = gate_at(s);
+                        auto update = data_store.addGateUpdate(id, &x);
+                        update->set_time(time);
+                        update->set_azimuth(v.x), update->set_elevation(0.1);
+                        update->set_width(0.1), update->set_height(0.1);
+                        update->set_minrange(v.y), update->set_maxrange(v.z);
+                        x.complete(&update);
+                    }
+                }
+                data_store.update(time);
+            }
+            data_store.removeListener(recorder);
+            checks.expect(recorder->close(), "the recording is written");
+        }
+
+        {
+            simData::MemoryDataStore data_store;
+            auto replayer = Replayer::open(path, data_store);
+            checks.expect(replayer != nullptr, "the recording opens");
+            if (replayer)
+            {
+                checks.expect(replayer->firstTime() == 0.0 && replayer->lastTime() == (double)(seconds - 1u), "the recording spans the recorded time");
+
+                std::size_t compared = 0, mismatches = 0;
+                auto compare = [&](double time)
+                    {
+                        replayer->update(time);
+                        data_store.update(time);
+
+                        auto s = (unsigned)time;
+                        for (auto id : ids)
+                        {
+                            bool gone = std::find(removed_ids.begin(), removed_ids.end(), id) != removed_ids.end() && s >= removed_at;
+                            auto replayed = replayer->idOf(id);
+                            if (gone || replayed == 0)
+                            {
+                                mismatches += replayed == 0;
+                                continue;
+                            }
+
+                            bool same = false;
+                            auto type = data_store.objectType(replayed);
+                            if (type == simData::PLATFORM)
+                            {
+                                auto* u = data_store.platformUpdateSlice(replayed)->current();
+                                auto v = platform_at(id, s);
+                                same = u && u->time() == (double)s && u->x() == v.x && u->y() == v.y && u->z() == v.z;
+                            }
+                            else if (type == simData::BEAM)
+                            {
+                                auto* u = data_store.beamUpdateSlice(replayed)->current();
+                                auto v = beam_at(s);
+                                same = u && u->time() == (double)s && u->azimuth() == v.x && u->elevation() == v.y && u->range() == v.z;
+                            }
+                            else if (type == simData::GATE)
+                            {
+                                auto* u = data_store.gateUpdateSlice(replayed)->current();
+                                auto v = gate_at(s);
+                                same = u && u->time() == (double)s && u->azimuth() == v.x && u->minrange() == v.y && u->maxrange() == v.z;
+                            }
+                            mismatches += !same;
+                            ++compared;
+                        }
+                    };
+
+                for (double time = 0.5; time < (double)seconds; time += 7.25)
+                    compare(time);
+                for (double time = 1000.5; time < 1100.0; time += 3.0)
+                    compare(time);
+
+                checks.expect(compared > 0u && mismatches == 0u, "a recording replays the samples it recorded");
+            }
+        }
+
+        std::remove(path.c_str());
+    }
+
+    /// Runs the correctness checks of the pieces the benchmarks time.
+    ///@return the number of failed checks
+    unsigned run_checks(const Options& options)
+    {
+        Checks checks;
+        printf("checks:\n");
+
+        check_parallel_for(checks);
+        check_spsc_ring(checks);
+        check_spatial_index(checks);
+        check_gate_batch(checks, options);
+        check_recording(checks, options);
+
+        printf("  %s\n", checks.failed == 0u ? "all passed" : "some failed");
+        return checks.failed;
+    }
+}
+
+int
+main(int argc, char** argv)
+{
+    Options options;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg(argv[i]);
+        bool has_value = i + 1 < argc;
+        if (arg == "--platforms" && has_value) options.platforms = parse_list(argv[++i]);
+        else if (arg == "--threads" && has_value) options.threads = parse_list(argv[++i]);
+        else if (arg == "--beams" && has_value) options.beams_per_platform = (unsigned)std::atoi(argv[++i]);
+        else if (arg == "--gates" && has_value) options.gates_per_beam = (unsigned)std::atoi(argv[++i]);
+        else if (arg == "--icons" && has_value) options.icons = (unsigned)std::atoi(argv[++i]);
+        else if (arg == "--samples" && has_value) options.samples = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--frames" && has_value) options.frames = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--dt" && has_value) options.dt = std::atof(argv[++i]);
+        else if (arg == "--sim-thread" && has_value) options.sim_thread = (unsigned)std::atoi(argv[++i]);
+        else if (arg == "--stress" && has_value) options.stress = (unsigned)std::atoi(argv[++i]);
+        else if (arg == "--readers" && has_value) options.readers = (unsigned)std::atoi(argv[++i]);
+        else if (arg == "--budget" && has_value) options.budget = (unsigned)std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--gate-batch" && has_value) options.gate_batch = (unsigned)std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--recording" && has_value) options.recording = (unsigned)std::atoi(argv[++i]);
+        else if (arg == "--stats" && has_value) options.stats = (unsigned)std::atoi(argv[++i]);
+        else if (arg == "--stats-out" && has_value) options.stats_out = argv[++i];
+        else if (arg == "--spatial" && has_value) options.spatial = (unsigned)std::atoi(argv[++i]);
+        else if (arg == "--declutter" && has_value) options.declutter = (unsigned)std::atoi(argv[++i]);
+        else if (arg == "--tracks" && has_value) options.tracks = (unsigned)std::atoi(argv[++i]);
+        else if (arg == "--schedule" && has_value) options.schedule = (unsigned)std::atoi(argv[++i]);
+        else if (arg == "--churn" && has_value) options.churn = (unsigned)std::atoi(argv[++i]);
+        else if (arg == "--lazy" && has_value) options.lazy = (unsigned)std::atoi(argv[++i]);
+        else if (arg == "--hidden" && has_value) options.hidden = std::atof(argv[++i]);
+        else if (arg == "--frame-budget" && has_value) options.frame_budget = std::max(0.1, std::atof(argv[++i]));
+        else if (arg == "--geo" && has_value) options.geo = (unsigned)std::atoi(argv[++i]);
+        else if (arg == "--ingest" && has_value) options.ingest = (unsigned)std::atoi(argv[++i]);
+        else if (arg == "--check") options.check = true;
+        else if (arg == "--recording-seconds" && has_value) options.recording_seconds = (unsigned)std::max(1, std::atoi(argv[++i]));
+        else
+        {
+            printf("Usage: %s [--platforms N,N,...] [--threads N,N,...] [--beams N] [--gates N] [--icons N] [--samples N] [--frames N] [--dt seconds] [--sim-thread N] [--budget N] [--stress N] [--readers N] [--gate-batch N] [--recording N] [--recording-seconds N] [--ingest N] [--geo N] [--stats N] [--stats-out file] [--spatial N] [--declutter N] [--tracks N] [--schedule N] [--frame-budget ms] [--churn N] [--lazy N] [--hidden fraction] [--check]\n", argv[0]);
+            return arg == "--help" ? 0 : -1;
+        }
+    }
+
+    rocky::Log()->set_level(rocky::log::level::warn);
+
+    if (options.check)
+        return run_checks(options) == 0u ? 0 : 1;
+
+    printf("beams/platform=%u gates/beam=%u icons=%u samples=%u frames=%u dt=%.3f\n\n",
+        options.beams_per_platform, options.gates_per_beam, options.icons, options.samples, options.frames, options.dt);
+
+    printf("%7s %9s %9s %9s %10s %8s %11s %9s %9s %9s %9s %9s %9s %9s %8s %9s %9s %8s %8s %12s\n",
+        "threads", "platforms", "entities", "dirty/frm", "build(ms)", "events", "listen(ms)", "ns/event", "flush(ms)", "coalesced",
+        "ds50(us)", "upd50(us)", "upd90(us)", "upd99(us)", "ns/ent", "noop(ns)", "iter(M/s)", "+rss(MB)", "rss(MB)", "images/icons");
+
+    for (auto num_platforms : options.platforms)
+    {
+        for (auto num_threads : options.threads)
+        {
+            run_scale(num_platforms, std::max(1u, num_threads), options);
+        }
+    }
+
+    if (options.sim_thread > 0)
+        run_sim_thread(options);
+
+    if (options.stress > 0 && options.readers > 0)
+        run_snapshot_stress(options);
+
+    if (options.stats > 0)
+        run_stats(options);
+
+    if (options.spatial > 0)
+        run_spatial(options);
+
+    if (options.declutter > 0)
+        run_declutter(options);
+
+    if (options.tracks > 0)
+        run_tracks(options);
+
+    if (options.schedule > 0)
+        run_schedule(options);
+
+    if (options.churn > 0)
+        run_churn(options);
+
+    if (options.lazy > 0)
+        run_lazy(options);
+
+    if (options.geo > 0)
+        run_geo_batch(options);
+
+    if (options.ingest > 0)
+        run_bulk_ingest(options);
+
+    if (options.recording > 0)
+        run_recording(options);
+
+    run_gate_geometry(options);
+
+    return 0;
+}
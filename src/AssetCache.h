@@ -0,0 +1,154 @@
+#pragma once
+#include "WorkerPool.h"
+
+#include <rocky/Image.h>
+#include <rocky/vsg/VSGContext.h>
+#include <rocky/Log.h>
+
+#include <vsg/io/read.h>
+#include <vsg/text/Font.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace
+{
+    // Creates an image to use when the image we want is missing.
+    std::shared_ptr<rocky::Image> createMissingImage()
+    {
+        auto image = rocky::Image::create(rocky::Image::R8G8B8A8_UNORM, 15, 15);
+        image->fill({ 1,1,1,1 });
+        for (unsigned i = 1; i < image->width() - 1; ++i) {
+            image->write({ 1,0,0,1 }, i, i);
+            image->write({ 1,0,0,1 }, i, image->height() - 1 - i);
+        }
+        return image;
+    }
+}
+
+
+//! An asset that loads in the background. Check ready() before reading value;
+//! once ready, value never changes.
+template<class T>
+struct Asset
+{
+    T value;
+
+    bool ready() const
+    {
+        return loaded.load(std::memory_order_acquire);
+    }
+
+    std::atomic<bool> loaded = { false };
+};
+
+using ImageAsset = Asset<std::shared_ptr<rocky::Image>>;
+using FontAsset = Asset<vsg::ref_ptr<vsg::Font>>;
+
+
+//! Loads images and fonts on a worker pool and shares them by URI, so any
+//! number of entities requesting the same icon cost a single read and decode.
+//! Requests never block; the caller shows a placeholder until the asset is ready.
+class AssetCache
+{
+public:
+    AssetCache(unsigned concurrency = 2u) :
+        pool(concurrency)
+    {
+        //nop
+    }
+
+    //! Gets or starts loading the image at a URI. A failed load resolves to the
+    //! "missing" image.
+    std::shared_ptr<ImageAsset> image(const std::string& uri, rocky::VSGContext runtime, std::shared_ptr<spdlog::logger> log)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& asset = images[uri];
+        if (!asset)
+        {
+            asset = std::make_shared<ImageAsset>();
+            if (runtime)
+            {
+                pool.dispatch([this, asset, uri, runtime, log]()
+                    {
+                        auto io = runtime->io;
+                        auto image = io.services.readImageFromURI(uri, io);
+                        if (image.status.ok())
+                        {
+                            asset->value = image.value;
+                        }
+                        else
+                        {
+                            log->warn("Icon \"" + uri + "\" cannot load: " + image.status.toString());
+                            asset->value = placeholder();
+                        }
+                        finish(*asset);
+                    });
+            }
+            else
+            {
+                // headless; no I/O services available
+                asset->value = placeholder_image;
+                finish(*asset);
+            }
+        }
+        return asset;
+    }
+
+    //! Gets or starts loading a font by name. A failed load resolves to a null font.
+    std::shared_ptr<FontAsset> font(const std::string& name, rocky::VSGContext runtime)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& asset = fonts[name];
+        if (!asset)
+        {
+            asset = std::make_shared<FontAsset>();
+            if (runtime)
+            {
+                pool.dispatch([this, asset, name, runtime]()
+                    {
+                        asset->value = vsg::read_cast<vsg::Font>(name, runtime->readerWriterOptions);
+                        finish(*asset);
+                    });
+            }
+            else
+            {
+                finish(*asset);
+            }
+        }
+        return asset;
+    }
+
+    //! Image to display while the real one loads, or in place of one that failed.
+    std::shared_ptr<rocky::Image> placeholder() const
+    {
+        return placeholder_image;
+    }
+
+    //! Total number of loads finished so far. Compare against a previous value
+    //! to find out cheaply whether anything new is ready.
+    std::uint64_t completions() const
+    {
+        return completed.load(std::memory_order_acquire);
+    }
+
+private:
+    std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<ImageAsset>> images;
+    std::unordered_map<std::string, std::shared_ptr<FontAsset>> fonts;
+    const std::shared_ptr<rocky::Image> placeholder_image = createMissingImage();
+    std::atomic<std::uint64_t> completed = { 0u };
+
+    // last member, so workers are joined before the rest is destroyed
+    WorkerPool pool;
+
+    template<class T>
+    void finish(Asset<T>& asset)
+    {
+        asset.loaded.store(true, std::memory_order_release);
+        completed.fetch_add(1u, std::memory_order_acq_rel);
+    }
+};
@@ -1,13 +1,125 @@
 #pragma once
 #include "SimulationContext.h"
 #include <rocky/vsg/ecs.h>
+#include <algorithm>
 
 
+//! The beam prefs fields the visualization uses.
+struct BeamPrefsState
+{
+    enum : ChangeMask
+    {
+        HORIZONTAL_WIDTH = 1u << 0,
+        VERTICAL_WIDTH = 1u << 1,
+        DRAW_MODE = 1u << 2,
+        OFFSET = 1u << 3,
+        SHAPE = HORIZONTAL_WIDTH | VERTICAL_WIDTH | DRAW_MODE
+    };
+
+    ChangeMask known = 0u;
+    FIELD_TYPE(simData::BeamPrefs, horizontalwidth) horizontalwidth = {};
+    FIELD_TYPE(simData::BeamPrefs, verticalwidth) verticalwidth = {};
+    FIELD_TYPE(simData::BeamPrefs, beamdrawmode) beamdrawmode = {};
+    vsg::dvec3 offset;
+    CommonPrefsState commonprefs;
+
+    //! Fields of 'prefs' that differ from this state (not including common prefs)
+    ChangeMask diff(const simData::BeamPrefs& prefs) const
+    {
+        ChangeMask changes = 0u;
+        DIFF_FIELD(horizontalwidth, prefs, *this, HORIZONTAL_WIDTH, changes);
+        DIFF_FIELD(verticalwidth, prefs, *this, VERTICAL_WIDTH, changes);
+        DIFF_FIELD(beamdrawmode, prefs, *this, DRAW_MODE, changes);
+        if (prefs.has_beampositionoffset())
+        {
+            auto& o = prefs.beampositionoffset();
+            if (!(known & OFFSET) || o.x() != offset.x || o.y() != offset.y || o.z() != offset.z)
+                changes |= OFFSET;
+        }
+        return changes;
+    }
+
+    void store(const simData::BeamPrefs& prefs, ChangeMask changes)
+    {
+        STORE_FIELD(horizontalwidth, prefs, *this, HORIZONTAL_WIDTH, changes);
+        STORE_FIELD(verticalwidth, prefs, *this, VERTICAL_WIDTH, changes);
+        STORE_FIELD(beamdrawmode, prefs, *this, DRAW_MODE, changes);
+        if (changes & OFFSET)
+        {
+            auto& o = prefs.beampositionoffset();
+            offset = vsg::dvec3(o.x(), o.y(), o.z());
+        }
+        known |= changes;
+    }
+};
+
+//! Hot beam state, updated every frame: plain data only, so views and update
+//! loops over beams don't drag the prefs through the cache.
 struct Beam
 {
-    simData::BeamProperties props;
-    simData::BeamPrefs prefs;
-    simData::BeamUpdate update;
+    enum : ChangeMask
+    {
+        AZIMUTH = 1u << 0,
+        ELEVATION = 1u << 1,
+        RANGE = 1u << 2
+    };
+
+    ChangeMask known = 0u;
+    double azimuth = 0.0;
+    double elevation = 0.0;
+    double range = 0.0;
+
+    //! position offset from the host, copied from prefs so transform
+    //! updates only read this component
+    vsg::dvec3 offset;
+
+    //! entity hosting this beam (normally a platform)
+    entt::entity host = entt::null;
+
+    ChangeMask diff(const simData::BeamUpdate& update) const
+    {
+        ChangeMask changes = 0u;
+        DIFF_FIELD(azimuth, update, *this, AZIMUTH, changes);
+        DIFF_FIELD(elevation, update, *this, ELEVATION, changes);
+        DIFF_FIELD(range, update, *this, RANGE, changes);
+        return changes;
+    }
+
+    void store(const simData::BeamUpdate& update, ChangeMask changes)
+    {
+        STORE_FIELD(azimuth, update, *this, AZIMUTH, changes);
+        STORE_FIELD(elevation, update, *this, ELEVATION, changes);
+        STORE_FIELD(range, update, *this, RANGE, changes);
+        known |= changes;
+    }
+
+    ChangeMask diff(const Beam& latest) const
+    {
+        ChangeMask changes = 0u;
+        DIFF_STATE(azimuth, latest, *this, AZIMUTH, changes);
+        DIFF_STATE(elevation, latest, *this, ELEVATION, changes);
+        DIFF_STATE(range, latest, *this, RANGE, changes);
+        return changes;
+    }
+
+    void store(const Beam& latest, ChangeMask changes)
+    {
+        STORE_STATE(azimuth, latest, *this, AZIMUTH, changes);
+        STORE_STATE(elevation, latest, *this, ELEVATION, changes);
+        STORE_STATE(range, latest, *this, RANGE, changes);
+        known |= changes;
+    }
+};
+
+//! Cold beam state, touched only when properties or prefs change.
+struct BeamInfo
+{
+    simData::ObjectId id = 0;
+    simData::ObjectId hostid = 0;
+    BeamPrefsState prefs;
+
+    //! unit frustum currently copied into the Line and Mesh
+    std::shared_ptr<const BeamShape> shape;
 };
 
 
@@ -15,23 +127,25 @@ struct Beam
 class BeamAdapter : public SimEntityAdapter
 {
 public:
-    const Beam* create(const simData::BeamProperties* props, SimulationContext& sim, entt::registry& registry)
+    entt::entity create(const simData::BeamProperties* props, SimulationContext& sim, entt::registry& registry)
     {
-        ROCKY_SOFT_ASSERT_AND_RETURN(props, nullptr);
-        ROCKY_SOFT_ASSERT_AND_RETURN(props->has_id(), nullptr);
+        ROCKY_SOFT_ASSERT_AND_RETURN(props, entt::null);
+        ROCKY_SOFT_ASSERT_AND_RETURN(props->has_id(), entt::null);
 
-        auto entt_id = sim.entities[props->id()] = registry.create();
-        auto& beam = registry.emplace<Beam>(entt_id);
+        auto entt_id = registry.create();
+        sim.entities.insert(props->id(), entt_id);
+        registry.emplace<Beam>(entt_id);
+        registry.emplace<BeamInfo>(entt_id);
 
         // give it an empty transform so hosted objects can find it:
         registry.emplace<rocky::Transform>(entt_id);
 
-        // emplace a Line primitive for drawing the beam's frustum.
-        // we will fill in the geometry later.
-        auto& line = registry.emplace<rocky::Line>(entt_id);
+        // the frustum's Line and/or Mesh are added once the beam has prefs
+        // and is in view.
+        sim.visuals.add(entt_id, registry);
 
         applyProps(props, sim, registry);
-        return &beam;
+        return entt_id;
     }
 
     void applyProps(const simData::BeamProperties* new_props, SimulationContext& sim, entt::registry& registry)
@@ -39,17 +153,20 @@ public:
         ROCKY_SOFT_ASSERT_AND_RETURN(new_props, void());
 
         auto entt_id = sim.entities[new_props->id()];
-        auto& beam = registry.get<Beam>(entt_id);
+        ROCKY_SOFT_ASSERT_AND_RETURN(entt_id != entt::null, void());
+        auto& info = registry.get<BeamInfo>(entt_id);
+
+        info.id = new_props->id();
 
-        if (VALUE_CHANGED(hostid, *new_props, beam.props))
+        if (new_props->has_hostid() && new_props->hostid() != info.hostid)
         {
-            ROCKY_SOFT_ASSERT_AND_RETURN(sim.entities.count(new_props->hostid()) > 0, void());
+            ROCKY_SOFT_ASSERT_AND_RETURN(sim.entities.contains(new_props->hostid()), void());
 
-            auto host_entt_id = sim.entities[new_props->hostid()];
-            auto& transform = registry.get<rocky::Transform>(entt_id);
+            info.hostid = new_props->hostid();
+            auto host = sim.entities[new_props->hostid()];
+            registry.get<Beam>(entt_id).host = host;
+            sim.hosts.attach(entt_id, host);
         }
-
-        beam.props = *new_props;
     }
 
     void applyPrefs(const simData::BeamPrefs* new_prefs, const simData::ObjectId beam_id, SimulationContext& sim, entt::registry& registry)
@@ -57,82 +174,166 @@ public:
         ROCKY_SOFT_ASSERT_AND_RETURN(new_prefs, void());
 
         auto entt_id = sim.entities[beam_id];
-        auto& beam = registry.get<Beam>(entt_id);
+        ROCKY_SOFT_ASSERT_AND_RETURN(entt_id != entt::null, void());
+        auto& info = registry.get<BeamInfo>(entt_id);
 
         // detect changes and apply new prefs.
-        auto& line = registry.emplace_or_replace<rocky::Line>(entt_id);
-        makeBeamGeometry(line, *new_prefs, beam.update);
+        auto changes = info.prefs.diff(*new_prefs);
+        info.prefs.store(*new_prefs, changes);
 
+        ChangeMask common = 0u;
         if (new_prefs->has_commonprefs())
         {
-            applyCommonPrefs(&new_prefs->commonprefs(), beam.prefs.commonprefs(), entt_id, sim, registry);
+            common = applyCommonPrefs(&new_prefs->commonprefs(), info.prefs.commonprefs, entt_id, sim, registry);
+        }
+
+        if (Materializer::materialized(entt_id, registry))
+        {
+            if (changes & BeamPrefsState::SHAPE)
+                applyShape(sim.beam_shapes.get(info.prefs.horizontalwidth, info.prefs.verticalwidth, info.prefs.beamdrawmode), entt_id, sim.components, registry);
+            else if (common & CommonPrefsState::COLOR)
+                applyColor(entt_id, registry);
         }
 
-        beam.prefs = *new_prefs;
+        if (changes & BeamPrefsState::OFFSET)
+        {
+            registry.get<Beam>(entt_id).offset = info.prefs.offset;
+            sim.hosts.markDirty(entt_id);
+        }
     }
 
-    void applyUpdate(const simData::BeamUpdate* new_update, const simData::ObjectId beam_id, SimulationContext& sim, entt::registry& registry)
+    //! Gives the beam its frustum and label, from the stored prefs. Not
+    //! thread safe.
+    void materialize(entt::entity entt_id, SimulationContext& sim, entt::registry& registry)
+    {
+        auto& info = registry.get<BeamInfo>(entt_id);
+        if (info.prefs.known & BeamPrefsState::SHAPE)
+            applyShape(sim.beam_shapes.get(info.prefs.horizontalwidth, info.prefs.verticalwidth, info.prefs.beamdrawmode), entt_id, sim.components, registry);
+        materializeLabel(info.prefs.commonprefs, entt_id, sim, registry);
+    }
+
+    //! Takes the beam's frustum and label away, keeping its data. Not thread
+    //! safe.
+    void dematerialize(entt::entity entt_id, SimulationContext& sim, entt::registry& registry)
+    {
+        releaseVisuals(entt_id, sim, registry);
+        registry.get<BeamInfo>(entt_id).shape = nullptr;
+    }
+
+    //! Removes the beam, after whatever it hosts. Not thread safe.
+    void destroy(entt::entity entt_id, SimulationContext& sim, entt::registry& registry)
+    {
+        destroyEntity(registry.get<BeamInfo>(entt_id).id, entt_id, sim, registry);
+    }
+
+    //! Applies a time update to the beam's own components. Touches nothing
+    //! shared, so different beams can be updated concurrently.
+    //! @return the fields that changed; pass them to commitUpdate()
+    ChangeMask applyUpdate(const simData::BeamUpdate* new_update, entt::entity entt_id, entt::registry& registry)
+    {
+        ROCKY_SOFT_ASSERT_AND_RETURN(new_update, 0u);
+        return applyLatest(*new_update, entt_id, registry);
+    }
+
+    //! Same as above, from the state read out of an update on another thread.
+    ChangeMask applyUpdate(const Beam& latest, entt::entity entt_id, entt::registry& registry)
+    {
+        return applyLatest(latest, entt_id, registry);
+    }
+
+    //! Records the effects of an applyUpdate() in shared state. Not thread safe.
+    void commitUpdate(entt::entity entt_id, ChangeMask changes, SimulationContext& sim)
+    {
+        // range scales the unit frustum, so every change here is a matrix
+        // update. the transform is rebuilt during propagation, after the host's.
+        if (changes != 0u)
+            sim.hosts.markDirty(entt_id);
+    }
+
+    //! Rebuilds the beam's transform from its host's, its offset, its pointing
+    //! angles and its range. Called host-first by HostGraph::propagate.
+    void updateTransform(entt::entity entt_id, entt::registry& registry) const
     {
-        auto entt_id = sim.entities[beam_id];
         auto& beam = registry.get<Beam>(entt_id);
+        if (beam.host == entt::null)
+            return;
+
+        auto& transform = registry.get<rocky::Transform>(entt_id);
+        transform = registry.get<rocky::Transform>(beam.host);
+        auto rot = rocky::quaternion_from_euler_radians(beam.elevation, 0.0, beam.azimuth);
+        transform.localMatrix = glm::translate(transform.localMatrix, glm::dvec3(beam.offset.x, beam.offset.y, beam.offset.z));
+        transform.localMatrix *= glm::mat4_cast(rot);
+        // a zero range (the default before the first update) would make the
+        // matrix singular and the normals NaN; keep a millimeter of frustum
+        transform.localMatrix = glm::scale(transform.localMatrix, glm::dvec3(std::max(beam.range, 1e-3)));
+        transform.dirty();
+    }
 
-        auto& host = registry.get<Platform>(sim.entities[beam.props.hostid()]);
-        auto& host_transform = registry.get<rocky::Transform>(sim.entities[host.props.id()]);
+    //! Copies a cached unit frustum into the beam's Line and Mesh, adding or
+    //! removing them to match the draw mode. Only happens when the widths or
+    //! draw mode change.
+    void applyShape(std::shared_ptr<const BeamShape> shape, entt::entity entt_id, ComponentPool& components, entt::registry& registry) const
+    {
+        auto& info = registry.get<BeamInfo>(entt_id);
+        if (shape == info.shape)
+            return;
 
-        if (VALUE_CHANGED(azimuth, *new_update, beam.update))
+        if (shape->wire())
         {
-            auto& transform = registry.get<rocky::Transform>(entt_id);
-            transform = host_transform;
-            auto rot = rocky::quaternion_from_euler_radians(beam.update.elevation(), 0.0, new_update->azimuth());
-            transform.localMatrix *= glm::mat4_cast(rot);
+            auto& line = components.get_or_emplace<rocky::Line>(entt_id, registry);
+            line.topology = rocky::Line::Topology::Segments;
+            line.points = shape->outline;
+            line.style.width = 2.0f;
+            line.dirty();
         }
-
-        if (VALUE_CHANGED(elevation , *new_update, beam.update))
+        else
         {
-            auto& transform = registry.get<rocky::Transform>(entt_id);
-            transform = host_transform;
-            auto rot = rocky::quaternion_from_euler_radians(beam.update.elevation(), 0.0, new_update->azimuth());
-            transform.localMatrix *= glm::mat4_cast(rot);
+            components.remove<rocky::Line>(entt_id, registry);
         }
 
-        if (VALUE_CHANGED(range, *new_update, beam.update))
+        if (shape->solid())
         {
-            auto& line = registry.get<rocky::Line>(entt_id);
-            makeBeamGeometry(line, beam.prefs, *new_update);
+            auto& mesh = components.get_or_emplace<rocky::Mesh>(entt_id, registry);
+            mesh.triangles = shape->triangles;
+            mesh.dirty();
+        }
+        else
+        {
+            components.remove<rocky::Mesh>(entt_id, registry);
         }
 
-        beam.update = *new_update;
+        info.shape = std::move(shape);
+        applyColor(entt_id, registry);
     }
 
-
-    void makeBeamGeometry(rocky::Line& line, const simData::BeamPrefs& prefs, const simData::BeamUpdate& update) const
+    //! Colors the beam's Line and Mesh from its common prefs: the outline
+    //! opaque, the solid as given. Yellow until a color is set.
+    void applyColor(entt::entity entt_id, entt::registry& registry) const
     {
-        auto range = update.range();
-        auto width_rad = prefs.horizontalwidth();
-        auto height_rad = prefs.verticalwidth();
-        auto beam_offset = prefs.beampositionoffset();
-
-        // x-forward
-        double x = range * acos(width_rad * 0.5);
-        double y = range * asin(width_rad * 0.5);
-        double z = range * asin(height_rad * 0.5);
-
-        vsg::dvec3 origin(beam_offset.x(), beam_offset.y(), beam_offset.z());
-        auto UL = vsg::dvec3(x, y, z) + origin;
-        auto UR = vsg::dvec3(x, -y, z) + origin;
-        auto LL = vsg::dvec3(x, y, -z) + origin;
-        auto LR = vsg::dvec3(x, -y, -z) + origin;
+        auto& prefs = registry.get<BeamInfo>(entt_id).prefs.commonprefs;
+        auto color = (prefs.known & CommonPrefsState::COLOR) ? colorFromRGBA(prefs.color) : vsg::vec4{ 1, 1, 0, 0.4f };
 
-        line.topology = rocky::Line::Topology::Segments;
-
-        line.points = {
-            UR, UL, UL, LL, LL, LR, LR, UR,
-            UR, origin, UL, origin, LR, origin, LL, origin
-        };
-
-        line.style.color = vsg::vec4{ 1, 1, 0, 1 };
-        line.style.width = 2.0f;
+        if (auto* line = registry.try_get<rocky::Line>(entt_id))
+        {
+            line->style.color = vsg::vec4{ color.x, color.y, color.z, 1.0f };
+            line->dirty();
+        }
+        if (auto* mesh = registry.try_get<rocky::Mesh>(entt_id))
+        {
+            mesh->style.color = color;
+            mesh->dirty();
+        }
+    }
 
-        line.dirty();
+private:
+    template<class SOURCE>
+    ChangeMask applyLatest(const SOURCE& latest, entt::entity entt_id, entt::registry& registry)
+    {
+        // a beam without a host keeps its state current too; its transform
+        // is built once a host is attached (see updateTransform())
+        auto& beam = registry.get<Beam>(entt_id);
+        auto changes = beam.diff(latest);
+        beam.store(latest, changes);
+        return changes;
     }
 };
@@ -0,0 +1,136 @@
+#pragma once
+#include <simData/DataStore.h>
+#include <rocky/vsg/ecs.h>
+
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+
+//! Beam frustum of unit range, apex at the origin and pointing down +X.
+//! The beam's transform scales it by range and moves it by the beam offset,
+//! so one shape is built for every beam with the same widths and draw mode.
+//! It carries no color; beams color their Line and Mesh styles themselves.
+struct BeamShape
+{
+    double horizontalwidth = 0.0;
+    double verticalwidth = 0.0;
+    simData::BeamPrefs::DrawMode drawmode = simData::BeamPrefs::WIRE;
+
+    //! wireframe outline, as line segments (empty when not drawn)
+    std::vector<vsg::dvec3> outline;
+
+    //! solid sides and far face (empty when not drawn)
+    std::vector<rocky::Triangle> triangles;
+
+    bool wire() const { return drawmode != simData::BeamPrefs::SOLID; }
+    bool solid() const { return drawmode != simData::BeamPrefs::WIRE; }
+};
+
+
+//! Builds each distinct beam shape once.
+//!
+//! This saves generating the frustum per beam, not memory: rocky's Line and
+//! Mesh own their vertices and can't share GPU buffers, so every beam copies
+//! the shape into its own components (see BeamAdapter::applyShape), N beams
+//! hold N copies on the CPU and the GPU, and a width change uploads the
+//! vertices again.
+class BeamShapeCache
+{
+public:
+    //! Gets or builds the unit shape for a pair of widths (radians) and a draw mode.
+    std::shared_ptr<const BeamShape> get(double horizontalwidth, double verticalwidth, simData::BeamPrefs::DrawMode drawmode)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& shape = shapes[Key(horizontalwidth, verticalwidth, drawmode)];
+        if (!shape)
+        {
+            if (shapes.size() > purge_threshold)
+            {
+                purge();
+            }
+            shape = build(horizontalwidth, verticalwidth, drawmode);
+        }
+        return shape;
+    }
+
+    //! Number of distinct shapes held
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return shapes.size();
+    }
+
+private:
+    using Key = std::tuple<double, double, int>;
+
+    // scanning beams can cycle through many widths; shapes no beam
+    // holds any more are dropped once the cache grows past this.
+    static constexpr std::size_t purge_threshold = 256u;
+
+    mutable std::mutex mutex;
+    std::map<Key, std::shared_ptr<const BeamShape>> shapes;
+
+    void purge()
+    {
+        for (auto i = shapes.begin(); i != shapes.end(); )
+        {
+            if (i->second && i->second.use_count() == 1)
+                i = shapes.erase(i);
+            else
+                ++i;
+        }
+    }
+
+    static std::shared_ptr<const BeamShape> build(double horizontalwidth, double verticalwidth, simData::BeamPrefs::DrawMode drawmode)
+    {
+        auto shape = std::make_shared<BeamShape>();
+        shape->horizontalwidth = horizontalwidth;
+        shape->verticalwidth = verticalwidth;
+        shape->drawmode = drawmode;
+
+        // x-forward, unit range
+        double x = cos(horizontalwidth * 0.5);
+        double y = sin(horizontalwidth * 0.5);
+        double z = sin(verticalwidth * 0.5);
+
+        vsg::dvec3 origin(0.0, 0.0, 0.0);
+        auto UL = vsg::dvec3(x, y, z);
+        auto UR = vsg::dvec3(x, -y, z);
+        auto LL = vsg::dvec3(x, y, -z);
+        auto LR = vsg::dvec3(x, -y, -z);
+
+        if (shape->wire())
+        {
+            shape->outline = {
+                UR, UL, UL, LL, LL, LR, LR, UR,
+                UR, origin, UL, origin, LR, origin, LL, origin
+            };
+        }
+
+        if (shape->solid())
+        {
+            auto add = [&](const vsg::dvec3& a, const vsg::dvec3& b, const vsg::dvec3& c)
+                {
+                    rocky::Triangle t;
+                    t.verts[0] = a, t.verts[1] = b, t.verts[2] = c;
+                    shape->triangles.emplace_back(t);
+                };
+
+            // sides
+            add(origin, UL, UR);
+            add(origin, LR, LL);
+            add(origin, LL, UL);
+            add(origin, UR, LR);
+
+            // far face
+            add(UL, LL, LR);
+            add(UL, LR, UR);
+        }
+
+        return shape;
+    }
+};
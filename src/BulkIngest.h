@@ -0,0 +1,346 @@
+#pragma once
+#include "GeoBatch.h"
+#include <simData/DataStore.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <numeric>
+#include <vector>
+
+
+//! Platform time updates in columns: ECEF position per (id, time)
+struct PlatformSamples
+{
+    std::vector<simData::ObjectId> ids;
+    std::vector<double> times, x, y, z;
+
+    void add(simData::ObjectId id, double time, double x_, double y_, double z_)
+    {
+        ids.emplace_back(id), times.emplace_back(time);
+        x.emplace_back(x_), y.emplace_back(y_), z.emplace_back(z_);
+    }
+
+    void reserve(std::size_t n)
+    {
+        ids.reserve(n), times.reserve(n);
+        x.reserve(n), y.reserve(n), z.reserve(n);
+    }
+
+    void clear()
+    {
+        ids.clear(), times.clear();
+        x.clear(), y.clear(), z.clear();
+    }
+
+    std::size_t size() const { return ids.size(); }
+    bool empty() const { return ids.empty(); }
+
+    template<class FUNC> void forEachColumn(FUNC func) { func(x), func(y), func(z); }
+    template<class FUNC> void forEachColumn(FUNC func) const { func(x), func(y), func(z); }
+};
+
+//! Beam time updates in columns: pointing angles (radians) and range per (id, time)
+struct BeamSamples
+{
+    std::vector<simData::ObjectId> ids;
+    std::vector<double> times, azimuth, elevation, range;
+
+    void add(simData::ObjectId id, double time, double azimuth_, double elevation_, double range_)
+    {
+        ids.emplace_back(id), times.emplace_back(time);
+        azimuth.emplace_back(azimuth_), elevation.emplace_back(elevation_), range.emplace_back(range_);
+    }
+
+    void reserve(std::size_t n)
+    {
+        ids.reserve(n), times.reserve(n);
+        azimuth.reserve(n), elevation.reserve(n), range.reserve(n);
+    }
+
+    void clear()
+    {
+        ids.clear(), times.clear();
+        azimuth.clear(), elevation.clear(), range.clear();
+    }
+
+    std::size_t size() const { return ids.size(); }
+    bool empty() const { return ids.empty(); }
+
+    template<class FUNC> void forEachColumn(FUNC func) { func(azimuth), func(elevation), func(range); }
+    template<class FUNC> void forEachColumn(FUNC func) const { func(azimuth), func(elevation), func(range); }
+};
+
+//! Gate time updates in columns
+struct GateSamples
+{
+    std::vector<simData::ObjectId> ids;
+    std::vector<double> times, azimuth, elevation, width, height, minrange, maxrange, centroid;
+
+    void add(simData::ObjectId id, double time, double azimuth_, double elevation_, double width_, double height_,
+        double minrange_, double maxrange_, double centroid_)
+    {
+        ids.emplace_back(id), times.emplace_back(time);
+        azimuth.emplace_back(azimuth_), elevation.emplace_back(elevation_);
+        width.emplace_back(width_), height.emplace_back(height_);
+        minrange.emplace_back(minrange_), maxrange.emplace_back(maxrange_), centroid.emplace_back(centroid_);
+    }
+
+    void reserve(std::size_t n)
+    {
+        ids.reserve(n), times.reserve(n);
+        forEachColumn([n](std::vector<double>& column) { column.reserve(n); });
+    }
+
+    void clear()
+    {
+        ids.clear(), times.clear();
+        forEachColumn([](std::vector<double>& column) { column.clear(); });
+    }
+
+    std::size_t size() const { return ids.size(); }
+    bool empty() const { return ids.empty(); }
+
+    template<class FUNC> void forEachColumn(FUNC func)
+    {
+        func(azimuth), func(elevation), func(width), func(height), func(minrange), func(maxrange), func(centroid);
+    }
+
+    template<class FUNC> void forEachColumn(FUNC func) const
+    {
+        func(azimuth), func(elevation), func(width), func(height), func(minrange), func(maxrange), func(centroid);
+    }
+};
+
+
+//! Inserts many time updates into a DataStore in one operation.
+//!
+//! Adding samples one by one costs a data limiting pass per sample. A
+//! BulkIngest takes whole columns of samples and orders them by (id, time),
+//! so every entity's samples go in as one run appended in time order. Each
+//! sample is still added with its own addXUpdate() and complete(); only the
+//! Transaction object is reused. Data limiting is suspended while the
+//! BulkIngest exists and restored when it is destroyed, so each entity is
+//! trimmed once per batch rather than once per sample. A BulkIngest kept across batches (which keeps its Transaction
+//! and scratch columns) can leave limiting alone at construction and call
+//! suspendLimiting() and resumeLimiting() around only the batches that insert.
+//!
+//! Inserting updates does not notify DataStore listeners; they see the new
+//! samples together at the next DataStore update().
+class BulkIngest
+{
+public:
+    BulkIngest(simData::DataStore& ds_, bool suspend_limiting = true) :
+        ds(ds_)
+    {
+        if (suspend_limiting)
+            suspendLimiting();
+    }
+
+    BulkIngest(const BulkIngest&) = delete;
+    BulkIngest& operator=(const BulkIngest&) = delete;
+
+    ~BulkIngest()
+    {
+        resumeLimiting();
+    }
+
+    //! Turns data limiting off until resumeLimiting(), if it is on.
+    void suspendLimiting()
+    {
+        if (!suspended && ds.dataLimiting())
+        {
+            ds.setDataLimiting(false);
+            suspended = true;
+        }
+    }
+
+    //! Turns data limiting back on if suspendLimiting() turned it off, which
+    //! trims every entity once.
+    void resumeLimiting()
+    {
+        if (suspended)
+        {
+            ds.setDataLimiting(true);
+            suspended = false;
+        }
+    }
+
+    //! Inserts columns of samples, in any order.
+    //! @return number of samples inserted
+    std::size_t insert(const PlatformSamples& samples)
+    {
+        return insertRuns(samples, platform_scratch, [this](simData::ObjectId id, std::size_t count, const double* times, const PlatformSamples& s, std::size_t i)
+            {
+                return insertPlatform(id, count, times, &s.x[i], &s.y[i], &s.z[i]);
+            });
+    }
+
+    //! Inserts platform samples whose x, y, z columns hold geodetic
+    //! longitude, latitude (degrees) and height (meters), converting them to
+    //! ECEF in one batch, in place. Pass the samples with std::move() when
+    //! they are not needed afterwards, so they are not copied.
+    std::size_t insertGeodetic(PlatformSamples samples)
+    {
+        GeoBatch::geodeticToECEF(samples.size(), samples.x.data(), samples.y.data(), samples.z.data(),
+            samples.x.data(), samples.y.data(), samples.z.data());
+        return insert(samples);
+    }
+
+    std::size_t insert(const BeamSamples& samples)
+    {
+        return insertRuns(samples, beam_scratch, [this](simData::ObjectId id, std::size_t count, const double* times, const BeamSamples& s, std::size_t i)
+            {
+                return insertBeam(id, count, times, &s.azimuth[i], &s.elevation[i], &s.range[i]);
+            });
+    }
+
+    std::size_t insert(const GateSamples& samples)
+    {
+        return insertRuns(samples, gate_scratch, [this](simData::ObjectId id, std::size_t count, const double* times, const GateSamples& s, std::size_t i)
+            {
+                return insertGate(id, count, times, &s.azimuth[i], &s.elevation[i], &s.width[i], &s.height[i],
+                    &s.minrange[i], &s.maxrange[i], &s.centroid[i]);
+            });
+    }
+
+    //! Inserts one platform's samples, given as columns in time order
+    //! (for example straight out of a mapped recording).
+    //! @return number of samples inserted (0 if the platform does not exist)
+    std::size_t insertPlatform(simData::ObjectId id, std::size_t count, const double* times,
+        const double* x, const double* y, const double* z)
+    {
+        std::size_t i = 0;
+        for (; i < count; ++i)
+        {
+            auto update = ds.addPlatformUpdate(id, &transaction);
+            if (!update)
+                break;
+            update->set_time(times[i]);
+            update->set_x(x[i]);
+            update->set_y(y[i]);
+            update->set_z(z[i]);
+            transaction.complete(&update);
+        }
+        inserted += i;
+        return i;
+    }
+
+    //! Inserts one beam's samples, given as columns in time order.
+    std::size_t insertBeam(simData::ObjectId id, std::size_t count, const double* times,
+        const double* azimuth, const double* elevation, const double* range)
+    {
+        std::size_t i = 0;
+        for (; i < count; ++i)
+        {
+            auto update = ds.addBeamUpdate(id, &transaction);
+            if (!update)
+                break;
+            update->set_time(times[i]);
+            update->set_azimuth(azimuth[i]);
+            update->set_elevation(elevation[i]);
+            update->set_range(range[i]);
+            transaction.complete(&update);
+        }
+        inserted += i;
+        return i;
+    }
+
+    //! Inserts one gate's samples, given as columns in time order.
+    std::size_t insertGate(simData::ObjectId id, std::size_t count, const double* times,
+        const double* azimuth, const double* elevation, const double* width, const double* height,
+        const double* minrange, const double* maxrange, const double* centroid)
+    {
+        std::size_t i = 0;
+        for (; i < count; ++i)
+        {
+            auto update = ds.addGateUpdate(id, &transaction);
+            if (!update)
+                break;
+            update->set_time(times[i]);
+            update->set_azimuth(azimuth[i]);
+            update->set_elevation(elevation[i]);
+            update->set_width(width[i]);
+            update->set_height(height[i]);
+            update->set_minrange(minrange[i]);
+            update->set_maxrange(maxrange[i]);
+            update->set_centroid(centroid[i]);
+            transaction.complete(&update);
+        }
+        inserted += i;
+        return i;
+    }
+
+    //! Total samples inserted so far
+    std::size_t count() const
+    {
+        return inserted;
+    }
+
+private:
+    simData::DataStore& ds;
+    bool suspended = false;
+    simData::DataStore::Transaction transaction;
+    std::size_t inserted = 0u;
+
+    // reordered copies of unsorted input, kept for reuse
+    std::vector<std::size_t> order;
+    PlatformSamples platform_scratch;
+    BeamSamples beam_scratch;
+    GateSamples gate_scratch;
+
+    //! Calls func(id, count, times, samples, first) for each run of one
+    //! entity's samples, after sorting the samples by (id, time) if needed.
+    template<class SAMPLES, class FUNC>
+    std::size_t insertRuns(const SAMPLES& input, SAMPLES& scratch, FUNC func)
+    {
+        auto& samples = sorted(input, scratch);
+        std::size_t result = 0;
+        for (std::size_t begin = 0, n = samples.size(); begin < n; )
+        {
+            auto id = samples.ids[begin];
+            auto end = begin + 1u;
+            while (end < n && samples.ids[end] == id)
+                ++end;
+            result += func(id, end - begin, &samples.times[begin], samples, begin);
+            begin = end;
+        }
+        return result;
+    }
+
+    template<class SAMPLES>
+    const SAMPLES& sorted(const SAMPLES& samples, SAMPLES& scratch)
+    {
+        auto n = samples.size();
+        auto less = [&](std::size_t a, std::size_t b)
+            {
+                return samples.ids[a] < samples.ids[b] || (samples.ids[a] == samples.ids[b] && samples.times[a] < samples.times[b]);
+            };
+
+        bool in_order = true;
+        for (std::size_t i = 1; i < n && in_order; ++i)
+            in_order = !less(i, i - 1u);
+        if (in_order)
+            return samples;
+
+        order.resize(n);
+        std::iota(order.begin(), order.end(), std::size_t(0));
+        std::stable_sort(order.begin(), order.end(), less);
+
+        scratch.clear();
+        scratch.reserve(n);
+        for (auto i : order)
+            scratch.ids.emplace_back(samples.ids[i]), scratch.times.emplace_back(samples.times[i]);
+
+        // gather each value column in the same order
+        std::vector<const std::vector<double>*> in;
+        std::vector<std::vector<double>*> out;
+        samples.forEachColumn([&](const std::vector<double>& column) { in.push_back(&column); });
+        scratch.forEachColumn([&](std::vector<double>& column) { out.push_back(&column); });
+        for (std::size_t c = 0; c < in.size(); ++c)
+        {
+            for (auto i : order)
+                out[c]->emplace_back((*in[c])[i]);
+        }
+        return scratch;
+    }
+};
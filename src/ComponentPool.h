@@ -0,0 +1,123 @@
+#pragma once
+#include <rocky/vsg/ecs.h>
+#include <entt/entt.hpp>
+
+#include <cstddef>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+
+//! Visual components of removed entities, kept for reuse by new ones.
+//!
+//! When an entity is removed, or leaves the view (see Materializer),
+//! release() moves its Line, Mesh, Label and Icon out of the registry.
+//! emplace() gives an entity one of these instead of a fresh component, so the
+//! line points, mesh triangles and label text keep the heap capacity they grew
+//! into and a scenario that constantly removes and adds entities doesn't churn
+//! the heap. Released components are emptied, their styles reset and their
+//! image references dropped; at most 'max_pooled' of each type are kept. The
+//! entities themselves are recycled by the registry, which reuses destroyed
+//! entity slots under a new version.
+class ComponentPool
+{
+public:
+    //! most released components kept per type
+    std::size_t max_pooled = 1024u;
+
+    //! Adds a T to an entity, reusing a released one if there is one.
+    template<class T>
+    T& emplace(entt::entity entity, entt::registry& registry)
+    {
+        auto& list = std::get<std::vector<T>>(released);
+        if (list.empty())
+            return registry.emplace<T>(entity);
+
+        auto& component = registry.emplace<T>(entity, std::move(list.back()));
+        list.pop_back();
+        ++reused_count;
+        component.dirty();
+        return component;
+    }
+
+    //! The entity's T, added with emplace() if it has none
+    template<class T>
+    T& get_or_emplace(entt::entity entity, entt::registry& registry)
+    {
+        if (auto* component = registry.try_get<T>(entity))
+            return *component;
+        return emplace<T>(entity, registry);
+    }
+
+    //! Removes an entity's T, keeping it for reuse
+    template<class T>
+    void remove(entt::entity entity, entt::registry& registry)
+    {
+        if (auto* component = registry.try_get<T>(entity))
+        {
+            recycle(std::move(*component));
+            registry.remove<T>(entity);
+        }
+    }
+
+    //! Moves every pooled component type out of an entity.
+    void release(entt::entity entity, entt::registry& registry)
+    {
+        remove<rocky::Line>(entity, registry);
+        remove<rocky::Mesh>(entity, registry);
+        remove<rocky::Label>(entity, registry);
+        remove<rocky::Icon>(entity, registry);
+    }
+
+    //! Released components waiting for reuse, and how many were reused so far
+    std::size_t pooled() const
+    {
+        return std::get<0>(released).size() + std::get<1>(released).size() +
+            std::get<2>(released).size() + std::get<3>(released).size();
+    }
+    std::size_t reused() const { return reused_count; }
+
+private:
+    std::tuple<
+        std::vector<rocky::Line>,
+        std::vector<rocky::Mesh>,
+        std::vector<rocky::Label>,
+        std::vector<rocky::Icon>> released;
+    std::size_t reused_count = 0u;
+
+    void recycle(rocky::Line&& line)
+    {
+        line.points.clear();
+        line.style = rocky::LineStyle{};
+        keep(std::move(line));
+    }
+
+    void recycle(rocky::Mesh&& mesh)
+    {
+        mesh.triangles.clear();
+        mesh.style = rocky::MeshStyle{};
+        keep(std::move(mesh));
+    }
+
+    void recycle(rocky::Label&& label)
+    {
+        label.text.clear();
+        label.style = rocky::LabelStyle{};
+        keep(std::move(label));
+    }
+
+    void recycle(rocky::Icon&& icon)
+    {
+        icon.image = nullptr;
+        icon.style = rocky::IconStyle{};
+        keep(std::move(icon));
+    }
+
+    template<class T>
+    void keep(T&& component)
+    {
+        auto& list = std::get<std::vector<T>>(released);
+        if (list.size() < max_pooled)
+            list.emplace_back(std::move(component));
+    }
+};
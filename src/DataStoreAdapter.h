@@ -3,63 +3,800 @@
 #include "Platform.h"
 #include "Beam.h"
 #include "Gate.h"
+#include "EntitySnapshot.h"
+#include "FrameScheduler.h"
+#include "Stats.h"
+#include "WorkerPool.h"
 #include <rocky/vsg/Application.h>
 #include <rocky/vsg/ecs.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+//! Everything needed to apply one entity's time updates, resolved once when
+//! the entity is created so the per-frame path does no map lookups. Host
+//! entities are kept in the hot Beam and Gate components.
+template<class SLICE>
+struct UpdateRecord
+{
+    simData::ObjectId id;
+    entt::entity entity = entt::null;
+    const SLICE* slice = nullptr;
+    bool queued = false;            // listed in 'dirty'
+    std::uint16_t waited = 0u;      // frames spent deferred
+};
+
+//! Contiguous update records for one entity type, plus the indices of the
+//! records whose slice changed and that have not been applied yet. A record
+//! is listed at most once however many DataStore updates it misses. The
+//! slots of erased records are reused, so the list stays the size of the
+//! live entities.
+template<class SLICE>
+struct UpdateList
+{
+    std::vector<UpdateRecord<SLICE>> records;
+    std::vector<std::uint32_t> dirty;
+
+    //! records per parallel chunk
+    static constexpr std::size_t grain = 512u;
+
+    //! Adds a record. It starts out dirty when its slice already has data,
+    //! since the slice change that produced it may predate the record.
+    void add(const UpdateRecord<SLICE>& record)
+    {
+        std::uint32_t i;
+        if (!free_slots.empty())
+        {
+            i = free_slots.back();
+            free_slots.pop_back();
+            records[i] = record;
+        }
+        else
+        {
+            i = (std::uint32_t)records.size();
+            records.push_back(record);
+        }
+        slots[record.id] = i;
+
+        if (record.slice && record.slice->current())
+        {
+            records[i].queued = true;
+            dirty.emplace_back(i);
+        }
+    }
+
+    //! Drops the record of an entity leaving the DataStore, so its slice is
+    //! never read again. A listed record keeps its place in 'dirty' (and is
+    //! skipped) until consume() passes it.
+    void erase(simData::ObjectId id)
+    {
+        auto slot = slots.find(id);
+        if (slot == slots.end())
+            return;
+
+        auto& record = records[slot->second];
+        record.slice = nullptr;
+        record.entity = entt::null;
+        if (!record.queued)
+            free_slots.emplace_back(slot->second);
+        slots.erase(slot);
+    }
+
+    //! Applies the current data of dirty records [begin, end) with
+    //! func(update, entity), in chunks on 'pool' if there is one, and keeps
+    //! what each call returns in 'changes' (indexed from 'begin') so the
+    //! results can be committed serially, in record order.
+    template<class FUNC>
+    void apply(WorkerPool* pool, std::size_t begin, std::size_t end, std::vector<ChangeMask>& changes, FUNC&& func)
+    {
+        changes.resize(end - begin);
+        parallel_for(pool, end - begin, grain, [&](std::size_t chunk_begin, std::size_t chunk_end)
+            {
+                for (auto i = chunk_begin; i < chunk_end; ++i)
+                {
+                    auto& record = records[dirty[begin + i]];
+                    changes[i] = record.slice ? func(record.slice->current(), record.entity) : 0u;
+                }
+            });
+    }
+
+    //! Moves the dirty records that must be applied this frame to the front,
+    //! keeping their order: those for which urgent(entity) is true, and those
+    //! already deferred for 'max_wait' frames.
+    //! @return how many there are
+    template<class PRED>
+    std::size_t prioritize(PRED&& urgent, std::uint16_t max_wait)
+    {
+        auto middle = std::stable_partition(dirty.begin(), dirty.end(), [&](std::uint32_t i)
+            {
+                auto& record = records[i];
+                return !record.slice || record.waited >= max_wait || urgent(record.entity);
+            });
+        return (std::size_t)(middle - dirty.begin());
+    }
+
+    //! Drops the first 'count' dirty records, which have been applied; the
+    //! rest stay dirty for the next frame.
+    void consume(std::size_t count)
+    {
+        for (std::size_t i = 0; i < dirty.size(); ++i)
+        {
+            auto& record = records[dirty[i]];
+            if (i < count)
+            {
+                record.queued = false, record.waited = 0u;
+                if (!record.slice)
+                    free_slots.emplace_back(dirty[i]);
+            }
+            else if (record.waited < 0xffffu)
+            {
+                ++record.waited;
+            }
+        }
+        dirty.erase(dirty.begin(), dirty.begin() + (std::ptrdiff_t)count);
+    }
+
+    void collectChanged()
+    {
+        for (std::uint32_t i = 0; i < (std::uint32_t)records.size(); ++i)
+        {
+            auto& record = records[i];
+            if (!record.queued && record.slice && record.slice->hasChanged() && record.slice->current())
+            {
+                record.queued = true;
+                dirty.emplace_back(i);
+            }
+        }
+    }
+
+private:
+    std::unordered_map<simData::ObjectId, std::uint32_t> slots;
+    std::vector<std::uint32_t> free_slots;
+};
+
+
+//! Listener events (entity added, properties or prefs changed), merged per
+//! entity until they are taken for processing. Thread safe.
+class EventQueue
+{
+public:
+    enum : unsigned { ADDED = 1u, PROPS = 2u, PREFS = 4u, REMOVED = 8u };
+
+    struct Event
+    {
+        simData::ObjectId id;
+        simData::ObjectType type;   // simData::NONE when not known yet
+        unsigned changes;
+    };
+
+    void push(simData::ObjectId id, simData::ObjectType type, unsigned change)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++received;
+
+        auto [slot, inserted] = slots.emplace(id, (std::uint32_t)events.size());
+        if (inserted)
+        {
+            events.push_back({ id, type, change });
+        }
+        else
+        {
+            auto& event = events[slot->second];
+            event.changes |= change;
+            if (type != simData::NONE)
+                event.type = type;
+        }
+    }
+
+    //! Moves the queued events into 'out' (which is cleared first), oldest first.
+    //! @return false if there were none
+    bool take(std::vector<Event>& out)
+    {
+        out.clear();
+        std::lock_guard<std::mutex> lock(mutex);
+        if (events.empty())
+            return false;
+        out.swap(events);
+        slots.clear();
+        return true;
+    }
+
+    //! Puts taken events that were not processed back at the front of the
+    //! queue, ahead of (and merged with) any pushed since, so entities are
+    //! still created in the order they were added.
+    void requeue(std::vector<Event>::const_iterator first, std::vector<Event>::const_iterator last)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<Event> merged(first, last);
+        slots.clear();
+        for (std::uint32_t i = 0; i < (std::uint32_t)merged.size(); ++i)
+            slots.emplace(merged[i].id, i);
+
+        for (auto& event : events)
+        {
+            auto [slot, inserted] = slots.emplace(event.id, (std::uint32_t)merged.size());
+            if (inserted)
+            {
+                merged.push_back(event);
+            }
+            else
+            {
+                merged[slot->second].changes |= event.changes;
+                if (event.type != simData::NONE)
+                    merged[slot->second].type = event.type;
+            }
+        }
+        events.swap(merged);
+    }
+
+    //! Total number of events pushed, before merging
+    std::uint64_t count() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return received;
+    }
+
+private:
+    mutable std::mutex mutex;
+    std::vector<Event> events;
+    std::unordered_map<simData::ObjectId, std::uint32_t> slots;
+    std::uint64_t received = 0u;
+};
 
 
 //! Listener that relays DataStore messages to the appropriate Adapter.
 class DataStoreAdapter : public simData::DataStore::DefaultListener
 {
 public:
-    rocky::Application& app;
+    rocky::ecs::Registry& ecs;
 
     SimulationContext sim;
     PlatformAdapter platforms;
     BeamAdapter beams;
     GateAdapter gates;
 
+    //! hot state of every entity as of the last update, for lock-free readers
+    SnapshotBuffer snapshots;
+
+    //! per-stage frame timings and counters (off until enabled); a frame
+    //! ends with each finishUpdate()
+    FrameStats stats;
+
+    //! hides overlapping labels; see declutterLabels()
+    LabelDeclutter declutter;
+
+    //! Milliseconds update() may spend on listener events and time updates
+    //! before leaving the rest for later frames, updating entities in view
+    //! first (see setView()). 0 applies everything every frame.
+    double frame_budget = 0.0;
+
+    //! frames a time update may be deferred before it is applied whatever
+    //! the budget
+    std::uint16_t max_deferred_frames = 8u;
+
     DataStoreAdapter(rocky::Application& app_) :
-        app(app_),
-        sim({ app.context })
+        DataStoreAdapter(app_.context, app_.registry)
+    {
+        //nop
+    }
+
+    //! Construct an adapter that writes to an arbitrary registry. The context may be
+    //! empty when running headless (no window or Vulkan device), in which case entities
+    //! get no fonts or icon images.
+    DataStoreAdapter(rocky::VSGContext context_, rocky::ecs::Registry& ecs_) :
+        ecs(ecs_),
+        sim{ context_ }
     {
-        //nop        
+        setThreads(std::thread::hardware_concurrency());
     }
 
+    //! Number of threads update() spreads the per-entity work over, including
+    //! the calling thread. 1 (or 0) updates everything on the calling thread.
+    void setThreads(unsigned threads)
+    {
+        workers.reset(threads > 1u ? new WorkerPool(threads - 1u) : nullptr);
+    }
+
+    unsigned threads() const
+    {
+        return workers ? workers->size() + 1u : 1u;
+    }
+
+    //! Listener events are queued and merged per entity, then applied together
+    //! under a single write lock by flushEvents() at the start of update().
     void onAddEntity(simData::DataStore* ds, simData::ObjectId id, simData::ObjectType type) override
     {
-        auto [lock, registry] = app.registry.write();
+        events.push(id, type, EventQueue::ADDED);
+    }
+
+    void onPropertiesChange(simData::DataStore* ds, simData::ObjectId id) override
+    {
+        events.push(id, simData::NONE, EventQueue::PROPS);
+    }
+
+    void onPrefsChange(simData::DataStore* ds, simData::ObjectId id) override
+    {
+        events.push(id, simData::NONE, EventQueue::PREFS);
+    }
+
+    //! The DataStore frees the entity's update slice when this returns, so its
+    //! update record goes now; the entity itself is removed with the other
+    //! queued events. The DataStore reports each hosted beam and gate too.
+    void onRemoveEntity(simData::DataStore* ds, simData::ObjectId id, simData::ObjectType type) override
+    {
+        platform_updates.erase(id);
+        beam_updates.erase(id);
+        gate_updates.erase(id);
+        events.push(id, type, EventQueue::REMOVED);
+    }
+
+    //! Removes every entity, as the whole scenario is about to go.
+    void onScenarioDelete(simData::DataStore* ds) override
+    {
+        simData::DataStore::IdList ids;
+        ds->idList(&ids);
+        for (auto id : ids)
+            onRemoveEntity(ds, id, ds->objectType(id));
+    }
+
+    //! Removes an entity and everything it hosts (a platform's beams and their
+    //! gates) from the registry and every index, keeping their visual
+    //! components for reuse. Call with the registry locked for writing.
+    void removeEntity(simData::ObjectId id, entt::registry& registry)
+    {
+        auto entity = sim.entities[id];
+        if (entity != entt::null)
+        {
+            destroy(entity, registry);
+            snapshots.rebuild();
+        }
+    }
+
+    //! Applies the queued listener events, oldest first, until the budget runs
+    //! out; the rest stay queued for the next call. Each entity is created at
+    //! most once and gets at most one properties and one prefs application,
+    //! using the latest values in the DataStore.
+    void flushEvents(simData::DataStore* ds, const FrameBudget& budget = {})
+    {
+        if (!events.take(flushing))
+            return;
+
+        ScopedTimer timer(stats, FrameStats::FLUSH_EVENTS);
+        auto applied = event_stats.applied;
+
+        ScopedTimer waiting(stats, FrameStats::LOCK_WAIT);
+        auto [lock, registry] = ecs.write();
+        waiting.stop();
+
+        for (std::size_t i = 0; i < flushing.size(); ++i)
+        {
+            // checking the clock every few events keeps its cost out of the way
+            if (i > 0 && i % 16u == 0 && budget.exhausted())
+            {
+                events.requeue(flushing.begin() + (std::ptrdiff_t)i, flushing.end());
+                stats.count(FrameStats::EVENTS_DEFERRED, flushing.size() - i);
+                break;
+            }
+
+            auto& event = flushing[i];
+
+            // an entity added and removed between flushes is never created
+            if (event.changes & EventQueue::REMOVED)
+            {
+                removeEntity(event.id, registry);
+                ++event_stats.applied;
+                continue;
+            }
 
+            auto type = event.type != simData::NONE ? event.type : ds->objectType(event.id);
+
+            if (event.changes & EventQueue::ADDED)
+            {
+                // creation applies the current properties
+                applyAddEntity(ds, event.id, type, registry);
+                snapshots.rebuild();
+                ++event_stats.applied;
+            }
+            else if (event.changes & EventQueue::PROPS)
+            {
+                applyPropertiesChange(ds, event.id, type, registry);
+                ++event_stats.applied;
+            }
+
+            if (event.changes & EventQueue::PREFS)
+            {
+                applyPrefsChange(ds, event.id, type, registry);
+                snapshots.markDirty(sim.entities[event.id]);
+                ++event_stats.applied;
+            }
+        }
+
+        auto received = events.count();
+        if (stats.enabled())
+        {
+            stats.count(FrameStats::EVENTS_RECEIVED, received - events_counted);
+            stats.count(FrameStats::EVENTS_COALESCED, (received - events_counted) - (event_stats.applied - applied));
+        }
+        events_counted = received;
+    }
+
+    //! Listener event counters
+    struct EventStats
+    {
+        std::uint64_t received = 0;
+        std::uint64_t applied = 0;
+
+        //! events merged away (or implied by an earlier event) before being applied
+        std::uint64_t coalesced() const { return received - applied; }
+    };
+
+    EventStats eventStats() const
+    {
+        auto stats = event_stats;
+        stats.received = events.count();
+        return stats;
+    }
+
+    //! Called by the DataStore after it updates to a new time. Records which
+    //! entities received new data so the next update() touches only those.
+    void onTimeChange(simData::DataStore* ds) override
+    {
+        ScopedTimer timer(stats, FrameStats::LISTENER);
+        platform_updates.collectChanged();
+        beam_updates.collectChanged();
+        gate_updates.collectChanged();
+    }
+
+    //! Sets the view whose entities update() serves first when it is over
+    //! budget, and outside which entities lose their visual components (see
+    //! Materializer). 'view_projection' maps ECEF to clip space.
+    void setView(const vsg::dmat4& view_projection)
+    {
+        view = view_projection;
+        has_view = true;
+    }
+
+    //! Applies the current data of every entity that changed since the last
+    //! DataStore update, one type at a time. Call once per frame after
+    //! data_store.update(time).
+    //!
+    //! Each phase splits its entities into chunks across the worker threads.
+    //! The registry is locked for writing for the whole update, which keeps
+    //! the rendering and snapshot readers out; the workers themselves share
+    //! the registry without further locking. That is safe with entt because
+    //! of what each parallel loop touches:
+    //!  - the update phases get the Platform, Beam or Gate and the Transform
+    //!    of entities of that type. Those storages were created with the
+    //!    first such entity, so registry.get() only finds them in the pool
+    //!    map. The update lists hold each entity once, so each component is
+    //!    written by one worker.
+    //!  - gate geometry (in finishUpdate()) writes gates' Lines. A Line only
+    //!    exists once its gate is materialized, so each gate is first checked
+    //!    with the const valid() and all_of<rocky::Line>(), which never create
+    //!    storage, and get() follows only when the Line (and so its storage)
+    //!    exists. GateGeometryBatch holds each entity once per batch, so each
+    //!    Line is written by one worker.
+    //!  - host propagation writes the Transform of the entities at one depth,
+    //!    each listed once, and reads their hosts' (done at the depth before)
+    //!    and the host Beam through a const lookup.
+    //! No parallel loop emplaces or removes components, so no storage's
+    //! sparse or packed arrays are resized while workers read them. Anything
+    //! shared (the host graph, the spatial index, the gate geometry batch) is
+    //! updated serially between chunks, in record order, so the result does
+    //! not depend on the number of threads.
+    //!
+    //! With a frame_budget, entities in view and those deferred for
+    //! max_deferred_frames are always updated; the others are updated a chunk
+    //! at a time until the budget runs out, and the rest keep their slot for
+    //! the next frame. Gate geometry follows the gate updates, so it is spread
+    //! over frames the same way.
+    //! @return number of entities updated
+    std::size_t update(simData::DataStore* ds)
+    {
+        FrameBudget budget(frame_budget);
+        flushEvents(ds, budget);
+        applyLoadedAssets();
+
+        ScopedTimer waiting(stats, FrameStats::LOCK_WAIT);
+        auto [lock, registry] = ecs.write();
+        waiting.stop();
+
+        // transforms of hosted objects are rebuilt afterwards by the host graph
+        ScopedTimer platform_timer(stats, FrameStats::PLATFORM_UPDATES);
+        auto count = applyUpdates(platform_updates, budget, registry,
+            [&](const simData::PlatformUpdate* update, entt::entity entity) { return platforms.applyUpdate(update, entity, registry); },
+            [&](entt::entity entity, ChangeMask mask) { platforms.commitUpdate(entity, mask, sim, registry); });
+        platform_timer.stop();
+
+        ScopedTimer beam_timer(stats, FrameStats::BEAM_UPDATES);
+        count += applyUpdates(beam_updates, budget, registry,
+            [&](const simData::BeamUpdate* update, entt::entity entity) { return beams.applyUpdate(update, entity, registry); },
+            [&](entt::entity entity, ChangeMask mask) { beams.commitUpdate(entity, mask, sim); });
+        beam_timer.stop();
+
+        ScopedTimer gate_timer(stats, FrameStats::GATE_UPDATES);
+        count += applyUpdates(gate_updates, budget, registry,
+            [&](const simData::GateUpdate* update, entt::entity entity) { return gates.applyUpdate(update, entity, registry); },
+            [&](entt::entity entity, ChangeMask mask) { gates.commitUpdate(entity, mask, registry); });
+        gate_timer.stop();
+
+        stats.count(FrameStats::ENTITIES_UPDATED, count);
+        stats.count(FrameStats::UPDATES_DEFERRED, platform_updates.dirty.size() + beam_updates.dirty.size() + gate_updates.dirty.size());
+
+        finishUpdate(registry);
+        return count;
+    }
+
+    //! Time updates left for later frames by the budget
+    std::size_t deferred() const
+    {
+        return platform_updates.dirty.size() + beam_updates.dirty.size() + gate_updates.dirty.size();
+    }
+
+    //! Applies platform moves to the spatial index, materializes and releases
+    //! visual components by view, rebuilds the gate geometry and hosted
+    //! transforms made stale by the updates committed since the last call,
+    //! syncs the track lines, publishes a new snapshot and ends the stats
+    //! frame. Call with the registry locked for writing.
+    void finishUpdate(entt::registry& registry)
+    {
+        auto* pool = workers.get();
+
+        sim.spatial.apply();
+
+        // before the geometry, which fills in the outlines of gates that
+        // come into view
+        ScopedTimer visuals_timer(stats, FrameStats::VISUALS);
+        auto now = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        sim.visuals.apply(registry, sim.hosts, sim.spatial, has_view ? &view : nullptr, now,
+            [&](entt::entity entity)
+            {
+                if (registry.all_of<Platform>(entity))
+                    platforms.materialize(entity, sim, registry);
+                else if (registry.all_of<Beam>(entity))
+                    beams.materialize(entity, sim, registry);
+                else if (registry.all_of<Gate>(entity))
+                    gates.materialize(entity, sim, registry);
+            },
+            [&](entt::entity entity)
+            {
+                if (registry.all_of<Platform>(entity))
+                    platforms.dematerialize(entity, sim, registry);
+                else if (registry.all_of<Beam>(entity))
+                    beams.dematerialize(entity, sim, registry);
+                else if (registry.all_of<Gate>(entity))
+                    gates.dematerialize(entity, sim, registry);
+            });
+        stats.count(FrameStats::VISUALS_BUILT, sim.visuals.built());
+        stats.count(FrameStats::VISUALS_RELEASED, sim.visuals.released());
+        visuals_timer.stop();
+
+        ScopedTimer geometry_timer(stats, FrameStats::GATE_GEOMETRY);
+        stats.count(FrameStats::GEOMETRY_REBUILDS, gates.applyGeometry(registry, pool));
+        geometry_timer.stop();
+
+        // carry host moves down to the beams and gates that depend on them,
+        // one depth at a time so every host is done before what it carries
+        ScopedTimer propagation_timer(stats, FrameStats::HOST_PROPAGATION);
+        sim.hosts.propagateByDepth([&](const std::vector<entt::entity>& entities)
+            {
+                stats.count(FrameStats::TRANSFORMS_DIRTIED, entities.size());
+                for (auto entity : entities)
+                    snapshots.markDirty(entity);
+                parallel_for(pool, entities.size(), 512u, [&](std::size_t begin, std::size_t end)
+                    {
+                        for (auto i = begin; i < end; ++i)
+                        {
+                            auto entity = entities[i];
+                            if (registry.all_of<Beam>(entity))
+                                beams.updateTransform(entity, registry);
+                            else if (registry.all_of<Gate>(entity))
+                                gates.updateTransform(entity, registry);
+                        }
+                    });
+            });
+        propagation_timer.stop();
+
+        ScopedTimer tracks_timer(stats, FrameStats::TRACKS);
+        sim.tracks.apply(registry);
+        tracks_timer.stop();
+
+        ScopedTimer snapshot_timer(stats, FrameStats::SNAPSHOT);
+        snapshots.publish(registry);
+        snapshot_timer.stop();
+
+        stats.endFrame();
+    }
+
+    //! Hides labels that overlap a label of higher priority in the given view
+    //! (or shows them all again if 'enabled' is false). Call once per frame,
+    //! after update(). 'view_projection' maps ECEF to clip space and width and
+    //! height are the viewport size in pixels.
+    void declutterLabels(const vsg::dmat4& view_projection, double width, double height, bool enabled = true)
+    {
+        ScopedTimer timer(stats, FrameStats::DECLUTTER);
+
+        ScopedTimer waiting(stats, FrameStats::LOCK_WAIT);
+        auto [lock, registry] = ecs.write();
+        waiting.stop();
+
+        if (enabled)
+            declutter.apply(registry, view_projection, width, height);
+        else if (declutter.hidden() > 0u)
+            declutter.showAll(registry);
+    }
+
+    //! Swaps placeholders for icons and fonts that finished loading in the
+    //! background. Takes the write lock only when some load has completed.
+    void applyLoadedAssets()
+    {
+        auto completions = sim.assets.completions();
+        if (completions != asset_completions)
+        {
+            asset_completions = completions;
+            ScopedTimer timer(stats, FrameStats::LOADED_ASSETS);
+
+            ScopedTimer waiting(stats, FrameStats::LOCK_WAIT);
+            auto [lock, registry] = ecs.write();
+            waiting.stop();
+            platforms.applyLoadedIcons(registry);
+            platforms.applyLoadedFonts(registry);
+        }
+    }
+
+private:
+    //! dirty records applied per budget check, past the ones that must be
+    static constexpr std::size_t budget_chunk = 2048u;
+
+    //! Applies the dirty records of one update list with apply(update, entity)
+    //! and commits each result with commit(entity, changes), within the budget.
+    //! @return number of records applied
+    template<class SLICE, class APPLY, class COMMIT>
+    std::size_t applyUpdates(UpdateList<SLICE>& updates, const FrameBudget& budget, const entt::registry& registry, APPLY&& apply, COMMIT&& commit)
+    {
+        auto* pool = workers.get();
+        auto end = updates.dirty.size();
+        auto urgent = end;
+        if (budget.limited())
+        {
+            urgent = updates.prioritize([&](entt::entity entity) { return inView(entity, registry); }, max_deferred_frames);
+        }
+
+        std::size_t begin = 0;
+        while (begin < end)
+        {
+            if (begin >= urgent && budget.exhausted())
+                break;
+
+            auto chunk_end = begin < urgent ? urgent : std::min(end, begin + budget_chunk);
+            updates.apply(pool, begin, chunk_end, changes, apply);
+            for (std::size_t i = 0; i < changes.size(); ++i)
+            {
+                auto entity = updates.records[updates.dirty[begin + i]].entity;
+                if (entity != entt::null && changes[i] != 0u)
+                {
+                    commit(entity, changes[i]);
+                    snapshots.markDirty(entity);
+                }
+            }
+            begin = chunk_end;
+        }
+
+        updates.consume(begin);
+        return begin;
+    }
+
+    //! Whether an entity's position is inside the view set by setView()
+    bool inView(entt::entity entity, const entt::registry& registry) const
+    {
+        if (!has_view)
+            return false;
+        auto* transform = registry.try_get<rocky::Transform>(entity);
+        if (!transform)
+            return false;
+
+        // clip space; vsg matrices are column major (m[column][row])
+        auto& m = view;
+        auto& p = transform->position;
+        auto w = m[0][3] * p.x + m[1][3] * p.y + m[2][3] * p.z + m[3][3];
+        if (w <= 0.0)
+            return false;
+        auto x = m[0][0] * p.x + m[1][0] * p.y + m[2][0] * p.z + m[3][0];
+        auto y = m[0][1] * p.x + m[1][1] * p.y + m[2][1] * p.z + m[3][1];
+        return x >= -w && x <= w && y >= -w && y <= w;
+    }
+
+    vsg::dmat4 view;
+    bool has_view = false;
+
+    void destroy(entt::entity entity, entt::registry& registry)
+    {
+        // hosted entities first; copied, since destroying them edits the list
+        auto hosted = sim.hosts.children(entity);
+        for (auto child : hosted)
+            destroy(child, registry);
+
+        // the update records are normally gone already (see onRemoveEntity)
+        if (registry.all_of<Platform>(entity))
+        {
+            platform_updates.erase(registry.get<PlatformInfo>(entity).id);
+            platforms.destroy(entity, sim, registry);
+        }
+        else if (registry.all_of<Beam>(entity))
+        {
+            beam_updates.erase(registry.get<BeamInfo>(entity).id);
+            beams.destroy(entity, sim, registry);
+        }
+        else if (registry.all_of<Gate>(entity))
+        {
+            gate_updates.erase(registry.get<GateInfo>(entity).id);
+            gates.destroy(entity, sim, registry);
+        }
+    }
+
+    EventQueue events;
+    std::vector<EventQueue::Event> flushing;
+    EventStats event_stats;
+    std::uint64_t events_counted = 0u;
+
+    std::unique_ptr<WorkerPool> workers;
+    std::vector<ChangeMask> changes;
+
+    std::uint64_t asset_completions = 0u;
+    UpdateList<simData::PlatformUpdateSlice> platform_updates;
+    UpdateList<simData::BeamUpdateSlice> beam_updates;
+    UpdateList<simData::GateUpdateSlice> gate_updates;
+
+    void applyAddEntity(simData::DataStore* ds, simData::ObjectId id, simData::ObjectType type, entt::registry& registry)
+    {
         if (type & simData::PLATFORM)
         {
             simData::DataStore::Transaction x;
             auto props = ds->platformProperties(id, &x);
-            platforms.create(props, sim, registry);
+            auto entity = platforms.create(props, sim, registry);
             x.complete(&props);
+
+            if (entity != entt::null)
+            {
+                platform_updates.add({ id, entity, ds->platformUpdateSlice(id) });
+            }
         }
 
         else if (type & simData::BEAM)
         {
             simData::DataStore::Transaction x;
             auto props = ds->beamProperties(id, &x);
-            beams.create(props, sim, registry);
+            auto entity = beams.create(props, sim, registry);
             x.complete(&props);
+
+            if (entity != entt::null)
+            {
+                beam_updates.add({ id, entity, ds->beamUpdateSlice(id) });
+            }
         }
 
         else if (type & simData::GATE)
         {
             simData::DataStore::Transaction x;
             auto props = ds->gateProperties(id, &x);
-            gates.create(props, sim, registry);
+            auto entity = gates.create(props, sim, registry);
             x.complete(&props);
+
+            if (entity != entt::null)
+            {
+                gate_updates.add({ id, entity, ds->gateUpdateSlice(id) });
+            }
         }
     }
 
-    void onPropertiesChange(simData::DataStore* ds, simData::ObjectId id) override
+    void applyPropertiesChange(simData::DataStore* ds, simData::ObjectId id, simData::ObjectType type, entt::registry& registry)
     {
-        auto [lock, registry] = app.registry.write();
-
-        auto type = ds->objectType(id);
-
         if (type & simData::PLATFORM)
         {
             simData::DataStore::Transaction x;
@@ -85,12 +822,8 @@ public:
         }
     }
 
-    void onPrefsChange(simData::DataStore* ds, simData::ObjectId id) override
+    void applyPrefsChange(simData::DataStore* ds, simData::ObjectId id, simData::ObjectType type, entt::registry& registry)
     {
-        auto [lock, registry] = app.registry.write();
-
-        auto type = ds->objectType(id);
-
         if (type & simData::PLATFORM)
         {
             simData::DataStore::Transaction x;
@@ -115,39 +848,4 @@ public:
             x.complete(&prefs);
         }
     }
-
-    void update(simData::DataStore* ds, const std::vector<simData::ObjectId>& ids)
-    {
-        auto [lock, registry] = app.registry.read();
-
-        for (auto& id : ids)
-        {
-            auto type = ds->objectType(id);
-
-            if (type & simData::PLATFORM)
-            {
-                auto slice = ds->platformUpdateSlice(id);
-                if (slice && slice->current())
-                {
-                    platforms.applyUpdate(slice->current(), id, sim, registry);
-                }
-            }
-            else if (type & simData::BEAM)
-            {
-                auto slice = ds->beamUpdateSlice(id);
-                if (slice && slice->current())
-                {
-                    beams.applyUpdate(slice->current(), id, sim, registry);
-                }
-            }
-            else if (type & simData::GATE)
-            {
-                auto slice = ds->gateUpdateSlice(id);
-                if (slice && slice->current())
-                {
-                    gates.applyUpdate(slice->current(), id, sim, registry);
-                }
-            }
-        }
-    }
 };
@@ -0,0 +1,141 @@
+#pragma once
+#include <simData/ObjectId.h>
+#include <entt/entt.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+
+//! Maps simData::ObjectId to entt::entity.
+//!
+//! MemoryDataStore assigns dense, mostly increasing IDs, so the index is a paged
+//! array addressed directly by ID: lookups, inserts and erases are O(1) with no
+//! hashing, and pages are only allocated where IDs exist. A page is freed when
+//! its last ID is erased, so a scenario that keeps removing old entities and
+//! adding new ones holds only the pages of the live IDs. IDs too large to page
+//! sensibly fall back to a hash map.
+//!
+//! Unlike std::unordered_map, operator[] never inserts; it returns entt::null
+//! for an unknown ID.
+class EntityIndex
+{
+public:
+    static constexpr std::size_t page_size = 4096;
+    static constexpr simData::ObjectId max_paged_id = simData::ObjectId(page_size) * 16384u;
+
+    //! Entity mapped to an ID, or entt::null if there is none.
+    entt::entity operator[](simData::ObjectId id) const
+    {
+        if (id < max_paged_id)
+        {
+            auto p = (std::size_t)(id / page_size);
+            return p < pages.size() && pages[p] ? (*pages[p])[id % page_size] : entt::null;
+        }
+        else
+        {
+            auto i = overflow.find(id);
+            return i != overflow.end() ? i->second : entt::null;
+        }
+    }
+
+    bool contains(simData::ObjectId id) const
+    {
+        return (*this)[id] != entt::null;
+    }
+
+    //! Maps an ID to an entity, replacing any existing mapping.
+    void insert(simData::ObjectId id, entt::entity entity)
+    {
+        if (entity == entt::null)
+        {
+            erase(id);
+        }
+        else if (id < max_paged_id)
+        {
+            auto p = (std::size_t)(id / page_size);
+            if (p >= pages.size())
+            {
+                pages.resize(p + 1);
+                page_counts.resize(p + 1, 0u);
+            }
+            if (!pages[p])
+            {
+                pages[p] = std::make_unique<Page>();
+                pages[p]->fill(entt::null);
+            }
+            auto& slot = (*pages[p])[id % page_size];
+            if (slot == entt::null)
+            {
+                ++count;
+                ++page_counts[p];
+            }
+            slot = entity;
+        }
+        else
+        {
+            if (overflow.emplace(id, entity).second)
+                ++count;
+            else
+                overflow[id] = entity;
+        }
+    }
+
+    //! Removes the mapping for an ID.
+    //! @return true if there was one
+    bool erase(simData::ObjectId id)
+    {
+        if (id < max_paged_id)
+        {
+            auto p = (std::size_t)(id / page_size);
+            if (p < pages.size() && pages[p])
+            {
+                auto& slot = (*pages[p])[id % page_size];
+                if (slot != entt::null)
+                {
+                    slot = entt::null;
+                    --count;
+                    if (--page_counts[p] == 0u)
+                        pages[p].reset();
+                    return true;
+                }
+            }
+            return false;
+        }
+        else if (overflow.erase(id) > 0)
+        {
+            --count;
+            return true;
+        }
+        return false;
+    }
+
+    //! Number of mapped IDs
+    std::size_t size() const
+    {
+        return count;
+    }
+
+    bool empty() const
+    {
+        return count == 0;
+    }
+
+    void clear()
+    {
+        pages.clear();
+        page_counts.clear();
+        overflow.clear();
+        count = 0;
+    }
+
+private:
+    using Page = std::array<entt::entity, page_size>;
+    std::vector<std::unique_ptr<Page>> pages;
+    std::vector<std::uint32_t> page_counts;     // mapped IDs per page
+    std::unordered_map<simData::ObjectId, entt::entity> overflow;
+    std::size_t count = 0;
+};
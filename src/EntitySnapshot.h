@@ -0,0 +1,252 @@
+#pragma once
+#include "Platform.h"
+#include "Beam.h"
+#include "Gate.h"
+#include <simData/ObjectId.h>
+#include <entt/entt.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+//! Hot state of one entity as of a snapshot.
+struct EntityState
+{
+    simData::ObjectId id = 0;
+    entt::entity entity = entt::null;
+    simData::ObjectType type = simData::NONE;
+    bool visible = true;
+
+    //! ECEF position of the entity (beams and gates: of their host)
+    vsg::dvec3 position;
+
+    //! pointing direction of beams and gates, radians (0 for platforms)
+    double azimuth = 0.0;
+    double elevation = 0.0;
+};
+
+//! Immutable view of every entity's hot state as of one frame.
+struct EntitySnapshot
+{
+    //! number of the publish that produced it; frames that change nothing
+    //! publish nothing
+    std::uint64_t frame = 0u;
+
+    //! entity states, sorted by ID
+    std::vector<EntityState> entities;
+
+    //! State of an entity, or nullptr if it was not in the snapshot.
+    const EntityState* find(simData::ObjectId id) const
+    {
+        auto i = std::lower_bound(entities.begin(), entities.end(), id,
+            [](const EntityState& state, simData::ObjectId id) { return state.id < id; });
+        return i != entities.end() && i->id == id ? &*i : nullptr;
+    }
+};
+
+
+//! Publishes an EntitySnapshot once per frame for readers that must not take
+//! the registry lock (pickers, declutter, external queries).
+//!
+//! The writer fills a back buffer while holding the registry lock, then swaps it
+//! in. Readers call acquire() and keep the returned snapshot for as long as they
+//! like; it never changes underneath them. The only lock readers take guards the
+//! pointer copy, never the entity data, so they never wait on ingest.
+//!
+//! The writer reports what changed with markDirty() (an entity's state) and
+//! rebuild() (entities added or removed). publish() does nothing when nothing
+//! changed, and otherwise patches only the dirty entities into the back
+//! buffer, which is the snapshot from two publishes ago: it gets the entities
+//! dirtied for the previous publish and those dirtied for this one. Only
+//! when a reader still holds that buffer, or after a rebuild, is the current
+//! snapshot copied first. A full pass over the registry happens only on
+//! rebuild(), so the cost follows what changed, not the entity count.
+class SnapshotBuffer
+{
+public:
+    //! Latest published snapshot (never null)
+    std::shared_ptr<const EntitySnapshot> acquire() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return current;
+    }
+
+    //! Records that an entity's state (position, angles or draw pref) changed
+    void markDirty(entt::entity entity)
+    {
+        if (entity != entt::null)
+            dirty.emplace_back(entity);
+    }
+
+    //! Records that entities were added or removed, so the next publish()
+    //! rebuilds the snapshot from the registry
+    void rebuild()
+    {
+        rebuilding = true;
+    }
+
+    //! Publishes a snapshot with the changes recorded since the last call.
+    //! Call with the registry locked, once per frame.
+    void publish(const entt::registry& registry)
+    {
+        if (dirty.empty() && !rebuilding)
+            return;
+
+        std::shared_ptr<EntitySnapshot> next;
+        bool up_to_previous = false;
+        if (spare && spare.use_count() == 1)
+        {
+            next = std::move(spare);
+            up_to_previous = !rebuilt_last;
+        }
+        else
+        {
+            next = std::make_shared<EntitySnapshot>();
+        }
+
+        if (rebuilding)
+        {
+            build(registry, next->entities);
+        }
+        else
+        {
+            if (up_to_previous)
+                patch(registry, last_dirty, next->entities);
+            else
+                next->entities = current->entities;
+            patch(registry, dirty, next->entities);
+        }
+        next->frame = ++frame;
+
+        rebuilt_last = rebuilding;
+        rebuilding = false;
+        last_dirty.swap(dirty);
+        dirty.clear();
+
+        std::shared_ptr<const EntitySnapshot> previous;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            previous = std::move(current);
+            current = next;
+        }
+        spare = std::const_pointer_cast<EntitySnapshot>(previous);
+    }
+
+private:
+    mutable std::mutex mutex;
+    std::shared_ptr<const EntitySnapshot> current = std::make_shared<EntitySnapshot>();
+    std::shared_ptr<EntitySnapshot> spare;
+    std::uint64_t frame = 0u;
+
+    std::vector<entt::entity> dirty;        // since the last publish
+    std::vector<entt::entity> last_dirty;   // patched into the last publish
+    bool rebuilding = true;
+    bool rebuilt_last = true;
+
+    static bool visible(const CommonPrefsState& prefs)
+    {
+        return !(prefs.known & CommonPrefsState::DRAW) || prefs.draw;
+    }
+
+    static void fill(EntityState& state, entt::entity entity, const Platform& platform, const PlatformInfo& info, const rocky::Transform&)
+    {
+        state.id = info.id;
+        state.entity = entity;
+        state.type = simData::PLATFORM;
+        state.visible = visible(info.prefs.commonprefs);
+        state.position = vsg::dvec3(platform.x, platform.y, platform.z);
+    }
+
+    static void fill(EntityState& state, entt::entity entity, const Beam& beam, const BeamInfo& info, const rocky::Transform& transform)
+    {
+        state.id = info.id;
+        state.entity = entity;
+        state.type = simData::BEAM;
+        state.visible = visible(info.prefs.commonprefs);
+        state.position = vsg::dvec3(transform.position.x, transform.position.y, transform.position.z);
+        state.azimuth = beam.azimuth;
+        state.elevation = beam.elevation;
+    }
+
+    static void fill(EntityState& state, entt::entity entity, const Gate& gate, const GateInfo& info, const rocky::Transform& transform)
+    {
+        state.id = info.id;
+        state.entity = entity;
+        state.type = simData::GATE;
+        state.visible = visible(info.prefs.commonprefs);
+        state.position = vsg::dvec3(transform.position.x, transform.position.y, transform.position.z);
+        state.azimuth = gate.azimuth;
+        state.elevation = gate.elevation;
+    }
+
+    //! Rewrites the states of the given entities in place; the entities
+    //! themselves must be the ones in 'out'
+    static void patch(const entt::registry& registry, const std::vector<entt::entity>& entities, std::vector<EntityState>& out)
+    {
+        auto find = [&](simData::ObjectId id)
+            {
+                auto i = std::lower_bound(out.begin(), out.end(), id,
+                    [](const EntityState& state, simData::ObjectId id) { return state.id < id; });
+                return i != out.end() && i->id == id ? &*i : nullptr;
+            };
+
+        for (auto entity : entities)
+        {
+            if (!registry.valid(entity))
+                continue;
+            auto* transform = registry.try_get<rocky::Transform>(entity);
+            if (!transform)
+                continue;
+
+            if (auto* platform = registry.try_get<Platform>(entity))
+            {
+                auto& info = registry.get<PlatformInfo>(entity);
+                if (auto* state = find(info.id))
+                    fill(*state, entity, *platform, info, *transform);
+            }
+            else if (auto* beam = registry.try_get<Beam>(entity))
+            {
+                auto& info = registry.get<BeamInfo>(entity);
+                if (auto* state = find(info.id))
+                    fill(*state, entity, *beam, info, *transform);
+            }
+            else if (auto* gate = registry.try_get<Gate>(entity))
+            {
+                auto& info = registry.get<GateInfo>(entity);
+                if (auto* state = find(info.id))
+                    fill(*state, entity, *gate, info, *transform);
+            }
+        }
+    }
+
+    static void build(const entt::registry& registry, std::vector<EntityState>& out)
+    {
+        out.clear();
+
+        for (auto [entity, platform, info, transform] : registry.view<Platform, PlatformInfo, rocky::Transform>().each())
+            fill(out.emplace_back(), entity, platform, info, transform);
+        auto beams_begin = out.size();
+
+        for (auto [entity, beam, info, transform] : registry.view<Beam, BeamInfo, rocky::Transform>().each())
+            fill(out.emplace_back(), entity, beam, info, transform);
+        auto gates_begin = out.size();
+
+        for (auto [entity, gate, info, transform] : registry.view<Gate, GateInfo, rocky::Transform>().each())
+            fill(out.emplace_back(), entity, gate, info, transform);
+
+        // each view is normally already in ID order (creation order), so
+        // this is a linear merge of three runs
+        auto by_id = [](const EntityState& a, const EntityState& b) { return a.id < b.id; };
+        auto begin = out.begin();
+        for (auto [first, last] : { std::make_pair(std::size_t(0), beams_begin), std::make_pair(beams_begin, gates_begin), std::make_pair(gates_begin, out.size()) })
+        {
+            if (!std::is_sorted(begin + first, begin + last, by_id))
+                std::sort(begin + first, begin + last, by_id);
+        }
+        std::inplace_merge(begin, begin + beams_begin, begin + gates_begin, by_id);
+        std::inplace_merge(begin, begin + gates_begin, out.end(), by_id);
+    }
+};
@@ -0,0 +1,90 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+
+
+//! Advances simulation time in fixed steps, independent of the frame rate.
+//!
+//! Each frame, advance() runs one tick per whole step of wall time elapsed
+//! since the last one, so the simulation keeps a steady rate whether frames
+//! come faster or slower than it. After a stall it catches up with several
+//! ticks in one frame, but at most 'max_steps': beyond that the backlog is
+//! dropped and the simulation falls behind wall time, rather than each frame
+//! taking longer to catch up than the last.
+class FixedStepClock
+{
+public:
+    FixedStepClock(double start_time_, double rate_hz, unsigned max_steps_ = 4u) :
+        step(1.0 / std::max(rate_hz, 1e-3)),
+        max_steps(std::max(max_steps_, 1u)),
+        sim_time(start_time_)
+    {
+        //nop
+    }
+
+    //! seconds of simulation time per tick
+    const double step;
+
+    //! most ticks run by one advance()
+    const unsigned max_steps;
+
+    //! Runs tick(time) for each step due by wall time 'now' (on the same
+    //! clock as the start time).
+    //! @return number of ticks run
+    template<class FUNC>
+    unsigned advance(double now, FUNC&& tick)
+    {
+        unsigned steps = 0u;
+        while (sim_time + step <= now - dropped_time)
+        {
+            if (steps == max_steps)
+            {
+                dropped_time = now - sim_time;
+                break;
+            }
+            sim_time += step;
+            tick(sim_time);
+            ++steps;
+        }
+        return steps;
+    }
+
+    //! simulation time of the last tick
+    double time() const { return sim_time; }
+
+    //! wall time dropped by catch-up limiting, in seconds
+    double dropped() const { return dropped_time; }
+
+private:
+    double sim_time;
+    double dropped_time = 0.0;
+};
+
+
+//! Deadline for one frame's deferrable work. A budget of zero (or less)
+//! never runs out.
+class FrameBudget
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    FrameBudget(double milliseconds = 0.0) :
+        has_deadline(milliseconds > 0.0),
+        deadline(Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(milliseconds)))
+    {
+        //nop
+    }
+
+    //! whether there is a deadline at all
+    bool limited() const { return has_deadline; }
+
+    //! whether the deadline has passed
+    bool exhausted() const
+    {
+        return has_deadline && Clock::now() >= deadline;
+    }
+
+private:
+    bool has_deadline;
+    Clock::time_point deadline;
+};
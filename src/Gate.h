@@ -1,13 +1,147 @@
 #pragma once
 #include "SimulationContext.h"
+#include "Beam.h"
+#include "GateGeometry.h"
 #include <rocky/vsg/ecs.h>
+#include <utility>
 
 
+//! The gate prefs fields the visualization uses.
+struct GatePrefsState
+{
+    enum : ChangeMask
+    {
+        AZIMUTH_OFFSET = 1u << 0,
+        ELEVATION_OFFSET = 1u << 1,
+        ROLL_OFFSET = 1u << 2,
+        DRAW_MODE = 1u << 3,
+        OFFSET = AZIMUTH_OFFSET | ELEVATION_OFFSET | ROLL_OFFSET
+    };
+
+    ChangeMask known = 0u;
+    FIELD_TYPE(simData::GatePrefs, gateazimuthoffset) gateazimuthoffset = {};
+    FIELD_TYPE(simData::GatePrefs, gateelevationoffset) gateelevationoffset = {};
+    FIELD_TYPE(simData::GatePrefs, gaterolloffset) gaterolloffset = {};
+    FIELD_TYPE(simData::GatePrefs, gatedrawmode) gatedrawmode = {};
+    CommonPrefsState commonprefs;
+
+    //! Fields of 'prefs' that differ from this state (not including common prefs)
+    ChangeMask diff(const simData::GatePrefs& prefs) const
+    {
+        ChangeMask changes = 0u;
+        DIFF_FIELD(gateazimuthoffset, prefs, *this, AZIMUTH_OFFSET, changes);
+        DIFF_FIELD(gateelevationoffset, prefs, *this, ELEVATION_OFFSET, changes);
+        DIFF_FIELD(gaterolloffset, prefs, *this, ROLL_OFFSET, changes);
+        DIFF_FIELD(gatedrawmode, prefs, *this, DRAW_MODE, changes);
+        return changes;
+    }
+
+    void store(const simData::GatePrefs& prefs, ChangeMask changes)
+    {
+        STORE_FIELD(gateazimuthoffset, prefs, *this, AZIMUTH_OFFSET, changes);
+        STORE_FIELD(gateelevationoffset, prefs, *this, ELEVATION_OFFSET, changes);
+        STORE_FIELD(gaterolloffset, prefs, *this, ROLL_OFFSET, changes);
+        STORE_FIELD(gatedrawmode, prefs, *this, DRAW_MODE, changes);
+        known |= changes;
+    }
+
+    //! Whether the gate is drawn from its host out to its max range rather
+    //! than between its min and max range
+    bool fromOrigin() const
+    {
+        return gatedrawmode == simData::GatePrefs::COVERAGE || gatedrawmode == simData::GatePrefs::SECTOR;
+    }
+};
+
+//! Hot gate state, updated every frame: plain data only, so views and update
+//! loops over gates don't drag the prefs through the cache.
 struct Gate
 {
-    simData::GateProperties props;
-    simData::GatePrefs prefs;
-    simData::GateUpdate update;
+    enum : ChangeMask
+    {
+        AZIMUTH = 1u << 0,
+        ELEVATION = 1u << 1,
+        WIDTH = 1u << 2,
+        HEIGHT = 1u << 3,
+        MIN_RANGE = 1u << 4,
+        MAX_RANGE = 1u << 5,
+        CENTROID = 1u << 6,
+        GEOMETRY = AZIMUTH | ELEVATION | WIDTH | HEIGHT | MIN_RANGE | MAX_RANGE
+    };
+
+    ChangeMask known = 0u;
+    double azimuth = 0.0;
+    double elevation = 0.0;
+    double width = 0.0;
+    double height = 0.0;
+    double minrange = 0.0;
+    double maxrange = 0.0;
+    double centroid = 0.0;
+
+    //! azimuth, elevation and roll offsets in radians, copied from prefs so
+    //! transform updates only read this component
+    vsg::dvec3 offset;
+
+    //! entity hosting this gate (normally a beam)
+    entt::entity host = entt::null;
+
+    ChangeMask diff(const simData::GateUpdate& update) const
+    {
+        ChangeMask changes = 0u;
+        DIFF_FIELD(azimuth, update, *this, AZIMUTH, changes);
+        DIFF_FIELD(elevation, update, *this, ELEVATION, changes);
+        DIFF_FIELD(width, update, *this, WIDTH, changes);
+        DIFF_FIELD(height, update, *this, HEIGHT, changes);
+        DIFF_FIELD(minrange, update, *this, MIN_RANGE, changes);
+        DIFF_FIELD(maxrange, update, *this, MAX_RANGE, changes);
+        DIFF_FIELD(centroid, update, *this, CENTROID, changes);
+        return changes;
+    }
+
+    void store(const simData::GateUpdate& update, ChangeMask changes)
+    {
+        STORE_FIELD(azimuth, update, *this, AZIMUTH, changes);
+        STORE_FIELD(elevation, update, *this, ELEVATION, changes);
+        STORE_FIELD(width, update, *this, WIDTH, changes);
+        STORE_FIELD(height, update, *this, HEIGHT, changes);
+        STORE_FIELD(minrange, update, *this, MIN_RANGE, changes);
+        STORE_FIELD(maxrange, update, *this, MAX_RANGE, changes);
+        STORE_FIELD(centroid, update, *this, CENTROID, changes);
+        known |= changes;
+    }
+
+    ChangeMask diff(const Gate& latest) const
+    {
+        ChangeMask changes = 0u;
+        DIFF_STATE(azimuth, latest, *this, AZIMUTH, changes);
+        DIFF_STATE(elevation, latest, *this, ELEVATION, changes);
+        DIFF_STATE(width, latest, *this, WIDTH, changes);
+        DIFF_STATE(height, latest, *this, HEIGHT, changes);
+        DIFF_STATE(minrange, latest, *this, MIN_RANGE, changes);
+        DIFF_STATE(maxrange, latest, *this, MAX_RANGE, changes);
+        DIFF_STATE(centroid, latest, *this, CENTROID, changes);
+        return changes;
+    }
+
+    void store(const Gate& latest, ChangeMask changes)
+    {
+        STORE_STATE(azimuth, latest, *this, AZIMUTH, changes);
+        STORE_STATE(elevation, latest, *this, ELEVATION, changes);
+        STORE_STATE(width, latest, *this, WIDTH, changes);
+        STORE_STATE(height, latest, *this, HEIGHT, changes);
+        STORE_STATE(minrange, latest, *this, MIN_RANGE, changes);
+        STORE_STATE(maxrange, latest, *this, MAX_RANGE, changes);
+        STORE_STATE(centroid, latest, *this, CENTROID, changes);
+        known |= changes;
+    }
+};
+
+//! Cold gate state, touched only when properties or prefs change.
+struct GateInfo
+{
+    simData::ObjectId id = 0;
+    simData::ObjectId hostid = 0;
+    GatePrefsState prefs;
 };
 
 
@@ -15,18 +149,23 @@ struct Gate
 class GateAdapter : public SimEntityAdapter
 {
 public:
-    const Gate* create(const simData::GateProperties* props, SimulationContext& sim, entt::registry& registry)
+    entt::entity create(const simData::GateProperties* props, SimulationContext& sim, entt::registry& registry)
     {
-        ROCKY_SOFT_ASSERT_AND_RETURN(props, nullptr);
-        ROCKY_SOFT_ASSERT_AND_RETURN(props->has_id(), nullptr);
+        ROCKY_SOFT_ASSERT_AND_RETURN(props, entt::null);
+        ROCKY_SOFT_ASSERT_AND_RETURN(props->has_id(), entt::null);
 
-        auto entt_id = sim.entities[props->id()] = registry.create();
-        auto& gate = registry.emplace<Gate>(entt_id);
+        auto entt_id = registry.create();
+        sim.entities.insert(props->id(), entt_id);
+        registry.emplace<Gate>(entt_id);
+        registry.emplace<GateInfo>(entt_id);
         // give it an empty transform so hosted objects can find it:
         registry.emplace<rocky::Transform>(entt_id);
 
+        // the outline is added once the gate is in view
+        sim.visuals.add(entt_id, registry);
+
         applyProps(props, sim, registry);
-        return &gate;
+        return entt_id;
     }
 
     void applyProps(const simData::GateProperties* new_props, SimulationContext& sim, entt::registry& registry)
@@ -34,17 +173,20 @@ public:
         ROCKY_SOFT_ASSERT_AND_RETURN(new_props, void());
 
         auto entt_id = sim.entities[new_props->id()];
-        auto& gate = registry.get<Gate>(entt_id);
+        ROCKY_SOFT_ASSERT_AND_RETURN(entt_id != entt::null, void());
+        auto& info = registry.get<GateInfo>(entt_id);
 
-        if (VALUE_CHANGED(hostid, *new_props, gate.props))
+        info.id = new_props->id();
+
+        if (new_props->has_hostid() && new_props->hostid() != info.hostid)
         {
-            ROCKY_SOFT_ASSERT_AND_RETURN(sim.entities.count(new_props->hostid()) > 0, void());
+            ROCKY_SOFT_ASSERT_AND_RETURN(sim.entities.contains(new_props->hostid()), void());
 
-            auto host_entt_id = sim.entities[new_props->hostid()];
-            auto& transform = registry.get<rocky::Transform>(entt_id);
+            info.hostid = new_props->hostid();
+            auto host = sim.entities[new_props->hostid()];
+            registry.get<Gate>(entt_id).host = host;
+            sim.hosts.attach(entt_id, host);
         }
-
-        gate.props = *new_props;
     }
 
     void applyPrefs(const simData::GatePrefs* new_prefs, const simData::ObjectId gate_id, SimulationContext& sim, entt::registry& registry)
@@ -52,32 +194,158 @@ public:
         ROCKY_SOFT_ASSERT_AND_RETURN(new_prefs, void());
 
         auto entt_id = sim.entities[gate_id];
-        auto& gate = registry.get<Gate>(entt_id);
+        ROCKY_SOFT_ASSERT_AND_RETURN(entt_id != entt::null, void());
+        auto& info = registry.get<GateInfo>(entt_id);
 
         // detect changes and apply new prefs.
-        makeGeometry(*new_prefs, gate.update);
+        auto changes = info.prefs.diff(*new_prefs);
+        info.prefs.store(*new_prefs, changes);
 
         if (new_prefs->has_commonprefs())
         {
-            applyCommonPrefs(&new_prefs->commonprefs(), gate.prefs.commonprefs(), entt_id, sim, registry);
+            applyCommonPrefs(&new_prefs->commonprefs(), info.prefs.commonprefs, entt_id, sim, registry);
+        }
+
+        if ((changes & GatePrefsState::DRAW_MODE) && Materializer::materialized(entt_id, registry))
+            queueGeometry(entt_id, registry);
+
+        if (changes & GatePrefsState::OFFSET)
+        {
+            registry.get<Gate>(entt_id).offset = vsg::dvec3(info.prefs.gateazimuthoffset, info.prefs.gateelevationoffset, info.prefs.gaterolloffset);
+            sim.hosts.markDirty(entt_id);
         }
+    }
+
+    //! Gives the gate its outline (built with the next applyGeometry()) and
+    //! label. Not thread safe.
+    void materialize(entt::entity entt_id, SimulationContext& sim, entt::registry& registry)
+    {
+        auto& line = sim.components.emplace<rocky::Line>(entt_id, registry);
+        line.topology = rocky::Line::Topology::Segments;
+        line.style.color = vsg::vec4{ 1, 0.5f, 0, 1 };
+        line.style.width = 2.0f;
 
-        gate.prefs = *new_prefs;
+        queueGeometry(entt_id, registry);
+        materializeLabel(registry.get<GateInfo>(entt_id).prefs.commonprefs, entt_id, sim, registry);
     }
 
-    void applyUpdate(const simData::GateUpdate* new_update, const simData::ObjectId gate_id, SimulationContext& sim, entt::registry& registry)
+    //! Takes the gate's outline and label away, keeping its data. Not thread
+    //! safe.
+    void dematerialize(entt::entity entt_id, SimulationContext& sim, entt::registry& registry)
+    {
+        releaseVisuals(entt_id, sim, registry);
+    }
+
+    //! Removes the gate. Not thread safe.
+    void destroy(entt::entity entt_id, SimulationContext& sim, entt::registry& registry)
+    {
+        destroyEntity(registry.get<GateInfo>(entt_id).id, entt_id, sim, registry);
+    }
+
+    //! Applies a time update to the gate's own components. Touches nothing
+    //! shared, so different gates can be updated concurrently.
+    //! @return the fields that changed; pass them to commitUpdate()
+    ChangeMask applyUpdate(const simData::GateUpdate* new_update, entt::entity entt_id, entt::registry& registry)
+    {
+        ROCKY_SOFT_ASSERT_AND_RETURN(new_update, 0u);
+        return applyLatest(*new_update, entt_id, registry);
+    }
+
+    //! Same as above, from the state read out of an update on another thread.
+    ChangeMask applyUpdate(const Gate& latest, entt::entity entt_id, entt::registry& registry)
+    {
+        return applyLatest(latest, entt_id, registry);
+    }
+
+    //! Records the effects of an applyUpdate() in shared state. Not thread safe.
+    void commitUpdate(entt::entity entt_id, ChangeMask changes, entt::registry& registry)
+    {
+        // gates out of view get their outline when they come into view
+        if ((changes & Gate::GEOMETRY) && Materializer::materialized(entt_id, registry))
+            queueGeometry(entt_id, registry);
+    }
+
+    //! Generates the outlines of every gate whose extents changed since the
+    //! last call, in one batch, and copies them into the gates' Lines. Chunks
+    //! of the batch run on 'pool' when there is one.
+    //! @return number of gates rebuilt
+    std::size_t applyGeometry(entt::registry& registry, WorkerPool* pool = nullptr)
+    {
+        auto count = batch.size();
+        if (count == 0)
+            return 0;
+
+        batch.reserve();
+
+        parallel_for(pool, count, 1024u, [&](std::size_t begin, std::size_t end)
+            {
+                batch.generate(begin, end);
+
+                for (auto i = begin; i < end; ++i)
+                {
+                    // the gate may have been removed or released since it was queued
+                    if (!registry.valid(batch.entity(i)) || !std::as_const(registry).all_of<rocky::Line>(batch.entity(i)))
+                        continue;
+                    auto& line = registry.get<rocky::Line>(batch.entity(i));
+                    auto* points = batch.points(i);
+                    line.points.assign(points, points + batch.count(i));
+                    line.dirty();
+                }
+            });
+
+        batch.clear();
+        return count;
+    }
+
+    //! Rebuilds the gate's transform from its host's and its offsets. Gate
+    //! angles are relative to the platform frame rather than the beam's
+    //! pointing direction, so a gate on a beam starts from the beam's
+    //! platform transform moved by the beam's position offset, without the
+    //! beam's pointing and range scale. Called host-first by HostGraph::propagate.
+    void updateTransform(entt::entity entt_id, entt::registry& registry) const
     {
-        auto entt_id = sim.entities[gate_id];
         auto& gate = registry.get<Gate>(entt_id);
-        
-        //TODO
+        if (gate.host == entt::null)
+            return;
 
-        gate.update = *new_update;
+        auto& transform = registry.get<rocky::Transform>(entt_id);
+        auto* beam = std::as_const(registry).try_get<Beam>(gate.host);
+        if (beam && beam->host != entt::null)
+        {
+            transform = registry.get<rocky::Transform>(beam->host);
+            transform.localMatrix = glm::translate(transform.localMatrix, glm::dvec3(beam->offset.x, beam->offset.y, beam->offset.z));
+        }
+        else
+        {
+            transform = registry.get<rocky::Transform>(gate.host);
+        }
+        auto rot = rocky::quaternion_from_euler_radians(gate.offset.y, gate.offset.z, gate.offset.x);
+        transform.localMatrix *= glm::mat4_cast(rot);
+        transform.dirty();
     }
 
+private:
+    GateGeometryBatch batch;
 
-    void makeGeometry(const simData::GatePrefs& prefs, const simData::GateUpdate& update) const
+    //! Queues the gate's outline for the next applyGeometry(), once its
+    //! extents are known. Coverage and sector gates are drawn from the host.
+    void queueGeometry(entt::entity entt_id, entt::registry& registry)
     {
-        //TODO
+        auto& gate = registry.get<Gate>(entt_id);
+        if (!(gate.known & Gate::GEOMETRY))
+            return;
+        auto& prefs = registry.get<GateInfo>(entt_id).prefs;
+        batch.add(entt_id, gate.azimuth, gate.elevation, gate.width, gate.height,
+            prefs.fromOrigin() ? 0.0 : gate.minrange, gate.maxrange);
+    }
+
+    template<class SOURCE>
+    ChangeMask applyLatest(const SOURCE& latest, entt::entity entt_id, entt::registry& registry)
+    {
+        auto& gate = registry.get<Gate>(entt_id);
+
+        auto changes = gate.diff(latest);
+        gate.store(latest, changes);
+        return changes;
     }
 };
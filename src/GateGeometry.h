@@ -0,0 +1,221 @@
+#pragma once
+#include <entt/entt.hpp>
+#include <vsg/maths/vec3.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+
+//! Builds range-gate outlines in batches.
+//!
+//! Gates are queued as they change, in structure-of-arrays form, and generate()
+//! then computes all of their outlines at once: one pass of branch-free loops
+//! over contiguous arrays (which the compiler can vectorize) followed by a single
+//! pass that writes line segments into one pooled vertex buffer. Nothing is
+//! allocated per gate, and the buffers keep their capacity from frame to frame.
+//!
+//! A gate is the wedge between its min and max range, spanning its width in
+//! azimuth and its height in elevation, centered on its azimuth and elevation.
+//! Its outline is the four azimuth arcs and four elevation arcs bounding the
+//! near and far faces, plus the four radial edges joining their corners. Each
+//! arc is split into segments of at most 'max_step' radians, so a wide gate or
+//! a 360 degree sector comes out round. Points are in the gate's frame: +X
+//! forward, +Y left, +Z up, with azimuth positive to the right.
+class GateGeometryBatch
+{
+public:
+    //! longest arc segment, in radians (5 degrees)
+    static constexpr double max_step = 0.08726646259971647;
+
+    //! Queues a gate; the angles are in radians. Widths beyond a full circle
+    //! (and heights beyond a half) are clamped. A gate already queued keeps
+    //! its place and takes the new extents, so each entity is in the batch
+    //! once and ranges of it can be generated and copied out concurrently.
+    void add(entt::entity entity, double azimuth, double elevation, double width, double height, double minrange, double maxrange)
+    {
+        auto [slot, added] = slots.emplace(entity, entities.size());
+        if (added)
+        {
+            entities.emplace_back(entity);
+            az.emplace_back(), el.emplace_back(), hw.emplace_back(), hh.emplace_back(), r0.emplace_back(), r1.emplace_back();
+        }
+
+        auto i = slot->second;
+        az[i] = azimuth;
+        el[i] = elevation;
+        hw[i] = std::min(std::abs(width), 2.0 * pi) * 0.5;
+        hh[i] = std::min(std::abs(height), pi) * 0.5;
+        r0[i] = minrange;
+        r1[i] = maxrange;
+    }
+
+    //! Number of queued gates
+    std::size_t size() const
+    {
+        return entities.size();
+    }
+
+    bool empty() const
+    {
+        return entities.empty();
+    }
+
+    //! Entity of queued gate i
+    entt::entity entity(std::size_t i) const
+    {
+        return entities[i];
+    }
+
+    //! First of the count(i) segment points of queued gate i. Valid after
+    //! generate() until the next clear().
+    const vsg::dvec3* points(std::size_t i) const
+    {
+        return vertices.data() + first[i];
+    }
+
+    //! Number of segment points of queued gate i, after reserve()
+    std::size_t count(std::size_t i) const
+    {
+        return first[i + 1u] - first[i];
+    }
+
+    //! Computes the outlines of all queued gates.
+    void generate()
+    {
+        reserve();
+        generate(0u, size());
+    }
+
+    //! Computes the segment counts and sizes the output buffers for the
+    //! queued gates. Call before generating ranges of the batch, possibly on
+    //! several threads.
+    void reserve()
+    {
+        const std::size_t n = size();
+        for (auto* column : { &cos_az, &sin_az, &cos_daz, &sin_daz, &cos_el, &sin_el, &cos_del, &sin_del })
+            column->resize(n);
+        az_steps.resize(n);
+        el_steps.resize(n);
+        first.resize(n + 1u);
+
+        first[0] = 0u;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            az_steps[i] = steps(2.0 * hw[i]);
+            el_steps[i] = steps(2.0 * hh[i]);
+            // 4 azimuth arcs, 4 elevation arcs and 4 radial edges, 2 points a segment
+            first[i + 1u] = first[i] + 8u * (az_steps[i] + el_steps[i] + 1u);
+        }
+        vertices.resize(first[n]);
+    }
+
+    //! Computes the outlines of queued gates [begin, end). Disjoint ranges
+    //! may be generated concurrently, after reserve().
+    void generate(std::size_t begin, std::size_t end)
+    {
+        const std::size_t n = end - begin;
+
+        // start angle and step of each arc
+        kernel(n, az.data() + begin, hw.data() + begin, az_steps.data() + begin,
+            cos_az.data() + begin, sin_az.data() + begin, cos_daz.data() + begin, sin_daz.data() + begin);
+        kernel(n, el.data() + begin, hh.data() + begin, el_steps.data() + begin,
+            cos_el.data() + begin, sin_el.data() + begin, cos_del.data() + begin, sin_del.data() + begin);
+
+        double ca[max_steps + 1u], sa[max_steps + 1u], ce[max_steps + 1u], se[max_steps + 1u];
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            // arc angles by rotation, from the start and the step
+            auto na = az_steps[i], ne = el_steps[i];
+            rotate(ca, sa, na, cos_az[i], sin_az[i], cos_daz[i], sin_daz[i]);
+            rotate(ce, se, ne, cos_el[i], sin_el[i], cos_del[i], sin_del[i]);
+
+            auto point = [&](double range, unsigned a, unsigned e)
+                {
+                    double horizontal = range * ce[e];
+                    return vsg::dvec3(horizontal * ca[a], -horizontal * sa[a], range * se[e]);
+                };
+
+            auto* out = vertices.data() + first[i];
+            for (double range : { r0[i], r1[i] })
+            {
+                for (unsigned e : { 0u, ne })
+                    for (unsigned a = 0; a < na; ++a)
+                        *out++ = point(range, a, e), *out++ = point(range, a + 1u, e);
+                for (unsigned a : { 0u, na })
+                    for (unsigned e = 0; e < ne; ++e)
+                        *out++ = point(range, a, e), *out++ = point(range, a, e + 1u);
+            }
+            for (unsigned a : { 0u, na })
+                for (unsigned e : { 0u, ne })
+                    *out++ = point(r0[i], a, e), *out++ = point(r1[i], a, e);
+        }
+    }
+
+    //! Empties the queue, keeping the buffers for reuse.
+    void clear()
+    {
+        entities.clear();
+        slots.clear();
+        az.clear(), el.clear(), hw.clear(), hh.clear(), r0.clear(), r1.clear();
+    }
+
+private:
+    static constexpr double pi = 3.14159265358979323846;
+
+    //! most segments in one arc (a full circle)
+    static constexpr unsigned max_steps = 72u;
+
+    // queued gates, and where each entity is in them
+    std::vector<entt::entity> entities;
+    std::unordered_map<entt::entity, std::size_t> slots;
+    std::vector<double> az, el, hw, hh, r0, r1;
+
+    // segments per azimuth and elevation arc, and each gate's first point
+    std::vector<unsigned> az_steps, el_steps;
+    std::vector<std::size_t> first;
+
+    // per-gate sines and cosines of the arcs' start and step
+    std::vector<double> cos_az, sin_az, cos_daz, sin_daz;
+    std::vector<double> cos_el, sin_el, cos_del, sin_del;
+
+    // pooled output
+    std::vector<vsg::dvec3> vertices;
+
+    static unsigned steps(double extent)
+    {
+        auto count = (unsigned)std::ceil(extent / max_step - 1e-9);
+        return std::min(std::max(count, 1u), max_steps);
+    }
+
+    // sin/cos of (center - half) and of the step, over contiguous arrays
+    static void kernel(std::size_t n,
+        const double* __restrict center, const double* __restrict half, const unsigned* __restrict steps,
+        double* __restrict cos0, double* __restrict sin0,
+        double* __restrict cosd, double* __restrict sind)
+    {
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            double a0 = center[i] - half[i];
+            double d = 2.0 * half[i] / (double)steps[i];
+            cos0[i] = std::cos(a0);
+            sin0[i] = std::sin(a0);
+            cosd[i] = std::cos(d);
+            sind[i] = std::sin(d);
+        }
+    }
+
+    // cosines and sines of 'count' + 1 evenly spaced angles
+    static void rotate(double* c, double* s, unsigned count, double c0, double s0, double cd, double sd)
+    {
+        c[0] = c0, s[0] = s0;
+        for (unsigned k = 0; k < count; ++k)
+        {
+            c[k + 1u] = c[k] * cd - s[k] * sd;
+            s[k + 1u] = s[k] * cd + c[k] * sd;
+        }
+    }
+};
@@ -0,0 +1,325 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define GEOBATCH_AVX2 1
+#define GEOBATCH_AVX2_TARGET __attribute__((target("avx2,fma")))
+#elif defined(_MSC_VER) && defined(__AVX2__)
+#include <immintrin.h>
+#define GEOBATCH_AVX2 1
+#define GEOBATCH_AVX2_TARGET
+#endif
+
+
+//! Batch coordinate conversions between geodetic (WGS84), ECEF and local
+//! east-north-up frames, over contiguous arrays.
+//!
+//! Geodetic coordinates are longitude and latitude in degrees and height above
+//! the ellipsoid in meters, as with rocky::SRS::WGS84. Outputs may alias inputs
+//! element for element, so arrays can be converted in place.
+//!
+//! The geodetic-to-ECEF and ENU conversions run four points at a time with
+//! AVX2 and FMA when the CPU has them (checked once at run time on GCC and
+//! Clang; with MSVC, when built with /arch:AVX2), using a Cephes-style
+//! polynomial sine and cosine; otherwise, or for the tail of an array, they
+//! fall back to scalar code. ECEF-to-geodetic is scalar.
+namespace GeoBatch
+{
+    // WGS84 ellipsoid
+    constexpr double semi_major = 6378137.0;
+    constexpr double flattening = 1.0 / 298.257223563;
+    constexpr double semi_minor = semi_major * (1.0 - flattening);
+    constexpr double e2 = flattening * (2.0 - flattening);
+    constexpr double deg2rad = 0.017453292519943295;
+    constexpr double rad2deg = 57.29577951308232;
+
+    namespace scalar
+    {
+        inline void geodeticToECEF(std::size_t n, const double* lon, const double* lat, const double* alt,
+            double* x, double* y, double* z)
+        {
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                double sin_lat = std::sin(lat[i] * deg2rad), cos_lat = std::cos(lat[i] * deg2rad);
+                double sin_lon = std::sin(lon[i] * deg2rad), cos_lon = std::cos(lon[i] * deg2rad);
+                double h = alt[i];
+                double N = semi_major / std::sqrt(1.0 - e2 * sin_lat * sin_lat);
+                x[i] = (N + h) * cos_lat * cos_lon;
+                y[i] = (N + h) * cos_lat * sin_lon;
+                z[i] = (N * (1.0 - e2) + h) * sin_lat;
+            }
+        }
+
+        inline void enuToECEF(std::size_t n, const double* lon, const double* lat,
+            const double* ox, const double* oy, const double* oz,
+            const double* east, const double* north, const double* up,
+            double* x, double* y, double* z)
+        {
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                double sin_lat = std::sin(lat[i] * deg2rad), cos_lat = std::cos(lat[i] * deg2rad);
+                double sin_lon = std::sin(lon[i] * deg2rad), cos_lon = std::cos(lon[i] * deg2rad);
+                double e = east[i], nn = north[i], u = up[i];
+                double t = cos_lat * u - sin_lat * nn;
+                double rx = ox[i] - sin_lon * e + cos_lon * t;
+                double ry = oy[i] + cos_lon * e + sin_lon * t;
+                double rz = oz[i] + cos_lat * nn + sin_lat * u;
+                x[i] = rx, y[i] = ry, z[i] = rz;
+            }
+        }
+
+        inline void ecefToENU(std::size_t n, const double* lon, const double* lat,
+            const double* ox, const double* oy, const double* oz,
+            const double* x, const double* y, const double* z,
+            double* east, double* north, double* up)
+        {
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                double sin_lat = std::sin(lat[i] * deg2rad), cos_lat = std::cos(lat[i] * deg2rad);
+                double sin_lon = std::sin(lon[i] * deg2rad), cos_lon = std::cos(lon[i] * deg2rad);
+                double dx = x[i] - ox[i], dy = y[i] - oy[i], dz = z[i] - oz[i];
+                double t = cos_lon * dx + sin_lon * dy;
+                east[i] = cos_lon * dy - sin_lon * dx;
+                north[i] = cos_lat * dz - sin_lat * t;
+                up[i] = cos_lat * t + sin_lat * dz;
+            }
+        }
+    }
+
+#ifdef GEOBATCH_AVX2
+    namespace avx2
+    {
+        //! sine and cosine of four angles (radians, |a| up to about 1e8),
+        //! after Cephes sin.c: reduce by multiples of pi/4 in three parts, then
+        //! evaluate both minimax polynomials and pick per octant.
+        GEOBATCH_AVX2_TARGET inline void sincos(__m256d a, __m256d& s, __m256d& c)
+        {
+            const __m256d sign_bit = _mm256_set1_pd(-0.0);
+            const __m256d one = _mm256_set1_pd(1.0);
+            const __m256d two = _mm256_set1_pd(2.0);
+
+            __m256d x = _mm256_andnot_pd(sign_bit, a);
+            __m256d sin_sign = _mm256_and_pd(a, sign_bit);
+
+            // octant, rounded up to even
+            __m256d j = _mm256_floor_pd(_mm256_mul_pd(x, _mm256_set1_pd(1.27323954473516268615)));
+            __m256d odd = _mm256_sub_pd(j, _mm256_mul_pd(two, _mm256_floor_pd(_mm256_mul_pd(j, _mm256_set1_pd(0.5)))));
+            j = _mm256_add_pd(j, odd);
+
+            // j mod 8, folded into [0, 4)
+            __m256d q = _mm256_sub_pd(j, _mm256_mul_pd(_mm256_set1_pd(8.0), _mm256_floor_pd(_mm256_mul_pd(j, _mm256_set1_pd(0.125)))));
+            __m256d upper = _mm256_cmp_pd(q, _mm256_set1_pd(3.0), _CMP_GT_OQ);
+            q = _mm256_sub_pd(q, _mm256_and_pd(upper, _mm256_set1_pd(4.0)));
+            __m256d swap = _mm256_cmp_pd(q, _mm256_set1_pd(1.0), _CMP_GT_OQ);
+
+            // extended precision reduction: z = x - j * pi/4
+            __m256d z = _mm256_fnmadd_pd(j, _mm256_set1_pd(7.85398125648498535156E-1), x);
+            z = _mm256_fnmadd_pd(j, _mm256_set1_pd(3.77489470793079817668E-8), z);
+            z = _mm256_fnmadd_pd(j, _mm256_set1_pd(2.69515142907905952645E-15), z);
+            __m256d zz = _mm256_mul_pd(z, z);
+
+            __m256d ps = _mm256_set1_pd(1.58962301576546568060E-10);
+            ps = _mm256_fmadd_pd(ps, zz, _mm256_set1_pd(-2.50507477628578072866E-8));
+            ps = _mm256_fmadd_pd(ps, zz, _mm256_set1_pd(2.75573136213857245213E-6));
+            ps = _mm256_fmadd_pd(ps, zz, _mm256_set1_pd(-1.98412698295895385996E-4));
+            ps = _mm256_fmadd_pd(ps, zz, _mm256_set1_pd(8.33333333332211858878E-3));
+            ps = _mm256_fmadd_pd(ps, zz, _mm256_set1_pd(-1.66666666666666307295E-1));
+            __m256d sin_poly = _mm256_fmadd_pd(_mm256_mul_pd(z, zz), ps, z);
+
+            __m256d pc = _mm256_set1_pd(-1.13585365213876817300E-11);
+            pc = _mm256_fmadd_pd(pc, zz, _mm256_set1_pd(2.08757008419747316778E-9));
+            pc = _mm256_fmadd_pd(pc, zz, _mm256_set1_pd(-2.75573141792967388112E-7));
+            pc = _mm256_fmadd_pd(pc, zz, _mm256_set1_pd(2.48015872888517045348E-5));
+            pc = _mm256_fmadd_pd(pc, zz, _mm256_set1_pd(-1.38888888888730564116E-3));
+            pc = _mm256_fmadd_pd(pc, zz, _mm256_set1_pd(4.16666666666665929218E-2));
+            __m256d cos_poly = _mm256_fmadd_pd(_mm256_mul_pd(zz, zz), pc, _mm256_fnmadd_pd(_mm256_set1_pd(0.5), zz, one));
+
+            sin_sign = _mm256_xor_pd(sin_sign, _mm256_and_pd(upper, sign_bit));
+            __m256d cos_sign = _mm256_and_pd(_mm256_xor_pd(upper, swap), sign_bit);
+
+            s = _mm256_xor_pd(_mm256_blendv_pd(sin_poly, cos_poly, swap), sin_sign);
+            c = _mm256_xor_pd(_mm256_blendv_pd(cos_poly, sin_poly, swap), cos_sign);
+        }
+
+        GEOBATCH_AVX2_TARGET inline void geodeticToECEF(std::size_t n, const double* lon, const double* lat, const double* alt,
+            double* x, double* y, double* z)
+        {
+            const __m256d to_rad = _mm256_set1_pd(deg2rad);
+            const __m256d one = _mm256_set1_pd(1.0);
+            const __m256d a = _mm256_set1_pd(semi_major);
+            const __m256d ecc2 = _mm256_set1_pd(e2);
+            const __m256d one_minus_e2 = _mm256_set1_pd(1.0 - e2);
+
+            std::size_t i = 0;
+            for (; i + 4u <= n; i += 4u)
+            {
+                __m256d sin_lat, cos_lat, sin_lon, cos_lon;
+                sincos(_mm256_mul_pd(_mm256_loadu_pd(lat + i), to_rad), sin_lat, cos_lat);
+                sincos(_mm256_mul_pd(_mm256_loadu_pd(lon + i), to_rad), sin_lon, cos_lon);
+                __m256d h = _mm256_loadu_pd(alt + i);
+
+                __m256d N = _mm256_div_pd(a, _mm256_sqrt_pd(_mm256_fnmadd_pd(_mm256_mul_pd(ecc2, sin_lat), sin_lat, one)));
+                __m256d r = _mm256_mul_pd(_mm256_add_pd(N, h), cos_lat);
+                _mm256_storeu_pd(x + i, _mm256_mul_pd(r, cos_lon));
+                _mm256_storeu_pd(y + i, _mm256_mul_pd(r, sin_lon));
+                _mm256_storeu_pd(z + i, _mm256_mul_pd(_mm256_fmadd_pd(N, one_minus_e2, h), sin_lat));
+            }
+            scalar::geodeticToECEF(n - i, lon + i, lat + i, alt + i, x + i, y + i, z + i);
+        }
+
+        GEOBATCH_AVX2_TARGET inline void enuToECEF(std::size_t n, const double* lon, const double* lat,
+            const double* ox, const double* oy, const double* oz,
+            const double* east, const double* north, const double* up,
+            double* x, double* y, double* z)
+        {
+            const __m256d to_rad = _mm256_set1_pd(deg2rad);
+
+            std::size_t i = 0;
+            for (; i + 4u <= n; i += 4u)
+            {
+                __m256d sin_lat, cos_lat, sin_lon, cos_lon;
+                sincos(_mm256_mul_pd(_mm256_loadu_pd(lat + i), to_rad), sin_lat, cos_lat);
+                sincos(_mm256_mul_pd(_mm256_loadu_pd(lon + i), to_rad), sin_lon, cos_lon);
+                __m256d e = _mm256_loadu_pd(east + i), nn = _mm256_loadu_pd(north + i), u = _mm256_loadu_pd(up + i);
+
+                __m256d t = _mm256_fmsub_pd(cos_lat, u, _mm256_mul_pd(sin_lat, nn));
+                __m256d rx = _mm256_fmadd_pd(cos_lon, t, _mm256_fnmadd_pd(sin_lon, e, _mm256_loadu_pd(ox + i)));
+                __m256d ry = _mm256_fmadd_pd(sin_lon, t, _mm256_fmadd_pd(cos_lon, e, _mm256_loadu_pd(oy + i)));
+                __m256d rz = _mm256_fmadd_pd(sin_lat, u, _mm256_fmadd_pd(cos_lat, nn, _mm256_loadu_pd(oz + i)));
+                _mm256_storeu_pd(x + i, rx);
+                _mm256_storeu_pd(y + i, ry);
+                _mm256_storeu_pd(z + i, rz);
+            }
+            scalar::enuToECEF(n - i, lon + i, lat + i, ox + i, oy + i, oz + i, east + i, north + i, up + i, x + i, y + i, z + i);
+        }
+
+        GEOBATCH_AVX2_TARGET inline void ecefToENU(std::size_t n, const double* lon, const double* lat,
+            const double* ox, const double* oy, const double* oz,
+            const double* x, const double* y, const double* z,
+            double* east, double* north, double* up)
+        {
+            const __m256d to_rad = _mm256_set1_pd(deg2rad);
+
+            std::size_t i = 0;
+            for (; i + 4u <= n; i += 4u)
+            {
+                __m256d sin_lat, cos_lat, sin_lon, cos_lon;
+                sincos(_mm256_mul_pd(_mm256_loadu_pd(lat + i), to_rad), sin_lat, cos_lat);
+                sincos(_mm256_mul_pd(_mm256_loadu_pd(lon + i), to_rad), sin_lon, cos_lon);
+                __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(ox + i));
+                __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(y + i), _mm256_loadu_pd(oy + i));
+                __m256d dz = _mm256_sub_pd(_mm256_loadu_pd(z + i), _mm256_loadu_pd(oz + i));
+
+                __m256d t = _mm256_fmadd_pd(cos_lon, dx, _mm256_mul_pd(sin_lon, dy));
+                _mm256_storeu_pd(east + i, _mm256_fmsub_pd(cos_lon, dy, _mm256_mul_pd(sin_lon, dx)));
+                _mm256_storeu_pd(north + i, _mm256_fmsub_pd(cos_lat, dz, _mm256_mul_pd(sin_lat, t)));
+                _mm256_storeu_pd(up + i, _mm256_fmadd_pd(cos_lat, t, _mm256_mul_pd(sin_lat, dz)));
+            }
+            scalar::ecefToENU(n - i, lon + i, lat + i, ox + i, oy + i, oz + i, x + i, y + i, z + i, east + i, north + i, up + i);
+        }
+    }
+#endif
+
+    //! Whether the vectorized kernels are used on this CPU
+    inline bool simd()
+    {
+#if defined(GEOBATCH_AVX2) && defined(__GNUC__)
+        static const bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        return supported;
+#elif defined(GEOBATCH_AVX2)
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    //! Converts geodetic coordinates (degrees, meters) to ECEF.
+    inline void geodeticToECEF(std::size_t n, const double* lon, const double* lat, const double* alt,
+        double* x, double* y, double* z)
+    {
+#ifdef GEOBATCH_AVX2
+        if (simd())
+            return avx2::geodeticToECEF(n, lon, lat, alt, x, y, z);
+#endif
+        scalar::geodeticToECEF(n, lon, lat, alt, x, y, z);
+    }
+
+    //! Converts offsets in the local east-north-up frames at geodetic
+    //! positions (lon, lat) with ECEF origins (ox, oy, oz) to ECEF.
+    inline void enuToECEF(std::size_t n, const double* lon, const double* lat,
+        const double* ox, const double* oy, const double* oz,
+        const double* east, const double* north, const double* up,
+        double* x, double* y, double* z)
+    {
+#ifdef GEOBATCH_AVX2
+        if (simd())
+            return avx2::enuToECEF(n, lon, lat, ox, oy, oz, east, north, up, x, y, z);
+#endif
+        scalar::enuToECEF(n, lon, lat, ox, oy, oz, east, north, up, x, y, z);
+    }
+
+    //! Converts ECEF points to offsets in the local east-north-up frames at
+    //! geodetic positions (lon, lat) with ECEF origins (ox, oy, oz).
+    inline void ecefToENU(std::size_t n, const double* lon, const double* lat,
+        const double* ox, const double* oy, const double* oz,
+        const double* x, const double* y, const double* z,
+        double* east, double* north, double* up)
+    {
+#ifdef GEOBATCH_AVX2
+        if (simd())
+            return avx2::ecefToENU(n, lon, lat, ox, oy, oz, x, y, z, east, north, up);
+#endif
+        scalar::ecefToENU(n, lon, lat, ox, oy, oz, x, y, z, east, north, up);
+    }
+
+    //! Converts ECEF to geodetic coordinates (degrees, meters), with
+    //! Heikkinen's closed form (no iteration, sub-millimeter accurate).
+    inline void ecefToGeodetic(std::size_t n, const double* x, const double* y, const double* z,
+        double* lon, double* lat, double* alt)
+    {
+        constexpr double a2 = semi_major * semi_major;
+        constexpr double b2 = semi_minor * semi_minor;
+        constexpr double ep2 = (a2 - b2) / b2;
+
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            double px = x[i], py = y[i], pz = z[i];
+            double p2 = px * px + py * py;
+            double p = std::sqrt(p2);
+            double longitude = std::atan2(py, px);
+            double latitude, height;
+
+            if (p < 1e-3)
+            {
+                // on the polar axis
+                latitude = pz >= 0.0 ? 1.5707963267948966 : -1.5707963267948966;
+                height = std::abs(pz) - semi_minor;
+            }
+            else
+            {
+                double z2 = pz * pz;
+                double F = 54.0 * b2 * z2;
+                double G = p2 + (1.0 - e2) * z2 - e2 * (a2 - b2);
+                double c = e2 * e2 * F * p2 / (G * G * G);
+                double s = std::cbrt(1.0 + c + std::sqrt(c * c + 2.0 * c));
+                double k = s + 1.0 + 1.0 / s;
+                double P = F / (3.0 * k * k * G * G);
+                double Q = std::sqrt(1.0 + 2.0 * e2 * e2 * P);
+                double r0 = -(P * e2 * p) / (1.0 + Q) +
+                    std::sqrt(0.5 * a2 * (1.0 + 1.0 / Q) - P * (1.0 - e2) * z2 / (Q * (1.0 + Q)) - 0.5 * P * p2);
+                double d = p - e2 * r0;
+                double U = std::sqrt(d * d + z2);
+                double V = std::sqrt(d * d + (1.0 - e2) * z2);
+                double z0 = b2 * pz / (semi_major * V);
+                height = U * (1.0 - b2 / (semi_major * V));
+                latitude = std::atan((pz + ep2 * z0) / p);
+            }
+
+            lon[i] = longitude * rad2deg;
+            lat[i] = latitude * rad2deg;
+            alt[i] = height;
+        }
+    }
+}
@@ -0,0 +1,212 @@
+#pragma once
+#include <entt/entt.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+
+//! Host hierarchy of simulation entities (platform -> beam -> gate).
+//!
+//! An entity whose placement changes is marked dirty along with everything it
+//! carries. Once per frame, propagate() visits the dirty entities host-first
+//! (in order of depth) so each one can rebuild its transform from an already
+//! up-to-date host. Entities in unchanged subtrees are never visited.
+class HostGraph
+{
+public:
+    //! Adds an entity to the graph, or moves it under a new host. Pass
+    //! entt::null as the host for a root (a platform).
+    void attach(entt::entity entity, entt::entity host)
+    {
+        bool added = !contains(entity);
+        auto& node = acquire(entity);
+        if (!added && node.host == host)
+            return;
+
+        if (node.host != entt::null)
+        {
+            unlink(node.host, entity);
+        }
+
+        node.host = host;
+        if (host != entt::null)
+        {
+            acquire(host).children.emplace_back(entity);
+        }
+
+        setDepth(entity, host != entt::null ? nodes[index(host)].depth + 1u : 0u);
+        markDirty(entity);
+    }
+
+    //! Removes an entity from the graph. Its hosted entities become roots.
+    void detach(entt::entity entity)
+    {
+        if (!contains(entity))
+            return;
+
+        auto& node = nodes[index(entity)];
+        if (node.host != entt::null)
+        {
+            unlink(node.host, entity);
+        }
+
+        for (auto child : node.children)
+        {
+            nodes[index(child)].host = entt::null;
+            setDepth(child, 0u);
+        }
+
+        node = Node();
+    }
+
+    bool contains(entt::entity entity) const
+    {
+        auto i = index(entity);
+        return i < nodes.size() && nodes[i].self == entity;
+    }
+
+    //! Host of an entity, or entt::null
+    entt::entity host(entt::entity entity) const
+    {
+        return contains(entity) ? nodes[index(entity)].host : entt::null;
+    }
+
+    //! Entities hosted directly by an entity
+    const std::vector<entt::entity>& children(entt::entity entity) const
+    {
+        static const std::vector<entt::entity> none;
+        return contains(entity) ? nodes[index(entity)].children : none;
+    }
+
+    //! Flags an entity, and everything it hosts, for recomputation.
+    void markDirty(entt::entity entity)
+    {
+        if (!contains(entity))
+            return;
+
+        auto& node = nodes[index(entity)];
+        if (node.dirty)
+            return; // its subtree is already marked
+
+        node.dirty = true;
+        enqueue(entity, node.depth);
+
+        for (auto child : node.children)
+            markDirty(child);
+    }
+
+    //! Calls func(entity) for every dirty entity, hosts before the entities
+    //! they carry, then clears the dirty flags.
+    //! @return number of entities visited
+    template<class FUNC>
+    std::size_t propagate(FUNC&& func)
+    {
+        return propagateByDepth([&](const std::vector<entt::entity>& entities)
+            {
+                for (auto entity : entities)
+                    func(entity);
+            });
+    }
+
+    //! Like propagate(), but calls func(entities) once per depth with all the
+    //! dirty entities at that depth. Their hosts are all at shallower depths,
+    //! so the entities of one call can be processed in parallel.
+    //! @return number of entities visited
+    template<class FUNC>
+    std::size_t propagateByDepth(FUNC&& func)
+    {
+        std::size_t count = 0;
+        for (std::uint32_t depth = 0; depth < (std::uint32_t)dirty.size(); ++depth)
+        {
+            // entries left behind by a depth change are skipped
+            level.clear();
+            for (auto entity : dirty[depth])
+            {
+                if (contains(entity) && nodes[index(entity)].dirty && nodes[index(entity)].depth == depth)
+                {
+                    nodes[index(entity)].dirty = false;
+                    level.emplace_back(entity);
+                }
+            }
+            dirty[depth].clear();
+
+            if (!level.empty())
+            {
+                func(static_cast<const std::vector<entt::entity>&>(level));
+                count += level.size();
+            }
+        }
+        return count;
+    }
+
+private:
+    struct Node
+    {
+        entt::entity self = entt::null;
+        entt::entity host = entt::null;
+        std::vector<entt::entity> children;
+        std::uint32_t depth = 0u;
+        bool dirty = false;
+    };
+
+    // indexed by entity slot, which entt keeps dense
+    std::vector<Node> nodes;
+
+    // dirty entities, bucketed by depth
+    std::vector<std::vector<entt::entity>> dirty;
+
+    // entities being visited at one depth
+    std::vector<entt::entity> level;
+
+    static std::size_t index(entt::entity entity)
+    {
+        return (std::size_t)entt::to_entity(entity);
+    }
+
+    Node& acquire(entt::entity entity)
+    {
+        auto i = index(entity);
+        if (i >= nodes.size())
+            nodes.resize(i + 1u);
+        if (nodes[i].self != entity)
+        {
+            nodes[i] = Node();
+            nodes[i].self = entity;
+        }
+        return nodes[i];
+    }
+
+    void unlink(entt::entity host, entt::entity child)
+    {
+        if (!contains(host))
+            return;
+        auto& siblings = nodes[index(host)].children;
+        auto i = std::find(siblings.begin(), siblings.end(), child);
+        if (i != siblings.end())
+        {
+            *i = siblings.back();
+            siblings.pop_back();
+        }
+    }
+
+    void enqueue(entt::entity entity, std::uint32_t depth)
+    {
+        if (dirty.size() <= depth)
+            dirty.resize(depth + 1u);
+        dirty[depth].emplace_back(entity);
+    }
+
+    void setDepth(entt::entity entity, std::uint32_t depth)
+    {
+        auto& node = nodes[index(entity)];
+        if (node.depth != depth)
+        {
+            node.depth = depth;
+            if (node.dirty)
+                enqueue(entity, depth);
+        }
+        for (auto child : node.children)
+            setDepth(child, depth + 1u);
+    }
+};
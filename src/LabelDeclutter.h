@@ -0,0 +1,274 @@
+#pragma once
+#include <rocky/vsg/ecs.h>
+#include <entt/entt.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+//! Declutter state of a labeled entity.
+struct DeclutterLabel
+{
+    //! labels with a higher priority win overlaps
+    double priority = 0.0;
+
+    //! hidden by the last declutter pass
+    bool hidden = false;
+
+    //! the label's text while it is hidden
+    std::string text;
+};
+
+
+//! Hides labels that would overlap a label of higher priority on screen.
+//!
+//! Once per frame, apply() projects the anchor of every label with a
+//! DeclutterLabel, estimates its screen rectangle from its text length, font
+//! size and alignment, and bins it into a uniform screen-space grid. Labels
+//! are placed in order of priority, then labels shown in the last pass, then
+//! nearest first; a label that overlaps one already placed is hidden. Keeping
+//! last pass's winners ahead of equal-priority newcomers stops labels of
+//! equal priority flickering as they move.
+//!
+//! A hidden label's text moves into its DeclutterLabel and the Label is left
+//! empty, so it costs no glyph layout or upload until it is shown again. Only
+//! labels whose state changes are dirtied. Labels whose anchor is behind the
+//! camera or off screen take no part and keep their state.
+class LabelDeclutter
+{
+public:
+    LabelDeclutter(double cell_pixels_ = 64.0) :
+        cell_pixels(cell_pixels_)
+    {
+        //nop
+    }
+
+    //! Extra space kept around each label, in pixels
+    double padding = 2.0;
+
+    //! Declutters the labels for one view. 'view_projection' maps ECEF to
+    //! clip space (projection * view); width and height are the viewport size
+    //! in pixels. Call with the registry locked for writing.
+    void apply(entt::registry& registry, const vsg::dmat4& view_projection, double width, double height)
+    {
+        collect(registry, view_projection, width, height);
+        sortOrder();
+
+        resetGrid(width, height);
+        shown_count = hidden_count = changed_count = 0u;
+
+        for (auto& entry : order)
+        {
+            auto& candidate = candidates[entry.index];
+            bool show = place(entry.rect);
+            show ? ++shown_count : ++hidden_count;
+            if (show != candidate.was_shown)
+            {
+                setHidden(registry, candidate.entity, !show);
+                ++changed_count;
+            }
+        }
+    }
+
+    //! Shows every hidden label, e.g. when decluttering is turned off.
+    void showAll(entt::registry& registry)
+    {
+        for (auto [entity, label, state] : registry.view<rocky::Label, DeclutterLabel>().each())
+        {
+            if (state.hidden)
+                setHidden(registry, entity, false);
+        }
+        hidden_count = 0u;
+    }
+
+    //! Labels shown and hidden by the last apply(), not counting those off
+    //! screen, and how many of them it switched
+    std::size_t shown() const { return shown_count; }
+    std::size_t hidden() const { return hidden_count; }
+    std::size_t changed() const { return changed_count; }
+
+private:
+    struct Rect
+    {
+        float x0, y0, x1, y1;   // pixels
+    };
+
+    struct Candidate
+    {
+        entt::entity entity;
+        bool was_shown;
+    };
+
+    //! A key that sorts in placement order, with the candidate's rectangle
+    //! carried along so placement reads the order sequentially
+    struct Order
+    {
+        std::uint64_t key;
+        Rect rect;
+        std::uint32_t index;    // into candidates
+    };
+
+    double cell_pixels;
+    std::vector<Candidate> candidates;
+    std::vector<Order> order, order_scratch;
+    std::vector<std::vector<Rect>> cells;   // placed rectangles touching each cell
+    int columns = 0, rows = 0;
+    std::size_t shown_count = 0u, hidden_count = 0u, changed_count = 0u;
+
+    void collect(entt::registry& registry, const vsg::dmat4& m, double width, double height)
+    {
+        candidates.clear();
+        order.clear();
+        for (auto [entity, label, state, transform] : registry.view<rocky::Label, DeclutterLabel, rocky::Transform>().each())
+        {
+            auto& text = state.hidden ? state.text : label.text;
+            if (text.empty())
+                continue;
+
+            // to clip space; vsg matrices are column major (m[column][row])
+            auto& p = transform.position;
+            auto w = m[0][3] * p.x + m[1][3] * p.y + m[2][3] * p.z + m[3][3];
+            if (w <= 0.0)
+                continue;
+            auto ndc_x = (m[0][0] * p.x + m[1][0] * p.y + m[2][0] * p.z + m[3][0]) / w;
+            auto ndc_y = (m[0][1] * p.x + m[1][1] * p.y + m[2][1] * p.z + m[3][1]) / w;
+
+            // estimated text extent: glyphs average about 0.6 em wide
+            auto size = label.style.pointSize > 0.0f ? (double)label.style.pointSize : 12.0;
+            auto text_width = 0.6 * size * (double)text.size() + 2.0 * padding;
+            auto text_height = 1.2 * size + 2.0 * padding;
+
+            auto x = 0.5 * (ndc_x + 1.0) * width;
+            auto y = 0.5 * (1.0 - ndc_y) * height;
+            auto x0 = x - 0.5 * text_width, y0 = y - 0.5 * text_height;
+            switch (label.style.horizontalAlignment)
+            {
+            case vsg::StandardLayout::LEFT_ALIGNMENT: x0 = x; break;
+            case vsg::StandardLayout::RIGHT_ALIGNMENT: x0 = x - text_width; break;
+            default: break;
+            }
+            switch (label.style.verticalAlignment)
+            {
+            case vsg::StandardLayout::TOP_ALIGNMENT: y0 = y; break;
+            case vsg::StandardLayout::BOTTOM_ALIGNMENT: y0 = y - text_height; break;
+            default: break;
+            }
+
+            if (x0 + text_width < 0.0 || y0 + text_height < 0.0 || x0 >= width || y0 >= height)
+                continue;
+
+            // w is the distance along the view direction
+            Rect rect = { (float)x0, (float)y0, (float)(x0 + text_width), (float)(y0 + text_height) };
+            order.push_back({ sortKey(state.priority, !state.hidden, w), rect, (std::uint32_t)candidates.size() });
+            candidates.push_back({ entity, !state.hidden });
+        }
+    }
+
+    //! Priority descending, then shown before hidden, then distance ascending,
+    //! packed so that the keys sort in ascending order.
+    static std::uint64_t sortKey(double priority, bool was_shown, double distance)
+    {
+        // order-preserving unsigned bits of a float
+        auto ordered = [](float value)
+            {
+                std::uint32_t bits;
+                std::memcpy(&bits, &value, sizeof(bits));
+                return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+            };
+        // distance to about 1%: sign, exponent and 7 bits of mantissa, so
+        // the sort has fewer distinct bytes to pass over
+        std::uint64_t high = ~ordered((float)priority);
+        std::uint64_t low = (was_shown ? 0u : 0x10000u) | (ordered((float)distance) >> 16);
+        return (high << 32) | low;
+    }
+
+    //! Stable LSD radix sort of the placement order, a byte at a time. All
+    //! eight histograms are counted in one pass, and bytes that every key
+    //! shares (most of the priority bits, usually) are skipped.
+    void sortOrder()
+    {
+        if (order.size() < 2u)
+            return;
+
+        std::size_t offsets[8][256] = {};
+        for (auto& entry : order)
+            for (unsigned byte = 0u; byte < 8u; ++byte)
+                ++offsets[byte][(entry.key >> (8u * byte)) & 0xffu];
+
+        order_scratch.resize(order.size());
+        for (unsigned byte = 0u; byte < 8u; ++byte)
+        {
+            auto shift = 8u * byte;
+            auto& offset = offsets[byte];
+            if (offset[(order.front().key >> shift) & 0xffu] == order.size())
+                continue;
+
+            std::size_t sum = 0u;
+            for (auto& value : offset)
+            {
+                auto count = value;
+                value = sum;
+                sum += count;
+            }
+            for (auto& entry : order)
+                order_scratch[offset[(entry.key >> shift) & 0xffu]++] = entry;
+            order.swap(order_scratch);
+        }
+    }
+
+    void resetGrid(double width, double height)
+    {
+        columns = std::max(1, (int)std::ceil(width / cell_pixels));
+        rows = std::max(1, (int)std::ceil(height / cell_pixels));
+        if (cells.size() < (std::size_t)(columns * rows))
+            cells.resize((std::size_t)(columns * rows));
+        for (auto& cell : cells)
+            cell.clear();
+    }
+
+    //! Places a label unless it overlaps one already placed.
+    bool place(const Rect& rect)
+    {
+        auto column = [this](float x) { return std::clamp((int)(x / cell_pixels), 0, columns - 1); };
+        auto row = [this](float y) { return std::clamp((int)(y / cell_pixels), 0, rows - 1); };
+        int c0 = column(rect.x0), c1 = column(rect.x1);
+        int r0 = row(rect.y0), r1 = row(rect.y1);
+
+        for (int r = r0; r <= r1; ++r)
+        {
+            for (int c = c0; c <= c1; ++c)
+            {
+                for (auto& other : cells[(std::size_t)(r * columns + c)])
+                {
+                    if (rect.x0 < other.x1 && other.x0 < rect.x1 && rect.y0 < other.y1 && other.y0 < rect.y1)
+                        return false;
+                }
+            }
+        }
+
+        for (int r = r0; r <= r1; ++r)
+            for (int c = c0; c <= c1; ++c)
+                cells[(std::size_t)(r * columns + c)].push_back(rect);
+        return true;
+    }
+
+    static void setHidden(entt::registry& registry, entt::entity entity, bool hide)
+    {
+        auto& label = registry.get<rocky::Label>(entity);
+        auto& state = registry.get<DeclutterLabel>(entity);
+        if (state.hidden == hide)
+            return;
+
+        // hidden labels stay empty, so they get no text layout
+        if (hide)
+            state.text.swap(label.text), label.text.clear();
+        else
+            label.text.swap(state.text), state.text.clear();
+        state.hidden = hide;
+        label.dirty();
+    }
+};
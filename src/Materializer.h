@@ -0,0 +1,221 @@
+#pragma once
+#include "HostGraph.h"
+#include "SpatialIndex.h"
+#include <rocky/vsg/ecs.h>
+#include <entt/entt.hpp>
+
+#include <cstdint>
+#include <vector>
+
+
+//! Whether an entity should be drawn, and whether it carries its visual
+//! components (Line, Mesh, Label, Icon) right now.
+struct VisualState
+{
+    //! the entity's own draw pref; hosted entities are also hidden with
+    //! their host
+    bool drawable = true;
+
+    //! whether the visual components exist
+    bool materialized = false;
+
+    //! when the entity was last drawable and in view, in seconds
+    double wanted_time = 0.0;
+
+    //! index in the materialized list
+    std::uint32_t slot = 0u;
+};
+
+
+//! Decides which entities carry visual components.
+//!
+//! Every entity keeps its data state (hot components, prefs state, transform)
+//! current, but only gets its Line, Mesh, Label and Icon once it is drawable
+//! and in view. Once per frame, apply() finds the platforms in the view
+//! through the spatial index (so the cost follows what is in view, not the
+//! scenario size) and materializes them and the beams and gates they host.
+//! An entity whose draw pref (or its host's) is turned off is released at
+//! once; one that leaves the view is released after 'idle_seconds', so the
+//! camera moving back and forth doesn't rebuild the same components.
+//!
+//! Without a view, every drawable entity is materialized and none are
+//! released for being out of view. Beams and gates are culled with their
+//! host platform, so a long beam from a platform well off screen may not
+//! show; 'view_margin' widens the view to allow for that.
+class Materializer
+{
+public:
+    //! Seconds an entity out of view keeps its visual components
+    double idle_seconds = 5.0;
+
+    //! Extent of the culling volume, as a multiple of the view's
+    double view_margin = 1.5;
+
+    //! Starts tracking a new entity, which is drawable until its prefs say
+    //! otherwise. Call after creating it.
+    void add(entt::entity entity, entt::registry& registry)
+    {
+        registry.emplace<VisualState>(entity);
+        changed.emplace_back(entity);
+    }
+
+    //! Stops tracking an entity about to be destroyed.
+    void erase(entt::entity entity, entt::registry& registry)
+    {
+        auto* state = registry.try_get<VisualState>(entity);
+        if (state && state->materialized)
+            unlist(*state, registry);
+    }
+
+    //! Records an entity's draw pref; takes effect at the next apply().
+    void setDrawable(entt::entity entity, bool drawable, entt::registry& registry)
+    {
+        auto& state = registry.get<VisualState>(entity);
+        if (state.drawable != drawable)
+        {
+            state.drawable = drawable;
+            changed.emplace_back(entity);
+        }
+    }
+
+    //! Whether an entity carries its visual components
+    static bool materialized(entt::entity entity, const entt::registry& registry)
+    {
+        auto* state = registry.try_get<VisualState>(entity);
+        return state && state->materialized;
+    }
+
+    //! Materializes what is drawable and in view with build(entity), and
+    //! releases what is not drawable, or has been out of view for
+    //! 'idle_seconds', with release(entity). 'view_projection' maps ECEF to
+    //! clip space, or is null when there is no view; 'now' is in seconds.
+    //! Call once per frame with the registry locked for writing, after the
+    //! spatial index is applied.
+    template<class BUILD, class RELEASE>
+    void apply(entt::registry& registry, const HostGraph& hosts, const SpatialIndex& spatial,
+        const vsg::dmat4* view_projection, double now, BUILD&& build, RELEASE&& release)
+    {
+        built_count = released_count = 0u;
+
+        auto want = [&](entt::entity entity)
+            {
+                if (!drawable(entity, registry, hosts))
+                    return;
+                auto& state = registry.get<VisualState>(entity);
+                state.wanted_time = now;
+                if (!state.materialized)
+                {
+                    build(entity);
+                    state.materialized = true;
+                    state.slot = (std::uint32_t)shown.size();
+                    shown.emplace_back(entity);
+                    ++built_count;
+                }
+            };
+
+        // draw pref changes and new entities; a host's change carries down
+        // to what it hosts
+        for (auto entity : changed)
+        {
+            if (!registry.valid(entity))
+                continue;
+            visit(entity, hosts, [&](entt::entity e)
+                {
+                    if (!drawable(e, registry, hosts))
+                        drop(e, registry, release);
+                    else if (!view_projection)
+                        want(e);
+                });
+        }
+        changed.clear();
+
+        if (!view_projection)
+            return;
+
+        spatial.frustum(planes(*view_projection), hits);
+        for (auto& hit : hits)
+        {
+            if (registry.valid(hit.entity))
+                visit(hit.entity, hosts, want);
+        }
+
+        // out of view for too long
+        for (std::size_t i = 0; i < shown.size(); )
+        {
+            auto entity = shown[i];
+            if (now - registry.get<VisualState>(entity).wanted_time > idle_seconds)
+                drop(entity, registry, release);
+            else
+                ++i;
+        }
+    }
+
+    //! Entities carrying their visual components
+    std::size_t size() const { return shown.size(); }
+
+    //! Entities materialized and released by the last apply()
+    std::size_t built() const { return built_count; }
+    std::size_t released() const { return released_count; }
+
+private:
+    std::vector<entt::entity> shown;
+    std::vector<entt::entity> changed;
+    std::vector<SpatialIndex::Hit> hits;
+    std::size_t built_count = 0u, released_count = 0u;
+
+    //! Drawable itself and all the way up its hosts
+    static bool drawable(entt::entity entity, const entt::registry& registry, const HostGraph& hosts)
+    {
+        for (; entity != entt::null; entity = hosts.host(entity))
+        {
+            auto* state = registry.try_get<VisualState>(entity);
+            if (state && !state->drawable)
+                return false;
+        }
+        return true;
+    }
+
+    //! Calls func on an entity and everything it hosts
+    template<class FUNC>
+    static void visit(entt::entity entity, const HostGraph& hosts, FUNC&& func)
+    {
+        func(entity);
+        for (auto child : hosts.children(entity))
+            visit(child, hosts, func);
+    }
+
+    template<class RELEASE>
+    void drop(entt::entity entity, entt::registry& registry, RELEASE&& release)
+    {
+        auto& state = registry.get<VisualState>(entity);
+        if (!state.materialized)
+            return;
+        release(entity);
+        unlist(state, registry);
+        ++released_count;
+    }
+
+    void unlist(VisualState& state, entt::registry& registry)
+    {
+        auto last = shown.back();
+        shown[state.slot] = last;
+        registry.get<VisualState>(last).slot = state.slot;
+        shown.pop_back();
+        state.materialized = false;
+    }
+
+    //! Side planes of the view volume widened by 'view_margin', and the plane
+    //! through the eye, in the SpatialIndex form; vsg matrices are column
+    //! major (m[column][row])
+    std::vector<SpatialIndex::Plane> planes(const vsg::dmat4& m) const
+    {
+        // k * w + sign * (row r of m) >= 0
+        auto side = [&](int r, double sign)
+            {
+                auto k = view_margin;
+                return SpatialIndex::Plane(k * m[0][3] + sign * m[0][r], k * m[1][3] + sign * m[1][r],
+                    k * m[2][3] + sign * m[2][r], k * m[3][3] + sign * m[3][r]);
+            };
+        return { SpatialIndex::Plane(m[0][3], m[1][3], m[2][3], m[3][3]), side(0, 1.0), side(0, -1.0), side(1, 1.0), side(1, -1.0) };
+    }
+};
@@ -1,12 +1,133 @@
 #pragma once
 #include "SimulationContext.h"
 #include <rocky/vsg/ecs.h>
+#include <unordered_set>
+#include <utility>
 
+//! The platform prefs fields the visualization uses.
+struct PlatformPrefsState
+{
+    enum : ChangeMask
+    {
+        ICON = 1u << 0,
+        SCALE = 1u << 1,
+        TRACK_MODE = 1u << 2,
+        TRACK_LENGTH = 1u << 3,
+        TRACK_STYLE = 1u << 4,
+        TRACK = TRACK_MODE | TRACK_LENGTH | TRACK_STYLE
+    };
+
+    ChangeMask known = 0u;
+    std::string icon;
+    FIELD_TYPE(simData::PlatformPrefs, scale) scale = {};
+    FIELD_TYPE(simData::TrackPrefs, trackdrawmode) trackdrawmode = {};
+    FIELD_TYPE(simData::TrackPrefs, tracklength) tracklength = {};
+    FIELD_TYPE(simData::TrackPrefs, trackcolor) trackcolor = {};
+    FIELD_TYPE(simData::TrackPrefs, linewidth) linewidth = {};
+    CommonPrefsState commonprefs;
+
+    //! Fields of 'prefs' that differ from this state (not including common prefs)
+    ChangeMask diff(const simData::PlatformPrefs& prefs) const
+    {
+        ChangeMask changes = 0u;
+        DIFF_FIELD(icon, prefs, *this, ICON, changes);
+        DIFF_FIELD(scale, prefs, *this, SCALE, changes);
+        if (prefs.has_trackprefs())
+        {
+            auto& track = prefs.trackprefs();
+            DIFF_FIELD(trackdrawmode, track, *this, TRACK_MODE, changes);
+            DIFF_FIELD(tracklength, track, *this, TRACK_LENGTH, changes);
+            DIFF_FIELD(trackcolor, track, *this, TRACK_STYLE, changes);
+            DIFF_FIELD(linewidth, track, *this, TRACK_STYLE, changes);
+        }
+        return changes;
+    }
+
+    void store(const simData::PlatformPrefs& prefs, ChangeMask changes)
+    {
+        STORE_FIELD(icon, prefs, *this, ICON, changes);
+        STORE_FIELD(scale, prefs, *this, SCALE, changes);
+        if (changes & TRACK)
+        {
+            auto& track = prefs.trackprefs();
+            STORE_FIELD(trackdrawmode, track, *this, TRACK_MODE, changes);
+            STORE_FIELD(tracklength, track, *this, TRACK_LENGTH, changes);
+            if (changes & TRACK_STYLE)
+            {
+                // either style field may be the one that changed
+                if (track.has_trackcolor()) trackcolor = track.trackcolor();
+                if (track.has_linewidth()) linewidth = track.linewidth();
+            }
+        }
+        known |= changes;
+    }
+};
+
+//! Hot platform state, updated every frame: plain data only, so views and update
+//! loops over platforms don't drag the prefs through the cache.
 struct Platform
 {
-    simData::PlatformProperties props;
-    simData::PlatformPrefs prefs;
-    simData::PlatformUpdate update;
+    enum : ChangeMask
+    {
+        POSITION = 1u << 0
+    };
+
+    ChangeMask known = 0u;
+    double x = 0.0, y = 0.0, z = 0.0;
+    double time = 0.0;      // of the position
+
+    ChangeMask diff(const simData::PlatformUpdate& update) const
+    {
+        ChangeMask changes = 0u;
+        DIFF_FIELD(x, update, *this, POSITION, changes);
+        DIFF_FIELD(y, update, *this, POSITION, changes);
+        DIFF_FIELD(z, update, *this, POSITION, changes);
+        return changes;
+    }
+
+    void store(const simData::PlatformUpdate& update, ChangeMask changes)
+    {
+        if (changes & POSITION)
+        {
+            x = update.x(), y = update.y(), z = update.z();
+            time = update.time();
+        }
+        known |= changes;
+    }
+
+    ChangeMask diff(const Platform& latest) const
+    {
+        ChangeMask changes = 0u;
+        DIFF_STATE(x, latest, *this, POSITION, changes);
+        DIFF_STATE(y, latest, *this, POSITION, changes);
+        DIFF_STATE(z, latest, *this, POSITION, changes);
+        return changes;
+    }
+
+    void store(const Platform& latest, ChangeMask changes)
+    {
+        if (changes & POSITION)
+        {
+            x = latest.x, y = latest.y, z = latest.z;
+            time = latest.time;
+        }
+        known |= changes;
+    }
+};
+
+//! Cold platform state, touched only when properties or prefs change.
+struct PlatformInfo
+{
+    simData::ObjectId id = 0;
+    PlatformPrefsState prefs;
+};
+
+
+//! How many icons reference how many distinct images.
+struct IconStats
+{
+    std::size_t references = 0;
+    std::size_t unique_images = 0;
 };
 
 
@@ -14,17 +135,21 @@ struct Platform
 class PlatformAdapter : public SimEntityAdapter
 {
 public:
-    const Platform* create(const simData::PlatformProperties* props, SimulationContext& sim, entt::registry& registry)
+    entt::entity create(const simData::PlatformProperties* props, SimulationContext& sim, entt::registry& registry)
     {
-        ROCKY_SOFT_ASSERT_AND_RETURN(props, nullptr);
-        ROCKY_SOFT_ASSERT_AND_RETURN(props->has_id(), nullptr);
+        ROCKY_SOFT_ASSERT_AND_RETURN(props, entt::null);
+        ROCKY_SOFT_ASSERT_AND_RETURN(props->has_id(), entt::null);
 
         sim.log->info("Add platform with id=" + std::to_string(props->id()));
-        auto entt_id = sim.entities[props->id()] = registry.create();
-        auto& platform = registry.emplace<Platform>(entt_id);
+        auto entt_id = registry.create();
+        sim.entities.insert(props->id(), entt_id);
+        registry.emplace<Platform>(entt_id);
+        registry.emplace<PlatformInfo>(entt_id);
         registry.emplace<rocky::Transform>(entt_id);
+        sim.hosts.attach(entt_id, entt::null);
+        sim.visuals.add(entt_id, registry);
         applyProps(props, sim, registry);
-        return &platform;
+        return entt_id;
     }
 
     void applyProps(const simData::PlatformProperties* new_props, SimulationContext& sim, entt::registry& registry)
@@ -33,9 +158,10 @@ public:
         ROCKY_SOFT_ASSERT_AND_RETURN(new_props->has_id(), void());
 
         auto entt_id = sim.entities[new_props->id()];
-        auto& platform = registry.emplace<Platform>(entt_id);
+        ROCKY_SOFT_ASSERT_AND_RETURN(entt_id != entt::null, void());
+        auto& info = registry.get<PlatformInfo>(entt_id);
 
-        platform.props = *new_props;
+        info.id = new_props->id();
     }
 
     void applyPrefs(const simData::PlatformPrefs* new_prefs, const simData::ObjectId id, SimulationContext& sim, entt::registry& registry)
@@ -43,58 +169,200 @@ public:
         ROCKY_SOFT_ASSERT_AND_RETURN(new_prefs != nullptr, void());
 
         auto entt_id = sim.entities[id];
-        auto& platform = registry.get<Platform>(entt_id);
+        ROCKY_SOFT_ASSERT_AND_RETURN(entt_id != entt::null, void());
+        auto& info = registry.get<PlatformInfo>(entt_id);
+
+        auto changes = info.prefs.diff(*new_prefs);
 
-        if (VALUE_CHANGED(icon, *new_prefs, platform.prefs))
+        // store first, so the icon size below sees the new scale
+        info.prefs.store(*new_prefs, changes);
+
+        if (Materializer::materialized(entt_id, registry))
         {
-            auto& icon = registry.get_or_emplace<rocky::Icon>(entt_id);
+            applyIcon(info.prefs, changes, entt_id, sim, registry);
+        }
 
-            auto io = sim.runtime->io;
-            auto image = io.services.readImageFromURI(new_prefs->icon(), io);
-            if (image.status.ok())
-            {
-                icon.image = image.value;
-            }
-            else
-            {
-                sim.log->warn("Icon \"" + new_prefs->icon() + "\" cannot load: " + image.status.toString());
-                icon.image = createMissingImage();
-            }
-            icon.dirty();
+        if (new_prefs->has_commonprefs())
+        {
+            applyCommonPrefs(&new_prefs->commonprefs(), info.prefs.commonprefs, entt_id, sim, registry);
         }
 
-        if (VALUE_CHANGED(scale, *new_prefs, platform.prefs))
+        if (changes & PlatformPrefsState::TRACK)
         {
-            auto& icon = registry.get_or_emplace<rocky::Icon>(entt_id);
-            if (icon.image && icon.image->valid())
-            {
-                icon.style.size_pixels = icon.image->width() * new_prefs->scale();
-            }
-            platform.prefs.set_scale(new_prefs->scale());
+            applyTrackPrefs(info.prefs, entt_id, sim, registry);
         }
+    }
 
-        if (new_prefs->has_commonprefs())
+    //! Gives the platform its icon, label and track line, from the stored
+    //! prefs. Not thread safe.
+    void materialize(entt::entity entt_id, SimulationContext& sim, entt::registry& registry)
+    {
+        auto& info = registry.get<PlatformInfo>(entt_id);
+        applyIcon(info.prefs, info.prefs.known, entt_id, sim, registry);
+        materializeLabel(info.prefs.commonprefs, entt_id, sim, registry);
+        sim.tracks.show(entt_id, sim.components, registry);
+    }
+
+    //! Takes the platform's icon, label and track line away, keeping its
+    //! data and track history. Not thread safe.
+    void dematerialize(entt::entity entt_id, SimulationContext& sim, entt::registry& registry)
+    {
+        releaseVisuals(entt_id, sim, registry);
+        sim.tracks.hide(entt_id, sim.components, registry);
+    }
+
+    //! Removes the platform, after whatever it hosts. Not thread safe.
+    void destroy(entt::entity entt_id, SimulationContext& sim, entt::registry& registry)
+    {
+        sim.tracks.disable(entt_id, sim.components, registry);
+        sim.spatial.erase(entt_id);
+        destroyEntity(registry.get<PlatformInfo>(entt_id).id, entt_id, sim, registry);
+    }
+
+    //! Applies a time update to the platform's own components. Touches nothing
+    //! shared, so different platforms can be updated concurrently.
+    //! @return the fields that changed; pass them to commitUpdate()
+    ChangeMask applyUpdate(const simData::PlatformUpdate* new_update, entt::entity entt_id, entt::registry& registry)
+    {
+        ROCKY_SOFT_ASSERT_AND_RETURN(new_update, 0u);
+        return applyLatest(*new_update, entt_id, registry);
+    }
+
+    //! Same as above, from the state read out of an update on another thread.
+    ChangeMask applyUpdate(const Platform& latest, entt::entity entt_id, entt::registry& registry)
+    {
+        return applyLatest(latest, entt_id, registry);
+    }
+
+    //! Records the effects of an applyUpdate() in shared state. Not thread safe.
+    void commitUpdate(entt::entity entt_id, ChangeMask changes, SimulationContext& sim, const entt::registry& registry)
+    {
+        if (changes & Platform::POSITION)
         {
-            applyCommonPrefs(&new_prefs->commonprefs(), platform.prefs.commonprefs(), entt_id, sim, registry);
+            // hosted beams and gates follow on the next propagation
+            sim.hosts.markDirty(entt_id);
+
+            auto& platform = registry.get<Platform>(entt_id);
+            sim.spatial.move(entt_id, registry.get<PlatformInfo>(entt_id).id, vsg::dvec3(platform.x, platform.y, platform.z));
         }
+    }
 
-        platform.prefs = *new_prefs;
+    //! Patches the icons of platforms whose image finished loading.
+    void applyLoadedIcons(entt::registry& registry)
+    {
+        std::vector<entt::entity> loaded;
+        for (auto [entity, pending] : registry.view<PendingIcon>().each())
+        {
+            if (pending.asset->ready())
+            {
+                applyIconImage(pending.asset->value, entity, registry);
+                loaded.emplace_back(entity);
+            }
+        }
+        for (auto entity : loaded)
+        {
+            registry.remove<PendingIcon>(entity);
+        }
     }
 
-    void applyUpdate(const simData::PlatformUpdate* new_update, const simData::ObjectId id, SimulationContext& sim, entt::registry& registry)
+    //! Counts icon components and the distinct images behind them. Images come
+    //! from the shared AssetCache, so this stays at the number of distinct icon
+    //! URIs no matter how many platforms use them.
+    IconStats iconStats(entt::registry& registry) const
     {
-        ROCKY_SOFT_ASSERT_AND_RETURN(new_update, void());
+        IconStats stats;
+        std::unordered_set<const rocky::Image*> images;
+        for (auto [entity, icon] : registry.view<rocky::Icon>().each())
+        {
+            ++stats.references;
+            if (icon.image)
+                images.emplace(icon.image.get());
+        }
+        stats.unique_images = images.size();
+        return stats;
+    }
 
-        auto entt_id = sim.entities[id];
+private:
+    template<class SOURCE>
+    ChangeMask applyLatest(const SOURCE& latest, entt::entity entt_id, entt::registry& registry)
+    {
         auto& platform = registry.get<Platform>(entt_id);
 
-        if (new_update->has_x() || new_update->has_y() || new_update->has_z())
+        auto changes = platform.diff(latest);
+        if (changes & Platform::POSITION)
         {
+            platform.store(latest, changes);
+
             auto& transform = registry.get<rocky::Transform>(entt_id);
-            transform.position = rocky::GeoPoint(rocky::SRS::ECEF, new_update->x(), new_update->y(), new_update->z());
+            transform.position = rocky::GeoPoint(rocky::SRS::ECEF, platform.x, platform.y, platform.z);
             transform.dirty();
+
+            // const lookup, so a registry without any tracks yet isn't given
+            // the Track storage from several threads at once
+            if (std::as_const(registry).all_of<Track>(entt_id))
+                registry.get<Track>(entt_id).append(platform.time, vsg::dvec3(platform.x, platform.y, platform.z));
+        }
+        return changes;
+    }
+
+    void applyTrackPrefs(const PlatformPrefsState& prefs, entt::entity entt_id, SimulationContext& sim, entt::registry& registry)
+    {
+        if (!(prefs.known & PlatformPrefsState::TRACK_MODE) || prefs.trackdrawmode == simData::TrackPrefs::OFF)
+        {
+            sim.tracks.disable(entt_id, sim.components, registry);
+            return;
+        }
+
+        // every draw mode shows as a line for now
+        vsg::vec4 color{ 1, 1, 1, 1 };
+        if (prefs.known & PlatformPrefsState::TRACK_STYLE && prefs.trackcolor != 0u)
+        {
+            color = colorFromRGBA(prefs.trackcolor);
+        }
+        auto width = prefs.linewidth > 0 ? (float)prefs.linewidth : 2.0f;
+        auto length = prefs.known & PlatformPrefsState::TRACK_LENGTH ? (double)prefs.tracklength : 0.0;
+        sim.tracks.enable(entt_id, std::max(length, 0.0), color, width, registry);
+        if (Materializer::materialized(entt_id, registry))
+            sim.tracks.show(entt_id, sim.components, registry);
+    }
+
+    //! Applies the 'changes' icon fields of 'prefs' to the platform's Icon.
+    void applyIcon(const PlatformPrefsState& prefs, ChangeMask changes, entt::entity entt_id, SimulationContext& sim, entt::registry& registry)
+    {
+        if (changes & PlatformPrefsState::ICON)
+        {
+            sim.components.get_or_emplace<rocky::Icon>(entt_id, registry);
+
+            // never block on I/O here; show a placeholder until the image loads.
+            auto image = sim.get_image(prefs.icon);
+            if (image->ready())
+            {
+                registry.remove<PendingIcon>(entt_id);
+                applyIconImage(image->value, entt_id, registry);
+            }
+            else
+            {
+                registry.emplace_or_replace<PendingIcon>(entt_id, image);
+                applyIconImage(sim.assets.placeholder(), entt_id, registry);
+            }
         }
+        else if (changes & PlatformPrefsState::SCALE)
+        {
+            auto& icon = sim.components.get_or_emplace<rocky::Icon>(entt_id, registry);
+            applyIconImage(icon.image, entt_id, registry);
+        }
+    }
 
-        platform.update = *new_update;
+    void applyIconImage(std::shared_ptr<rocky::Image> image, entt::entity entt_id, entt::registry& registry)
+    {
+        auto& icon = registry.get_or_emplace<rocky::Icon>(entt_id);
+        icon.image = image;
+
+        auto& info = registry.get<PlatformInfo>(entt_id);
+        if ((info.prefs.known & PlatformPrefsState::SCALE) && image && image->valid())
+        {
+            icon.style.size_pixels = image->width() * info.prefs.scale;
+        }
+        icon.dirty();
     }
 };
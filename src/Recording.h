@@ -0,0 +1,797 @@
+#pragma once
+#include "BulkIngest.h"
+#include <simData/DataStore.h>
+#include <rocky/Log.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+//! Binary recording of DataStore time updates, stored by columns.
+//!
+//! Layout (native byte order, every section 8-byte aligned):
+//!
+//!     FileHeader
+//!     chunk data...      per chunk: double times[count], then one
+//!                        double[count] column per field of the entity type
+//!     EntityEntry + name (padded to 8 bytes), per entity
+//!     ChunkEntry[chunk_count], sorted by start time
+//!     FileTrailer
+//!
+//! A chunk holds consecutive samples of one entity. Fields per type:
+//! platform x, y, z (ECEF); beam azimuth, elevation, range; gate azimuth,
+//! elevation, width, height, minrange, maxrange, centroid.
+namespace Recording
+{
+    constexpr char magic[8] = { 'S', 'I', 'M', 'R', 'E', 'C', '0', '1' };
+    constexpr std::uint32_t version = 1u;
+
+    struct FileHeader
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t reserved;
+    };
+
+    struct EntityEntry
+    {
+        std::uint64_t id;
+        std::uint64_t hostid;
+        std::uint32_t type;         // simData::ObjectType
+        std::uint32_t name_length;  // bytes of name following the entry
+    };
+
+    struct ChunkEntry
+    {
+        std::uint64_t offset;
+        std::uint64_t id;
+        std::uint32_t type;
+        std::uint32_t count;
+        double t0;
+        double t1;
+    };
+
+    struct FileTrailer
+    {
+        std::uint64_t entities_offset;
+        std::uint64_t entity_count;
+        std::uint64_t chunks_offset;
+        std::uint64_t chunk_count;
+        char magic[8];
+    };
+
+    //! Number of recorded fields for an entity type (0 if not recorded)
+    inline unsigned fields(std::uint32_t type)
+    {
+        return
+            type == simData::PLATFORM ? 3u :
+            type == simData::BEAM ? 3u :
+            type == simData::GATE ? 7u : 0u;
+    }
+
+    inline std::size_t padded(std::size_t bytes)
+    {
+        return (bytes + 7u) & ~std::size_t(7u);
+    }
+}
+
+
+//! DataStore listener that records every entity's time updates to a file.
+//!
+//! Each time the DataStore moves to a new time, the current update of every
+//! entity whose slice changed is appended to that entity's column buffers.
+//! A buffer is written out as a chunk when it reaches chunk_size samples, and
+//! all of them are when max_buffered samples are waiting, so memory use stays
+//! bounded however long the recording runs. An entity removed from the
+//! DataStore has its samples flushed and its slice forgotten at once; it
+//! stays in the entity table so its chunks replay. close() writes the entity
+//! table and chunk directory.
+class Recorder : public simData::DataStore::DefaultListener
+{
+public:
+    static constexpr std::uint32_t chunk_size = 4096u;
+    static constexpr std::size_t max_buffered = 1u << 20;
+
+    //! Starts a recording. Check ok() afterwards.
+    Recorder(const std::string& path_) :
+        path(path_)
+    {
+        file = fopen(path.c_str(), "wb");
+        if (file)
+        {
+            Recording::FileHeader header = {};
+            memcpy(header.magic, Recording::magic, sizeof(header.magic));
+            header.version = Recording::version;
+            write(&header, sizeof(header));
+        }
+        else
+        {
+            rocky::Log()->warn("Recording \"" + path + "\" cannot be created");
+        }
+    }
+
+    ~Recorder()
+    {
+        close();
+    }
+
+    bool ok() const
+    {
+        return file != nullptr && !failed;
+    }
+
+    //! Flushes the remaining samples and writes the directory.
+    //! @return true if the whole recording was written
+    bool close()
+    {
+        if (!file)
+            return false;
+
+        for (auto& [id, entity] : entities)
+            flushChunk(id, entity);
+
+        Recording::FileTrailer trailer = {};
+        memcpy(trailer.magic, Recording::magic, sizeof(trailer.magic));
+
+        trailer.entities_offset = offset;
+        trailer.entity_count = entities.size() + removed.size();
+        auto writeEntry = [&](simData::ObjectId id, const Entity& entity)
+            {
+                Recording::EntityEntry entry = { id, entity.hostid, entity.type, (std::uint32_t)entity.name.size() };
+                write(&entry, sizeof(entry));
+                write(entity.name.data(), entity.name.size());
+                pad();
+            };
+        for (auto& [id, entity] : removed)
+            writeEntry(id, entity);
+        for (auto& [id, entity] : entities)
+            writeEntry(id, entity);
+
+        std::sort(chunks.begin(), chunks.end(), [](auto& a, auto& b) { return a.t0 < b.t0; });
+        trailer.chunks_offset = offset;
+        trailer.chunk_count = chunks.size();
+        write(chunks.data(), chunks.size() * sizeof(Recording::ChunkEntry));
+        write(&trailer, sizeof(trailer));
+
+        bool result = !failed && fclose(file) == 0;
+        file = nullptr;
+        if (!result)
+            rocky::Log()->warn("Recording \"" + path + "\" could not be written");
+        return result;
+    }
+
+    //! Number of samples recorded so far
+    std::uint64_t samples() const
+    {
+        return sample_count;
+    }
+
+    void onAddEntity(simData::DataStore* ds, simData::ObjectId id, simData::ObjectType type) override
+    {
+        if (Recording::fields(type) == 0u)
+            return;
+
+        auto& entity = entities[id];
+        entity.type = type;
+        entity.columns.resize(Recording::fields(type) + 1u);
+        readProperties(ds, id, entity);
+        readName(ds, id, entity);
+
+        if (type == simData::PLATFORM)
+            platform_slices.push_back({ id, ds->platformUpdateSlice(id) });
+        else if (type == simData::BEAM)
+            beam_slices.push_back({ id, ds->beamUpdateSlice(id) });
+        else
+            gate_slices.push_back({ id, ds->gateUpdateSlice(id) });
+    }
+
+    //! Writes out the entity's buffered samples and stops reading its slice,
+    //! which the DataStore frees once this returns.
+    void onRemoveEntity(simData::DataStore* ds, simData::ObjectId id, simData::ObjectType type) override
+    {
+        auto i = entities.find(id);
+        if (i == entities.end())
+            return;
+
+        forget(platform_slices, id);
+        forget(beam_slices, id);
+        forget(gate_slices, id);
+
+        buffered -= i->second.columns[0].size();
+        flushChunk(id, i->second);
+        i->second.columns.clear();
+        removed.emplace_back(id, std::move(i->second));
+        entities.erase(i);
+    }
+
+    //! Same as above for every entity, as the whole scenario is about to go.
+    void onScenarioDelete(simData::DataStore* ds) override
+    {
+        platform_slices.clear();
+        beam_slices.clear();
+        gate_slices.clear();
+
+        for (auto& [id, entity] : entities)
+        {
+            flushChunk(id, entity);
+            entity.columns.clear();
+            removed.emplace_back(id, std::move(entity));
+        }
+        entities.clear();
+        buffered = 0u;
+    }
+
+    void onPropertiesChange(simData::DataStore* ds, simData::ObjectId id) override
+    {
+        auto i = entities.find(id);
+        if (i != entities.end())
+            readProperties(ds, id, i->second);
+    }
+
+    void onPrefsChange(simData::DataStore* ds, simData::ObjectId id) override
+    {
+        auto i = entities.find(id);
+        if (i != entities.end())
+            readName(ds, id, i->second);
+    }
+
+    void onTimeChange(simData::DataStore* ds) override
+    {
+        if (!ok())
+            return;
+
+        for (auto& [id, slice] : platform_slices)
+        {
+            if (slice && slice->hasChanged() && slice->current())
+            {
+                auto* u = slice->current();
+                append(id, u->time(), { u->x(), u->y(), u->z() });
+            }
+        }
+        for (auto& [id, slice] : beam_slices)
+        {
+            if (slice && slice->hasChanged() && slice->current())
+            {
+                auto* u = slice->current();
+                append(id, u->time(), { u->azimuth(), u->elevation(), u->range() });
+            }
+        }
+        for (auto& [id, slice] : gate_slices)
+        {
+            if (slice && slice->hasChanged() && slice->current())
+            {
+                auto* u = slice->current();
+                append(id, u->time(), { u->azimuth(), u->elevation(), u->width(), u->height(), u->minrange(), u->maxrange(), u->centroid() });
+            }
+        }
+    }
+
+private:
+    struct Entity
+    {
+        std::uint32_t type = 0u;
+        std::uint64_t hostid = 0u;
+        std::string name;
+        std::vector<std::vector<double>> columns;   // times, then one per field
+    };
+
+    std::string path;
+    FILE* file = nullptr;
+    bool failed = false;
+    std::uint64_t offset = 0u;
+    std::uint64_t sample_count = 0u;
+    std::size_t buffered = 0u;
+    std::unordered_map<simData::ObjectId, Entity> entities;
+    std::vector<std::pair<simData::ObjectId, Entity>> removed;   // left the DataStore; table rows only
+    std::vector<Recording::ChunkEntry> chunks;
+    std::vector<std::pair<simData::ObjectId, const simData::PlatformUpdateSlice*>> platform_slices;
+    std::vector<std::pair<simData::ObjectId, const simData::BeamUpdateSlice*>> beam_slices;
+    std::vector<std::pair<simData::ObjectId, const simData::GateUpdateSlice*>> gate_slices;
+
+    template<class SLICES>
+    static void forget(SLICES& slices, simData::ObjectId id)
+    {
+        for (auto& entry : slices)
+        {
+            if (entry.first == id)
+            {
+                entry = slices.back();
+                slices.pop_back();
+                return;
+            }
+        }
+    }
+
+    void write(const void* data, std::size_t bytes)
+    {
+        if (bytes > 0u && fwrite(data, 1, bytes, file) != bytes)
+            failed = true;
+        offset += bytes;
+    }
+
+    void pad()
+    {
+        static const char zeros[8] = {};
+        write(zeros, Recording::padded((std::size_t)offset) - (std::size_t)offset);
+    }
+
+    void readProperties(simData::DataStore* ds, simData::ObjectId id, Entity& entity)
+    {
+        simData::DataStore::Transaction x;
+        if (entity.type == simData::BEAM)
+        {
+            auto props = ds->beamProperties(id, &x);
+            if (props)
+                entity.hostid = props->hostid();
+            x.complete(&props);
+        }
+        else if (entity.type == simData::GATE)
+        {
+            auto props = ds->gateProperties(id, &x);
+            if (props)
+                entity.hostid = props->hostid();
+            x.complete(&props);
+        }
+    }
+
+    void readName(simData::DataStore* ds, simData::ObjectId id, Entity& entity)
+    {
+        simData::DataStore::Transaction x;
+        if (entity.type == simData::PLATFORM)
+        {
+            auto prefs = ds->platformPrefs(id, &x);
+            if (prefs)
+                entity.name = prefs->commonprefs().name();
+            x.complete(&prefs);
+        }
+        else if (entity.type == simData::BEAM)
+        {
+            auto prefs = ds->beamPrefs(id, &x);
+            if (prefs)
+                entity.name = prefs->commonprefs().name();
+            x.complete(&prefs);
+        }
+        else if (entity.type == simData::GATE)
+        {
+            auto prefs = ds->gatePrefs(id, &x);
+            if (prefs)
+                entity.name = prefs->commonprefs().name();
+            x.complete(&prefs);
+        }
+    }
+
+    void append(simData::ObjectId id, double time, std::initializer_list<double> values)
+    {
+        auto& entity = entities[id];
+        auto& columns = entity.columns;
+        columns[0].push_back(time);
+        std::size_t c = 1u;
+        for (auto value : values)
+            columns[c++].push_back(value);
+        ++sample_count;
+        ++buffered;
+
+        if (columns[0].size() >= chunk_size)
+        {
+            buffered -= columns[0].size();
+            flushChunk(id, entity);
+        }
+        else if (buffered >= max_buffered)
+        {
+            for (auto& [other_id, other] : entities)
+                flushChunk(other_id, other);
+            buffered = 0u;
+        }
+    }
+
+    void flushChunk(simData::ObjectId id, Entity& entity)
+    {
+        auto& columns = entity.columns;
+        if (columns.empty() || columns[0].empty())
+            return;
+
+        auto count = (std::uint32_t)columns[0].size();
+        chunks.push_back({ offset, id, entity.type, count, columns[0].front(), columns[0].back() });
+        for (auto& column : columns)
+        {
+            write(column.data(), column.size() * sizeof(double));
+            column.clear();
+        }
+    }
+};
+
+
+//! Read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    bool open(const std::string& path)
+    {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+            return close(), false;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping)
+            return close(), false;
+        bytes = (const std::uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!bytes)
+            return close(), false;
+        length = (std::size_t)file_size.QuadPart;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0)
+            return ::close(fd), false;
+        void* address = mmap(nullptr, (std::size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (address == MAP_FAILED)
+            return false;
+        bytes = (const std::uint8_t*)address;
+        length = (std::size_t)st.st_size;
+#endif
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (bytes)
+            UnmapViewOfFile(bytes);
+        if (mapping)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (bytes)
+            munmap((void*)bytes, length);
+#endif
+        bytes = nullptr;
+        length = 0u;
+    }
+
+    //! Tells the OS a range is not needed for now, so its pages can leave the
+    //! resident set. Reading it again faults them back in from the file.
+    void release(std::size_t offset, std::size_t size) const
+    {
+#ifndef _WIN32
+        static const std::size_t page = (std::size_t)sysconf(_SC_PAGESIZE);
+        auto begin = (offset + page - 1u) / page * page;    // whole pages only
+        auto end = (offset + size) / page * page;
+        if (bytes && end > begin)
+            madvise((void*)(bytes + begin), end - begin, MADV_DONTNEED);
+#endif
+    }
+
+    const std::uint8_t* data() const { return bytes; }
+    std::size_t size() const { return length; }
+
+private:
+    const std::uint8_t* bytes = nullptr;
+    std::size_t length = 0u;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+};
+
+
+//! Streams a recording into a DataStore around the current time.
+//!
+//! open() maps the file and reads only its directory, then creates the
+//! recorded entities; no samples are loaded. Before each DataStore update,
+//! call update(time): chunks overlapping [time - behind, time + ahead] are
+//! inserted, and the DataStore's data limiting (set to the same window on
+//! every replayed entity) drops samples that fall behind. Seeking backwards
+//! flushes the replayed entities and loads the window again. Mapped pages are
+//! released once read, so resident memory stays proportional to the window,
+//! not the file.
+class Replayer
+{
+public:
+    //! seconds of data kept behind and loaded ahead of the current time
+    double behind = 30.0;
+    double ahead = 30.0;
+
+    //! Maps a recording and creates its entities in the DataStore.
+    //! @return nullptr (after logging why) if the file cannot be used
+    static std::shared_ptr<Replayer> open(const std::string& path, simData::DataStore& ds, double behind = 30.0, double ahead = 30.0)
+    {
+        auto replayer = std::shared_ptr<Replayer>(new Replayer(ds));
+        replayer->behind = behind;
+        replayer->ahead = ahead;
+        if (!replayer->load(path))
+            return nullptr;
+        return replayer;
+    }
+
+    //! Loads the chunks around 'time'. Call before ds.update(time).
+    //! @return number of samples inserted
+    std::size_t update(double time)
+    {
+        auto window_begin = time - behind;
+        auto window_end = time + ahead;
+
+        // data limiting keeps the newest samples, so after a seek back the
+        // window must be loaded again from scratch
+        if (time < last_time)
+        {
+            for (auto& [recorded_id, id] : ids)
+                ds.flush(id);
+            std::fill(progress.begin(), progress.end(), 0u);
+
+            // chunks are sorted by start time; restart from the first one
+            // that could still reach into the window
+            auto earliest = window_begin - longest_chunk;
+            next = (std::size_t)(std::lower_bound(chunks, chunks + chunk_count, earliest,
+                [](const Recording::ChunkEntry& chunk, double t) { return chunk.t0 < t; }) - chunks);
+        }
+        last_time = time;
+
+        // data limiting is suspended only for frames that insert something
+        std::size_t inserted = 0;
+        for (auto i = next; i < chunk_count && chunks[i].t0 <= window_end; ++i)
+        {
+            if (progress[i] < chunks[i].count && chunks[i].t1 >= window_begin)
+                inserted += insert(i, window_begin, window_end);
+        }
+        ingest.resumeLimiting();
+
+        // skip chunks that are fully loaded or entirely in the past
+        while (next < chunk_count && (progress[next] == chunks[next].count || chunks[next].t1 < window_begin))
+            ++next;
+
+        return inserted;
+    }
+
+    //! Time span of the recording
+    double firstTime() const { return first_time; }
+    double lastTime() const { return last_time_recorded; }
+
+    //! DataStore ID of a recorded entity, or 0
+    simData::ObjectId idOf(std::uint64_t recorded_id) const
+    {
+        auto i = ids.find(recorded_id);
+        return i != ids.end() ? i->second : 0;
+    }
+
+private:
+    simData::DataStore& ds;
+    BulkIngest ingest;      // kept for its Transaction across frames
+    MappedFile file;
+    const Recording::ChunkEntry* chunks = nullptr;
+    std::size_t chunk_count = 0u;
+    std::vector<std::uint32_t> progress;    // samples of each chunk inserted so far
+    std::size_t next = 0u;
+    double longest_chunk = 0.0;
+    double last_time = -1e300;
+    double first_time = 0.0;
+    double last_time_recorded = 0.0;
+    std::unordered_map<std::uint64_t, simData::ObjectId> ids;
+
+    Replayer(simData::DataStore& ds_) :
+        ds(ds_),
+        ingest(ds_, false)
+    {
+        //nop
+    }
+
+    bool load(const std::string& path)
+    {
+        auto fail = [&](const std::string& why)
+            {
+                rocky::Log()->warn("Recording \"" + path + "\" cannot be replayed: " + why);
+                return false;
+            };
+
+        if (!file.open(path))
+            return fail("cannot map file");
+
+        auto* base = file.data();
+        auto size = file.size();
+        if (size < sizeof(Recording::FileHeader) + sizeof(Recording::FileTrailer))
+            return fail("too short");
+
+        auto* header = (const Recording::FileHeader*)base;
+        auto* trailer = (const Recording::FileTrailer*)(base + size - sizeof(Recording::FileTrailer));
+        if (memcmp(header->magic, Recording::magic, sizeof(Recording::magic)) != 0 ||
+            memcmp(trailer->magic, Recording::magic, sizeof(Recording::magic)) != 0)
+            return fail("not a recording, or incomplete");
+        if (header->version != Recording::version)
+            return fail("unsupported version " + std::to_string(header->version));
+
+        // every offset and count below comes from the file, so each range is
+        // checked against the one that must contain it before it is read,
+        // without sums or products that could wrap around
+        auto fits = [](std::uint64_t offset, std::uint64_t bytes, std::uint64_t begin, std::uint64_t end)
+            {
+                return offset >= begin && offset <= end && bytes <= end - offset && offset % 8u == 0u;
+            };
+        const std::uint64_t data_begin = sizeof(Recording::FileHeader);
+        const std::uint64_t directory_end = size - sizeof(Recording::FileTrailer);
+        if (trailer->chunk_count > directory_end / sizeof(Recording::ChunkEntry) ||
+            !fits(trailer->chunks_offset, trailer->chunk_count * sizeof(Recording::ChunkEntry), data_begin, directory_end))
+            return fail("corrupt chunk directory");
+        if (!fits(trailer->entities_offset, 0u, data_begin, trailer->chunks_offset))
+            return fail("corrupt entity table");
+
+        chunks = (const Recording::ChunkEntry*)(base + trailer->chunks_offset);
+        chunk_count = (std::size_t)trailer->chunk_count;
+        progress.assign(chunk_count, 0u);
+
+        for (std::size_t i = 0; i < chunk_count; ++i)
+        {
+            auto& chunk = chunks[i];
+            auto bytes = (std::uint64_t)chunk.count * (Recording::fields(chunk.type) + 1u) * sizeof(double);
+            if (Recording::fields(chunk.type) == 0u || !fits(chunk.offset, bytes, data_begin, trailer->entities_offset))
+                return fail("corrupt chunk " + std::to_string(i));
+            longest_chunk = std::max(longest_chunk, chunk.t1 - chunk.t0);
+            last_time_recorded = std::max(last_time_recorded, chunk.t1);
+        }
+        first_time = chunk_count > 0u ? chunks[0].t0 : 0.0;
+
+        // create the entities, hosts first
+        std::vector<const Recording::EntityEntry*> entries;
+        auto position = trailer->entities_offset;
+        for (std::uint64_t i = 0; i < trailer->entity_count; ++i)
+        {
+            if (!fits(position, sizeof(Recording::EntityEntry), position, trailer->chunks_offset))
+                return fail("corrupt entity table");
+            auto* entry = (const Recording::EntityEntry*)(base + position);
+            auto bytes = Recording::padded(sizeof(Recording::EntityEntry) + (std::size_t)entry->name_length);
+            if (!fits(position, bytes, position, trailer->chunks_offset))
+                return fail("corrupt entity " + std::to_string(i));
+            entries.push_back(entry);
+            position += bytes;
+        }
+
+        auto rank = [](std::uint32_t type) { return type == simData::PLATFORM ? 0 : type == simData::BEAM ? 1 : 2; };
+        std::stable_sort(entries.begin(), entries.end(), [&](auto* a, auto* b) { return rank(a->type) < rank(b->type); });
+
+        for (auto* entry : entries)
+        {
+            std::string name((const char*)(entry + 1), entry->name_length);
+            auto id = addEntity(*entry, name);
+            if (id != 0)
+                ids[entry->id] = id;
+        }
+
+        ds.setDataLimiting(true);
+        return true;
+    }
+
+    simData::ObjectId addEntity(const Recording::EntityEntry& entry, const std::string& name)
+    {
+        simData::DataStore::Transaction x;
+        simData::ObjectId id = 0;
+
+        if (entry.type == simData::PLATFORM)
+        {
+            auto props = ds.addPlatform(&x);
+            id = props->id();
+            x.complete(&props);
+
+            auto prefs = ds.mutable_platformPrefs(id, &x);
+            setCommonPrefs(prefs->mutable_commonprefs(), name);
+            x.complete(&prefs);
+        }
+        else if (entry.type == simData::BEAM || entry.type == simData::GATE)
+        {
+            auto host = ids.find(entry.hostid);
+            if (host == ids.end())
+                return 0;
+
+            if (entry.type == simData::BEAM)
+            {
+                auto props = ds.addBeam(&x);
+                id = props->id();
+                props->set_hostid(host->second);
+                x.complete(&props);
+
+                auto prefs = ds.mutable_beamPrefs(id, &x);
+                setCommonPrefs(prefs->mutable_commonprefs(), name);
+                x.complete(&prefs);
+            }
+            else
+            {
+                auto props = ds.addGate(&x);
+                id = props->id();
+                props->set_hostid(host->second);
+                x.complete(&props);
+
+                auto prefs = ds.mutable_gatePrefs(id, &x);
+                setCommonPrefs(prefs->mutable_commonprefs(), name);
+                x.complete(&prefs);
+            }
+        }
+        return id;
+    }
+
+    void setCommonPrefs(simData::CommonPrefs* prefs, const std::string& name)
+    {
+        if (!name.empty())
+            prefs->set_name(name);
+        prefs->set_datalimittime(behind + ahead);
+    }
+
+    //! Inserts the samples of a chunk up to the end of the window; samples
+    //! past it are left for later, as data limiting would otherwise drop the
+    //! current ones in favor of them.
+    std::size_t insert(std::size_t index, double window_begin, double window_end)
+    {
+        auto& chunk = chunks[index];
+        auto id = idOf(chunk.id);
+        if (id == 0)
+        {
+            progress[index] = chunk.count;
+            return 0;
+        }
+
+        auto count = (std::size_t)chunk.count;
+        auto* times = (const double*)(file.data() + chunk.offset);
+        auto column = [&](unsigned field) { return times + count * (field + 1u); };
+
+        // on first load, skip the samples data limiting would drop right away,
+        // but keep the one in effect at the window start
+        auto first = (std::size_t)progress[index];
+        if (first == 0u)
+        {
+            first = (std::size_t)(std::lower_bound(times, times + count, window_begin) - times);
+            if (first > 0u)
+                --first;
+        }
+        auto last = (std::size_t)(std::upper_bound(times + first, times + count, window_end) - times);
+        if (last <= first)
+            return 0;
+
+        auto n = last - first;
+        auto* t = times + first;
+        ingest.suspendLimiting();
+        if (chunk.type == simData::PLATFORM)
+            ingest.insertPlatform(id, n, t, column(0) + first, column(1) + first, column(2) + first);
+        else if (chunk.type == simData::BEAM)
+            ingest.insertBeam(id, n, t, column(0) + first, column(1) + first, column(2) + first);
+        else if (chunk.type == simData::GATE)
+            ingest.insertGate(id, n, t, column(0) + first, column(1) + first, column(2) + first, column(3) + first,
+                column(4) + first, column(5) + first, column(6) + first);
+
+        // once the whole chunk lives in the DataStore, let its pages go
+        progress[index] = (std::uint32_t)last;
+        if (last == count)
+            file.release((std::size_t)chunk.offset, count * (Recording::fields(chunk.type) + 1u) * sizeof(double));
+        return n;
+    }
+};
@@ -1,4 +1,13 @@
 #pragma once
+#include "AssetCache.h"
+#include "BeamShapes.h"
+#include "ComponentPool.h"
+#include "EntityIndex.h"
+#include "HostGraph.h"
+#include "LabelDeclutter.h"
+#include "Materializer.h"
+#include "SpatialIndex.h"
+#include "TrackHistory.h"
 #include <simData/ObjectId.h>
 #include <simData/DataStore.h>
 
@@ -8,32 +17,102 @@
 #include <rocky/Log.h>
 #include <entt/entt.hpp>
 
-#include <vsg/io/read.h>
-#include <vsg/text/Font.h>
 #include <vsgXchange/all.h>
 
-#include <unordered_map>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
-namespace
+//! Bit set of message fields that changed
+using ChangeMask = std::uint32_t;
+
+//! Value type of protobuf field NAME in message type MSG
+#define FIELD_TYPE(MSG, NAME) std::decay_t<decltype(std::declval<const MSG&>().NAME())>
+
+//! Sets BIT in CHANGES if message MSG carries field NAME with a value other than the
+//! one last stored in STATE.NAME, or if STATE has never stored that field.
+#define DIFF_FIELD(NAME, MSG, STATE, BIT, CHANGES) \
+    if ((MSG).has_##NAME() && (!((STATE).known & (BIT)) || (MSG).NAME() != (STATE).NAME)) (CHANGES) |= (BIT)
+
+//! Copies field NAME from message MSG into STATE.NAME if BIT is set in CHANGES.
+#define STORE_FIELD(NAME, MSG, STATE, BIT, CHANGES) \
+    if ((CHANGES) & (BIT)) (STATE).NAME = (MSG).NAME()
+
+//! Like DIFF_FIELD, but compares against another state LATEST (e.g. one read from
+//! the DataStore on another thread) rather than a message.
+#define DIFF_STATE(NAME, LATEST, STATE, BIT, CHANGES) \
+    if (((LATEST).known & (BIT)) && (!((STATE).known & (BIT)) || (LATEST).NAME != (STATE).NAME)) (CHANGES) |= (BIT)
+
+//! Copies STATE.NAME from another state LATEST if BIT is set in CHANGES.
+#define STORE_STATE(NAME, LATEST, STATE, BIT, CHANGES) \
+    if ((CHANGES) & (BIT)) (STATE).NAME = (LATEST).NAME
+
+//! A simData color (0xRRGGBBAA) as RGBA floats
+inline vsg::vec4 colorFromRGBA(std::uint32_t c)
 {
-    // Creates an image to use when the image we want is missing.
-    std::shared_ptr<rocky::Image> createMissingImage()
-    {
-        auto image = rocky::Image::create(rocky::Image::R8G8B8A8_UNORM, 15, 15);
-        image->fill({ 1,1,1,1 });
-        for (unsigned i = 1; i < image->width() - 1; ++i) {
-            image->write({ 1,0,0,1 }, i, i);
-            image->write({ 1,0,0,1 }, i, image->height() - 1 - i);
-        }
-        return image;
-    }
+    return vsg::vec4{ (float)((c >> 24) & 0xff) / 255.0f, (float)((c >> 16) & 0xff) / 255.0f,
+        (float)((c >> 8) & 0xff) / 255.0f, (float)(c & 0xff) / 255.0f };
 }
 
-#define VALUE_CHANGED(NAME, P0, P1) \
-    ((P0).has_##NAME() && (!(P1).has_##NAME() || ((P0).##NAME() != (P1).##NAME())))
 
+//! The common prefs fields the visualization uses. Adapters keep this instead of a
+//! copy of the full message and diff incoming prefs against it.
+struct CommonPrefsState
+{
+    enum : ChangeMask
+    {
+        NAME = 1u << 0,
+        DRAW = 1u << 1,
+        FONT = 1u << 2,
+        FONT_SIZE = 1u << 3,
+        ALIGNMENT = 1u << 4,
+        PRIORITY = 1u << 5,
+        COLOR = 1u << 6
+    };
 
-using ObjectToEntityLUT = std::unordered_map<simData::ObjectId, entt::entity>;
+    ChangeMask known = 0u;
+    std::string name;
+    bool draw = false;
+    FIELD_TYPE(simData::CommonPrefs, color) color = {};
+    std::string overlayfontname;
+    FIELD_TYPE(simData::LabelPrefs, overlayfontpointsize) overlayfontpointsize = {};
+    FIELD_TYPE(simData::LabelPrefs, alignment) alignment = {};
+    FIELD_TYPE(simData::LabelPrefs, priority) priority = {};
+
+    //! Fields of 'prefs' that differ from this state
+    ChangeMask diff(const simData::CommonPrefs& prefs) const
+    {
+        ChangeMask changes = 0u;
+        DIFF_FIELD(name, prefs, *this, NAME, changes);
+        DIFF_FIELD(draw, prefs, *this, DRAW, changes);
+        DIFF_FIELD(color, prefs, *this, COLOR, changes);
+        if (prefs.has_labelprefs())
+        {
+            auto& label = prefs.labelprefs();
+            DIFF_FIELD(overlayfontname, label, *this, FONT, changes);
+            DIFF_FIELD(overlayfontpointsize, label, *this, FONT_SIZE, changes);
+            DIFF_FIELD(alignment, label, *this, ALIGNMENT, changes);
+            DIFF_FIELD(priority, label, *this, PRIORITY, changes);
+        }
+        return changes;
+    }
+
+    //! Stores the changed fields of 'prefs'
+    void store(const simData::CommonPrefs& prefs, ChangeMask changes)
+    {
+        STORE_FIELD(name, prefs, *this, NAME, changes);
+        STORE_FIELD(draw, prefs, *this, DRAW, changes);
+        STORE_FIELD(color, prefs, *this, COLOR, changes);
+        auto& label = prefs.labelprefs();
+        STORE_FIELD(overlayfontname, label, *this, FONT, changes);
+        STORE_FIELD(overlayfontpointsize, label, *this, FONT_SIZE, changes);
+        STORE_FIELD(alignment, label, *this, ALIGNMENT, changes);
+        STORE_FIELD(priority, label, *this, PRIORITY, changes);
+        known |= changes;
+    }
+};
 
 
 struct SimulationContext
@@ -42,24 +121,56 @@ struct SimulationContext
     rocky::VSGContext runtime;
 
     //! mapping table from simData::ObjectId to entt::entity
-    ObjectToEntityLUT entities;
-
-    //! cache of fonts by name
-    std::unordered_map<std::string, vsg::ref_ptr<vsg::Font>> fonts;
+    EntityIndex entities;
 
     //! simvis-specific logger
     std::shared_ptr<spdlog::logger> log = rocky::Log()->clone("simvis");
 
-    //! gets or loads a font by name
-    vsg::ref_ptr<vsg::Font>& get_font(const std::string& name)
+    //! which entity carries which (platform -> beam -> gate)
+    HostGraph hosts;
+
+    //! icons and fonts, shared by URI and loaded in the background
+    AssetCache assets;
+
+    //! unit beam frusta, shared by widths and draw mode
+    BeamShapeCache beam_shapes;
+
+    //! platform positions, for range queries and picking from any thread
+    SpatialIndex spatial;
+
+    //! platform history trails, within a total point budget
+    TrackHistory tracks;
+
+    //! visual components of removed entities, for reuse
+    ComponentPool components;
+
+    //! which entities carry visual components
+    Materializer visuals;
+
+    //! gets or starts loading an image by URI
+    std::shared_ptr<ImageAsset> get_image(const std::string& uri)
     {
-        auto& font = fonts[name];
-        if (!font.valid())
-        {
-            font = vsg::read_cast<vsg::Font>(name, runtime->readerWriterOptions);
-        }
-        return font;
+        return assets.image(uri, runtime, log);
     }
+
+    //! gets or starts loading a font by name
+    std::shared_ptr<FontAsset> get_font(const std::string& name)
+    {
+        return assets.font(name, runtime);
+    }
+};
+
+
+//! Icon image that is still loading; the Icon shows a placeholder until then.
+struct PendingIcon
+{
+    std::shared_ptr<ImageAsset> asset;
+};
+
+//! Label font that is still loading; the Label uses the default font until then.
+struct PendingFont
+{
+    std::shared_ptr<FontAsset> asset;
 };
 
 
@@ -68,52 +179,140 @@ struct SimulationContext
 class SimEntityAdapter
 {
 public:
-    void applyCommonPrefs(const simData::CommonPrefs* new_prefs, const simData::CommonPrefs& old_prefs, entt::entity entity, SimulationContext& sim, entt::registry& registry)
+    //! Drops an entity from the shared indices, keeps its visual components
+    //! for reuse and destroys it. Whatever it hosts must be gone already.
+    void destroyEntity(simData::ObjectId id, entt::entity entity, SimulationContext& sim, entt::registry& registry)
     {
-        if (VALUE_CHANGED(name, *new_prefs, old_prefs))
+        sim.entities.erase(id);
+        sim.hosts.detach(entity);
+        sim.visuals.erase(entity, registry);
+        sim.components.release(entity, registry);
+        registry.destroy(entity);
+    }
+
+    //! Applies the common prefs fields that differ from 'state', then records them.
+    //! The label is only touched while the entity is materialized; otherwise
+    //! materializeLabel() builds it from the state later.
+    //! @return the fields that changed, for the entity type's own use (color)
+    ChangeMask applyCommonPrefs(const simData::CommonPrefs* new_prefs, CommonPrefsState& state, entt::entity entity, SimulationContext& sim, entt::registry& registry)
+    {
+        auto changes = state.diff(*new_prefs);
+        if (changes == 0u)
+            return 0u;
+
+        state.store(*new_prefs, changes);
+
+        if (changes & CommonPrefsState::DRAW)
         {
-            auto& label = registry.get_or_emplace<rocky::Label>(entity);
-            label.text = new_prefs->name();
-            if (!label.style.font) label.style.font = sim.runtime->defaultFont;
-            label.dirty();
+            sim.visuals.setDrawable(entity, state.draw, registry);
         }
 
-        if (new_prefs->has_labelprefs())
+        if (changes & CommonPrefsState::PRIORITY)
         {
-            applyLabelPrefs(&new_prefs->labelprefs(), old_prefs.labelprefs(), entity, sim, registry);
+            registry.get_or_emplace<DeclutterLabel>(entity).priority = (double)state.priority;
         }
+
+        if (Materializer::materialized(entity, registry))
+        {
+            applyLabel(state, changes, entity, sim, registry);
+        }
+        return changes;
+    }
+
+    //! Gives a newly materialized entity its label, from the stored prefs.
+    void materializeLabel(const CommonPrefsState& state, entt::entity entity, SimulationContext& sim, entt::registry& registry)
+    {
+        applyLabel(state, state.known, entity, sim, registry);
     }
 
-    void applyLabelPrefs(const simData::LabelPrefs* new_prefs, const simData::LabelPrefs& old_prefs, entt::entity entity, SimulationContext& sim, entt::registry& registry)
+    //! Takes the visual components off an entity leaving the view, keeping
+    //! them for reuse. Its data state stays as it is.
+    void releaseVisuals(entt::entity entity, SimulationContext& sim, entt::registry& registry)
     {
-        if (VALUE_CHANGED(overlayfontname, *new_prefs, old_prefs))
+        sim.components.release(entity, registry);
+        registry.remove<PendingIcon>(entity);
+        registry.remove<PendingFont>(entity);
+        if (auto* declutter = registry.try_get<DeclutterLabel>(entity))
         {
-            auto& font = sim.get_font(new_prefs->overlayfontname());
-            if (font)
+            declutter->hidden = false;
+            declutter->text.clear();
+        }
+    }
+
+    //! Patches the labels of entities whose font finished loading.
+    void applyLoadedFonts(entt::registry& registry)
+    {
+        std::vector<entt::entity> loaded;
+        for (auto [entity, pending] : registry.view<PendingFont>().each())
+        {
+            if (pending.asset->ready())
             {
-                auto& label = registry.get_or_emplace<rocky::Label>(entity);
-                label.style.font = font;
-                label.dirty();
+                applyFont(pending.asset->value, entity, registry);
+                loaded.emplace_back(entity);
             }
         }
+        for (auto entity : loaded)
+        {
+            registry.remove<PendingFont>(entity);
+        }
+    }
 
-        if (VALUE_CHANGED(overlayfontpointsize , *new_prefs, old_prefs))
+private:
+    //! Applies the 'changes' label fields of 'state' to the entity's Label.
+    void applyLabel(const CommonPrefsState& state, ChangeMask changes, entt::entity entity, SimulationContext& sim, entt::registry& registry)
+    {
+        if (changes & CommonPrefsState::NAME)
         {
-            auto& label = registry.get_or_emplace<rocky::Label>(entity);
-            label.style.pointSize = new_prefs->overlayfontpointsize();
+            // a label hidden by the declutter keeps its text aside until shown
+            auto& label = sim.components.get_or_emplace<rocky::Label>(entity, registry);
+            auto& declutter = registry.get_or_emplace<DeclutterLabel>(entity);
+            (declutter.hidden ? declutter.text : label.text) = state.name;
+            if (!label.style.font && sim.runtime) label.style.font = sim.runtime->defaultFont;
             label.dirty();
         }
 
-        if (VALUE_CHANGED(alignment, *new_prefs, old_prefs))
+        if (changes & CommonPrefsState::FONT)
         {
-            auto& label = registry.get_or_emplace<rocky::Label>(entity);
-            auto align = new_prefs->alignment();
+            auto font = sim.get_font(state.overlayfontname);
+            if (font->ready())
+            {
+                registry.remove<PendingFont>(entity);
+                applyFont(font->value, entity, registry);
+            }
+            else
+            {
+                registry.emplace_or_replace<PendingFont>(entity, font);
+            }
+        }
+
+        if (changes & CommonPrefsState::FONT_SIZE)
+        {
+            auto& label = sim.components.get_or_emplace<rocky::Label>(entity, registry);
+            label.style.pointSize = state.overlayfontpointsize;
+            label.dirty();
+        }
+
+        if (changes & CommonPrefsState::ALIGNMENT)
+        {
+            auto& label = sim.components.get_or_emplace<rocky::Label>(entity, registry);
+            auto align = state.alignment;
             switch (align) {
             case simData::TextAlignment::ALIGN_RIGHT_CENTER:
                 label.style.horizontalAlignment = vsg::StandardLayout::RIGHT_ALIGNMENT;
                 label.style.verticalAlignment = vsg::StandardLayout::CENTER_ALIGNMENT;
                 break;
             }
+            label.dirty();
+        }
+    }
+
+    void applyFont(vsg::ref_ptr<vsg::Font> font, entt::entity entity, entt::registry& registry)
+    {
+        if (font)
+        {
+            auto& label = registry.get_or_emplace<rocky::Label>(entity);
+            label.style.font = font;
+            label.dirty();
         }
     }
 };
@@ -0,0 +1,400 @@
+#pragma once
+#include "DataStoreAdapter.h"
+#include "SpscRing.h"
+#include <simData/DataStore.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+
+//! Properties and/or prefs of one entity, copied out of the DataStore on the
+//! simulation thread.
+template<class PROPS, class PREFS>
+struct EntityMessages
+{
+    bool added = false;             // create the entity from 'props'
+    std::unique_ptr<PROPS> props;   // set if added or the properties changed
+    std::unique_ptr<PREFS> prefs;   // set if the prefs changed
+};
+
+using PlatformMessages = EntityMessages<simData::PlatformProperties, simData::PlatformPrefs>;
+using BeamMessages = EntityMessages<simData::BeamProperties, simData::BeamPrefs>;
+using GateMessages = EntityMessages<simData::GateProperties, simData::GatePrefs>;
+
+//! Removal of an entity (and whatever it hosts) from the DataStore.
+struct EntityRemoved
+{
+};
+
+//! One change published by the simulation thread. A time update carries just
+//! the entity's hot state (a few doubles); properties and prefs, which change
+//! rarely, carry heap copies of the messages.
+struct SimDelta
+{
+    simData::ObjectId id = 0;
+    std::variant<std::monostate, Platform, Beam, Gate,
+        std::unique_ptr<PlatformMessages>,
+        std::unique_ptr<BeamMessages>,
+        std::unique_ptr<GateMessages>,
+        EntityRemoved> value;
+};
+
+
+//! Runs the DataStore on its own thread, so interpolation and slice work stay
+//! off the render thread.
+//!
+//! Once started, the simulation thread owns the DataStore: it calls the tick
+//! function (which typically advances the DataStore's time and may add data),
+//! then publishes what changed as SimDeltas on a lock-free single-producer,
+//! single-consumer ring. The render thread calls apply() once per frame to
+//! drain the ring into the registry through a DataStoreAdapter, which must not
+//! itself be registered as a listener of the DataStore.
+//!
+//! Entities already in the DataStore at construction are published on the
+//! first tick. create() registers the thread as a DataStore listener; remove
+//! it with removeListener() as usual when done.
+class SimulationThread : public simData::DataStore::DefaultListener
+{
+public:
+    using Tick = std::function<void(simData::DataStore&)>;
+
+    static std::shared_ptr<SimulationThread> create(simData::DataStore& ds, std::size_t capacity = 65536u)
+    {
+        std::shared_ptr<SimulationThread> thread(new SimulationThread(ds, capacity));
+        ds.addListener(thread);
+        return thread;
+    }
+
+    ~SimulationThread()
+    {
+        stop();
+    }
+
+    //! Starts calling tick(ds) every 'period' on the simulation thread.
+    void start(Tick tick, std::chrono::duration<double> period)
+    {
+        stop();
+        stopping = false;
+        thread = std::thread([this, tick, period]()
+            {
+                auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(period);
+                auto next = std::chrono::steady_clock::now();
+                while (!stopping)
+                {
+                    tick(ds);
+                    publish();
+                    next += interval;
+                    std::this_thread::sleep_until(next);
+                }
+            });
+    }
+
+    //! Stops the simulation thread; the DataStore may be used from other
+    //! threads again afterwards. Deltas already published stay queued.
+    void stop()
+    {
+        stopping = true;
+        if (thread.joinable())
+            thread.join();
+    }
+
+    //! Render thread: applies up to max_deltas published deltas to the
+    //! adapter's registry, under one write lock, stopping early when the
+    //! adapter's frame_budget runs out. Limiting the work spreads a large
+    //! burst over several frames instead of stalling one. Deltas are applied
+    //! in the order they were published, so there is no in-view priority here.
+    //! The view-driven work of DataStoreAdapter::finishUpdate() (visuals
+    //! following the camera, tracks, the snapshot) runs every frame, even
+    //! when no deltas are waiting.
+    //! @return number of deltas applied
+    std::size_t apply(DataStoreAdapter& adapter, std::size_t max_deltas = std::numeric_limits<std::size_t>::max())
+    {
+        FrameBudget budget(adapter.frame_budget);
+        adapter.applyLoadedAssets();
+
+        auto& sim = adapter.sim;
+        ScopedTimer timer(adapter.stats, FrameStats::SIM_APPLY);
+
+        ScopedTimer waiting(adapter.stats, FrameStats::LOCK_WAIT);
+        auto [lock, registry] = adapter.ecs.write();
+        waiting.stop();
+
+        std::size_t count = 0;
+        SimDelta delta;
+        while (count < max_deltas && ring.pop(delta))
+        {
+            ++count;
+
+            if (auto* state = std::get_if<Platform>(&delta.value))
+            {
+                auto entity = sim.entities[delta.id];
+                if (entity != entt::null)
+                {
+                    adapter.platforms.commitUpdate(entity, adapter.platforms.applyUpdate(*state, entity, registry), sim, registry);
+                    adapter.snapshots.markDirty(entity);
+                }
+            }
+            else if (auto* state = std::get_if<Beam>(&delta.value))
+            {
+                auto entity = sim.entities[delta.id];
+                if (entity != entt::null)
+                {
+                    adapter.beams.commitUpdate(entity, adapter.beams.applyUpdate(*state, entity, registry), sim);
+                    adapter.snapshots.markDirty(entity);
+                }
+            }
+            else if (auto* state = std::get_if<Gate>(&delta.value))
+            {
+                auto entity = sim.entities[delta.id];
+                if (entity != entt::null)
+                {
+                    adapter.gates.commitUpdate(entity, adapter.gates.applyUpdate(*state, entity, registry), registry);
+                    adapter.snapshots.markDirty(entity);
+                }
+            }
+            else if (auto* messages = std::get_if<std::unique_ptr<PlatformMessages>>(&delta.value))
+            {
+                applyMessages(**messages, delta.id, adapter.platforms, adapter.snapshots, sim, registry);
+            }
+            else if (auto* messages = std::get_if<std::unique_ptr<BeamMessages>>(&delta.value))
+            {
+                applyMessages(**messages, delta.id, adapter.beams, adapter.snapshots, sim, registry);
+            }
+            else if (auto* messages = std::get_if<std::unique_ptr<GateMessages>>(&delta.value))
+            {
+                applyMessages(**messages, delta.id, adapter.gates, adapter.snapshots, sim, registry);
+            }
+            else if (std::holds_alternative<EntityRemoved>(delta.value))
+            {
+                adapter.removeEntity(delta.id, registry);
+            }
+
+            if (count % 64u == 0 && budget.exhausted())
+                break;
+        }
+
+        timer.stop();
+        adapter.stats.count(FrameStats::DELTAS_APPLIED, count);
+
+        adapter.finishUpdate(registry);
+        return count;
+    }
+
+    //! Number of published deltas waiting for apply()
+    std::size_t pending() const
+    {
+        return ring.size();
+    }
+
+    // DataStore listener, called on whichever thread is changing the DataStore
+
+    void onAddEntity(simData::DataStore* ds_, simData::ObjectId id, simData::ObjectType type) override
+    {
+        events.push(id, type, EventQueue::ADDED);
+    }
+
+    void onPropertiesChange(simData::DataStore* ds_, simData::ObjectId id) override
+    {
+        events.push(id, simData::NONE, EventQueue::PROPS);
+    }
+
+    void onPrefsChange(simData::DataStore* ds_, simData::ObjectId id) override
+    {
+        events.push(id, simData::NONE, EventQueue::PREFS);
+    }
+
+    //! Called on the simulation thread (which is changing the DataStore). The
+    //! entity's slice is freed when this returns, so its record goes now.
+    void onRemoveEntity(simData::DataStore* ds_, simData::ObjectId id, simData::ObjectType type) override
+    {
+        platform_updates.erase(id);
+        beam_updates.erase(id);
+        gate_updates.erase(id);
+        events.push(id, type, EventQueue::REMOVED);
+    }
+
+    void onScenarioDelete(simData::DataStore* ds_) override
+    {
+        simData::DataStore::IdList ids;
+        ds_->idList(&ids);
+        for (auto id : ids)
+            onRemoveEntity(ds_, id, ds_->objectType(id));
+    }
+
+    void onTimeChange(simData::DataStore* ds_) override
+    {
+        platform_updates.collectChanged();
+        beam_updates.collectChanged();
+        gate_updates.collectChanged();
+    }
+
+private:
+    simData::DataStore& ds;
+    SpscRing<SimDelta> ring;
+    EventQueue events;
+    std::vector<EventQueue::Event> publishing;
+    UpdateList<simData::PlatformUpdateSlice> platform_updates;
+    UpdateList<simData::BeamUpdateSlice> beam_updates;
+    UpdateList<simData::GateUpdateSlice> gate_updates;
+    std::thread thread;
+    std::atomic<bool> stopping = { false };
+
+    SimulationThread(simData::DataStore& ds_, std::size_t capacity) :
+        ds(ds_),
+        ring(capacity)
+    {
+        simData::DataStore::IdList ids;
+        ds.idList(&ids);
+        for (auto id : ids)
+        {
+            events.push(id, ds.objectType(id), EventQueue::ADDED | EventQueue::PREFS);
+        }
+    }
+
+    //! Blocks (yielding) while the render thread catches up.
+    void send(SimDelta&& delta)
+    {
+        while (!ring.push(std::move(delta)))
+        {
+            if (stopping)
+                return;
+            std::this_thread::yield();
+        }
+    }
+
+    //! Publishes the entities added or changed since the last call, then the
+    //! time updates, so the render thread always creates an entity before it
+    //! sees its first update.
+    void publish()
+    {
+        if (events.take(publishing))
+        {
+            for (auto& event : publishing)
+            {
+                // an entity added and removed between publishes is never sent
+                if (event.changes & EventQueue::REMOVED)
+                {
+                    if (!(event.changes & EventQueue::ADDED))
+                        send({ event.id, EntityRemoved{} });
+                    continue;
+                }
+
+                auto type = event.type != simData::NONE ? event.type : ds.objectType(event.id);
+
+                if (type & simData::PLATFORM)
+                {
+                    send({ event.id, copyMessages<PlatformMessages>(event,
+                        [&](simData::DataStore::Transaction* x) { return ds.platformProperties(event.id, x); },
+                        [&](simData::DataStore::Transaction* x) { return ds.platformPrefs(event.id, x); }) });
+                    if (event.changes & EventQueue::ADDED)
+                        platform_updates.add({ event.id, entt::null, ds.platformUpdateSlice(event.id) });
+                }
+                else if (type & simData::BEAM)
+                {
+                    send({ event.id, copyMessages<BeamMessages>(event,
+                        [&](simData::DataStore::Transaction* x) { return ds.beamProperties(event.id, x); },
+                        [&](simData::DataStore::Transaction* x) { return ds.beamPrefs(event.id, x); }) });
+                    if (event.changes & EventQueue::ADDED)
+                        beam_updates.add({ event.id, entt::null, ds.beamUpdateSlice(event.id) });
+                }
+                else if (type & simData::GATE)
+                {
+                    send({ event.id, copyMessages<GateMessages>(event,
+                        [&](simData::DataStore::Transaction* x) { return ds.gateProperties(event.id, x); },
+                        [&](simData::DataStore::Transaction* x) { return ds.gatePrefs(event.id, x); }) });
+                    if (event.changes & EventQueue::ADDED)
+                        gate_updates.add({ event.id, entt::null, ds.gateUpdateSlice(event.id) });
+                }
+            }
+        }
+
+        publishUpdates(platform_updates);
+        publishUpdates(beam_updates);
+        publishUpdates(gate_updates);
+    }
+
+    template<class MESSAGES, class PROPS_FUNC, class PREFS_FUNC>
+    std::unique_ptr<MESSAGES> copyMessages(const EventQueue::Event& event, PROPS_FUNC props_func, PREFS_FUNC prefs_func)
+    {
+        auto messages = std::make_unique<MESSAGES>();
+        messages->added = (event.changes & EventQueue::ADDED) != 0;
+
+        if (event.changes & (EventQueue::ADDED | EventQueue::PROPS))
+        {
+            simData::DataStore::Transaction x;
+            auto props = props_func(&x);
+            if (props)
+                messages->props = std::make_unique<std::decay_t<decltype(*props)>>(*props);
+            x.complete(&props);
+        }
+
+        if (event.changes & EventQueue::PREFS)
+        {
+            simData::DataStore::Transaction x;
+            auto prefs = prefs_func(&x);
+            if (prefs)
+                messages->prefs = std::make_unique<std::decay_t<decltype(*prefs)>>(*prefs);
+            x.complete(&prefs);
+        }
+
+        return messages;
+    }
+
+    template<class SLICE>
+    void publishUpdates(UpdateList<SLICE>& updates)
+    {
+        for (auto i : updates.dirty)
+        {
+            auto& record = updates.records[i];
+            if (!record.slice)
+                continue;
+            SimDelta delta{ record.id };
+            if constexpr (std::is_same_v<SLICE, simData::PlatformUpdateSlice>)
+                delta.value = latest<Platform>(*record.slice->current());
+            else if constexpr (std::is_same_v<SLICE, simData::BeamUpdateSlice>)
+                delta.value = latest<Beam>(*record.slice->current());
+            else
+                delta.value = latest<Gate>(*record.slice->current());
+            send(std::move(delta));
+        }
+        updates.consume(updates.dirty.size());
+    }
+
+    //! Hot state holding every field present in an update
+    template<class STATE, class UPDATE>
+    static STATE latest(const UPDATE& update)
+    {
+        STATE state;
+        state.store(update, state.diff(update));
+        return state;
+    }
+
+    template<class MESSAGES, class ADAPTER>
+    static void applyMessages(MESSAGES& messages, simData::ObjectId id, ADAPTER& adapter, SnapshotBuffer& snapshots, SimulationContext& sim, entt::registry& registry)
+    {
+        if (messages.added)
+        {
+            if (adapter.create(messages.props.get(), sim, registry) == entt::null)
+                return;
+            snapshots.rebuild();
+        }
+        else if (messages.props)
+        {
+            adapter.applyProps(messages.props.get(), sim, registry);
+        }
+
+        if (messages.prefs && sim.entities.contains(id))
+        {
+            adapter.applyPrefs(messages.prefs.get(), id, sim, registry);
+            snapshots.markDirty(sim.entities[id]);
+        }
+    }
+};
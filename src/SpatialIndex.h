@@ -0,0 +1,499 @@
+#pragma once
+#include <simData/ObjectId.h>
+#include <entt/entt.hpp>
+#include <vsg/maths/vec3.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+
+//! Hashed uniform grid of entity positions (ECEF), for range queries and
+//! picking without scanning every entity.
+//!
+//! The render thread moves entities with move(), which only queues the new
+//! position, then calls apply() once per frame to fold the queued moves into
+//! the grid under one exclusive lock. A move within a cell just updates the
+//! position; a move across cells is a swap-remove from one cell's vector and
+//! an append to another's, so maintenance is O(1) per moving entity. Each
+//! occupied cell is also counted in 'levels' coarser blocks (2x2x2 cells, then
+//! 4x4x4, and so on), updated only when a cell empties or fills, so frustum
+//! queries can skip empty space a block at a time.
+//!
+//! Queries take a shared lock and may run on any thread. They see the grid as
+//! of the last apply().
+class SpatialIndex
+{
+public:
+    struct Hit
+    {
+        simData::ObjectId id = 0;
+        entt::entity entity = entt::null;
+        vsg::dvec3 position;
+        double distance = 0.0;  // from the query point (0 for frustum queries)
+    };
+
+    //! Plane (x, y, z) . p + w = 0, with the inside where it is >= 0
+    using Plane = vsg::dvec4;
+
+    SpatialIndex(double cell_size_ = 50000.0) :
+        cell_size(cell_size_),
+        inverse_cell_size(1.0 / cell_size_)
+    {
+        //nop
+    }
+
+    //! Queues a new position for an entity, adding it if it is not indexed.
+    //! Render thread only; takes effect at the next apply().
+    void move(entt::entity entity, simData::ObjectId id, const vsg::dvec3& position)
+    {
+        pending.push_back({ entity, id, position, false });
+    }
+
+    //! Queues the removal of an entity. Render thread only.
+    void erase(entt::entity entity)
+    {
+        pending.push_back({ entity, 0, {}, true });
+    }
+
+    //! Applies the queued moves and removals. Render thread only.
+    void apply()
+    {
+        if (pending.empty())
+            return;
+
+        std::unique_lock<std::shared_mutex> lock(mutex);
+        for (auto& change : pending)
+        {
+            if (change.erase)
+                remove(change.entity);
+            else
+                place(change.entity, change.id, change.position);
+        }
+        pending.clear();
+    }
+
+    //! Number of indexed entities (as of the last apply())
+    std::size_t size() const
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        return count;
+    }
+
+    //! Entities within 'radius' meters of 'center', nearest first.
+    void radius(const vsg::dvec3& center, double radius, std::vector<Hit>& out) const
+    {
+        out.clear();
+        std::shared_lock<std::shared_mutex> lock(mutex);
+
+        auto r2 = radius * radius;
+        auto lo = cellOf(center - vsg::dvec3(radius, radius, radius));
+        auto hi = cellOf(center + vsg::dvec3(radius, radius, radius));
+        visitBox(lo, hi, [&](const Cell& cell)
+            {
+                for (auto slot : cell.slots)
+                {
+                    auto& entry = entries[slot];
+                    auto d2 = distance2(entry.position, center);
+                    if (d2 <= r2)
+                        out.push_back({ entry.id, entry.entity, entry.position, std::sqrt(d2) });
+                }
+            });
+
+        std::sort(out.begin(), out.end(), [](const Hit& a, const Hit& b) { return a.distance < b.distance; });
+    }
+
+    //! The k entities nearest to 'center', nearest first.
+    void nearest(const vsg::dvec3& center, std::size_t k, std::vector<Hit>& out) const
+    {
+        out.clear();
+        if (k == 0u)
+            return;
+
+        std::shared_lock<std::shared_mutex> lock(mutex);
+        if (count == 0u)
+            return;
+
+        // search shells of cells around the center's cell until the k-th best
+        // is closer than anything the next shell could hold
+        auto by_distance = [](const Hit& a, const Hit& b) { return a.distance < b.distance; };
+        auto c = cellOf(center);
+        for (std::int64_t ring = 0; ; ++ring)
+        {
+            visitShell(c, ring, [&](const Cell& cell)
+                {
+                    for (auto slot : cell.slots)
+                    {
+                        auto& entry = entries[slot];
+                        auto d = std::sqrt(distance2(entry.position, center));
+                        if (out.size() < k)
+                        {
+                            out.push_back({ entry.id, entry.entity, entry.position, d });
+                            std::push_heap(out.begin(), out.end(), by_distance);
+                        }
+                        else if (d < out.front().distance)
+                        {
+                            std::pop_heap(out.begin(), out.end(), by_distance);
+                            out.back() = { entry.id, entry.entity, entry.position, d };
+                            std::push_heap(out.begin(), out.end(), by_distance);
+                        }
+                    }
+                });
+
+            bool covered = c.x - ring <= bounds_lo.x && c.y - ring <= bounds_lo.y && c.z - ring <= bounds_lo.z &&
+                c.x + ring >= bounds_hi.x && c.y + ring >= bounds_hi.y && c.z + ring >= bounds_hi.z;
+            if (covered || (out.size() == k && out.front().distance <= (double)ring * cell_size))
+                break;
+        }
+
+        std::sort_heap(out.begin(), out.end(), by_distance);
+    }
+
+    //! Entities inside every plane, e.g. the six planes of a view or pick
+    //! frustum in ECEF. Descends from the coarsest occupied blocks into the
+    //! occupied blocks and cells that overlap the frustum, so the cost follows
+    //! the occupied cells in view (times 'levels' at the frustum's edges), not
+    //! the number of indexed entities. Entities in blocks wholly inside are
+    //! taken without testing them.
+    void frustum(const std::vector<Plane>& planes, std::vector<Hit>& out) const
+    {
+        out.clear();
+        std::shared_lock<std::shared_mutex> lock(mutex);
+
+        for (auto& [key, block] : blocks[levels - 1])
+            visitFrustum(levels, block.coord, planes, false, out);
+    }
+
+private:
+    struct Coord
+    {
+        std::int64_t x = 0, y = 0, z = 0;
+    };
+
+    struct Cell
+    {
+        Coord coord;
+        std::vector<std::uint32_t> slots;   // into entries
+    };
+
+    struct Block
+    {
+        Coord coord;                        // in blocks of its level
+        std::uint32_t cells = 0u;           // occupied cells inside
+    };
+
+    struct Entry
+    {
+        entt::entity entity = entt::null;
+        simData::ObjectId id = 0;
+        vsg::dvec3 position;
+        std::uint64_t key = 0u;             // cell
+        std::uint32_t index = 0u;           // within the cell's slots
+    };
+
+    struct Change
+    {
+        entt::entity entity;
+        simData::ObjectId id;
+        vsg::dvec3 position;
+        bool erase;
+    };
+
+    static constexpr std::uint32_t none = ~0u;
+
+    //! coarser block levels; the coarsest blocks are 2^levels cells a side
+    static constexpr int levels = 8;
+
+    double cell_size;
+    double inverse_cell_size;
+
+    mutable std::shared_mutex mutex;
+    std::unordered_map<std::uint64_t, Cell> cells;
+    std::unordered_map<std::uint64_t, Block> blocks[levels];   // [l]: 2^(l+1) cells a side
+    std::vector<Entry> entries;             // dense; swap-removed
+    std::vector<std::uint32_t> slot_of;     // by entity slot, into entries
+    std::size_t count = 0u;
+    Coord bounds_lo, bounds_hi;             // of every cell ever occupied
+
+    std::vector<Change> pending;
+
+    static std::size_t index(entt::entity entity)
+    {
+        return (std::size_t)entt::to_entity(entity);
+    }
+
+    static double distance2(const vsg::dvec3& a, const vsg::dvec3& b)
+    {
+        auto d = a - b;
+        return d.x * d.x + d.y * d.y + d.z * d.z;
+    }
+
+    static double signedDistance(const Plane& plane, const vsg::dvec3& p)
+    {
+        return plane.x * p.x + plane.y * p.y + plane.z * p.z + plane.w;
+    }
+
+    Coord cellOf(const vsg::dvec3& p) const
+    {
+        return {
+            (std::int64_t)std::floor(p.x * inverse_cell_size),
+            (std::int64_t)std::floor(p.y * inverse_cell_size),
+            (std::int64_t)std::floor(p.z * inverse_cell_size) };
+    }
+
+    vsg::dvec3 cellMin(const Coord& c) const
+    {
+        return vsg::dvec3((double)c.x * cell_size, (double)c.y * cell_size, (double)c.z * cell_size);
+    }
+
+    //! Coordinates of the block of 2^level cells a side holding cell c
+    static Coord blockOf(const Coord& c, int level)
+    {
+        return { c.x >> level, c.y >> level, c.z >> level };
+    }
+
+    //! 21 bits per axis; enough for ECEF at cell sizes down to about 10 m
+    static std::uint64_t keyOf(const Coord& c)
+    {
+        auto bits = [](std::int64_t v) { return (std::uint64_t)(v + (1 << 20)) & 0x1fffffu; };
+        return bits(c.x) | (bits(c.y) << 21) | (bits(c.z) << 42);
+    }
+
+    void place(entt::entity entity, simData::ObjectId id, const vsg::dvec3& position)
+    {
+        auto i = index(entity);
+        if (i >= slot_of.size())
+            slot_of.resize(i + 1u, none);
+
+        auto coord = cellOf(position);
+        auto key = keyOf(coord);
+
+        auto slot = slot_of[i];
+        if (slot != none && entries[slot].entity == entity)
+        {
+            auto& entry = entries[slot];
+            entry.position = position;
+            entry.id = id;
+            if (entry.key == key)
+                return;
+            unlink(slot);
+            link(slot, key, coord);
+            return;
+        }
+
+        slot = (std::uint32_t)entries.size();
+        entries.push_back({ entity, id, position, key, 0u });
+        slot_of[i] = slot;
+        link(slot, key, coord);
+        ++count;
+    }
+
+    void remove(entt::entity entity)
+    {
+        auto i = index(entity);
+        if (i >= slot_of.size() || slot_of[i] == none || entries[slot_of[i]].entity != entity)
+            return;
+
+        auto slot = slot_of[i];
+        unlink(slot);
+        slot_of[i] = none;
+
+        // keep entries dense: move the last one into the hole
+        auto last = (std::uint32_t)entries.size() - 1u;
+        if (slot != last)
+        {
+            auto& moved = entries[last];
+            cells[moved.key].slots[moved.index] = slot;
+            slot_of[index(moved.entity)] = slot;
+            entries[slot] = moved;
+        }
+        entries.pop_back();
+        --count;
+    }
+
+    void link(std::uint32_t slot, std::uint64_t key, const Coord& coord)
+    {
+        auto& cell = cells[key];
+        if (cell.slots.empty())
+        {
+            cell.coord = coord;
+            for (int l = 0; l < levels; ++l)
+            {
+                auto block_coord = blockOf(coord, l + 1);
+                auto& block = blocks[l][keyOf(block_coord)];
+                block.coord = block_coord;
+                ++block.cells;
+            }
+            if (cells.size() == 1u && count == 0u)
+            {
+                bounds_lo = bounds_hi = coord;
+            }
+            else
+            {
+                bounds_lo = { std::min(bounds_lo.x, coord.x), std::min(bounds_lo.y, coord.y), std::min(bounds_lo.z, coord.z) };
+                bounds_hi = { std::max(bounds_hi.x, coord.x), std::max(bounds_hi.y, coord.y), std::max(bounds_hi.z, coord.z) };
+            }
+        }
+        auto& entry = entries[slot];
+        entry.key = key;
+        entry.index = (std::uint32_t)cell.slots.size();
+        cell.slots.push_back(slot);
+    }
+
+    void unlink(std::uint32_t slot)
+    {
+        auto& entry = entries[slot];
+        auto cell = cells.find(entry.key);
+        auto& slots = cell->second.slots;
+
+        // swap-remove from the cell
+        auto last = slots.back();
+        slots[entry.index] = last;
+        entries[last].index = entry.index;
+        slots.pop_back();
+
+        if (slots.empty())
+        {
+            for (int l = 0; l < levels; ++l)
+            {
+                auto block = blocks[l].find(keyOf(blockOf(cell->second.coord, l + 1)));
+                if (--block->second.cells == 0u)
+                    blocks[l].erase(block);
+            }
+            cells.erase(cell);
+        }
+    }
+
+    //! Adds the entities inside 'planes' from the block at 'c' of the given
+    //! level (0 being a single cell), descending into its occupied children.
+    //! 'inside' means the block is known to be inside every plane.
+    void visitFrustum(int level, const Coord& c, const std::vector<Plane>& planes, bool inside, std::vector<Hit>& out) const
+    {
+        if (!inside)
+        {
+            // outside a plane when the corner furthest along its normal is;
+            // inside all of them when the nearest corners are
+            auto size = cell_size * (double)(std::int64_t(1) << level);
+            vsg::dvec3 lo((double)c.x * size, (double)c.y * size, (double)c.z * size);
+            inside = true;
+            for (auto& plane : planes)
+            {
+                vsg::dvec3 outer(
+                    plane.x >= 0.0 ? lo.x + size : lo.x,
+                    plane.y >= 0.0 ? lo.y + size : lo.y,
+                    plane.z >= 0.0 ? lo.z + size : lo.z);
+                if (signedDistance(plane, outer) < 0.0)
+                    return;
+                vsg::dvec3 inner(
+                    plane.x >= 0.0 ? lo.x : lo.x + size,
+                    plane.y >= 0.0 ? lo.y : lo.y + size,
+                    plane.z >= 0.0 ? lo.z : lo.z + size);
+                if (signedDistance(plane, inner) < 0.0)
+                    inside = false;
+            }
+        }
+
+        if (level == 0)
+        {
+            auto cell = cells.find(keyOf(c));
+            if (cell == cells.end())
+                return;
+            for (auto slot : cell->second.slots)
+            {
+                auto& entry = entries[slot];
+                bool in = inside;
+                if (!in)
+                {
+                    in = true;
+                    for (auto& plane : planes)
+                    {
+                        if (signedDistance(plane, entry.position) < 0.0)
+                        {
+                            in = false;
+                            break;
+                        }
+                    }
+                }
+                if (in)
+                    out.push_back({ entry.id, entry.entity, entry.position, 0.0 });
+            }
+            return;
+        }
+
+        for (std::int64_t dx = 0; dx < 2; ++dx)
+            for (std::int64_t dy = 0; dy < 2; ++dy)
+                for (std::int64_t dz = 0; dz < 2; ++dz)
+                {
+                    Coord child = { c.x * 2 + dx, c.y * 2 + dy, c.z * 2 + dz };
+                    if (level == 1 || blocks[level - 2].count(keyOf(child)))
+                        visitFrustum(level - 1, child, planes, inside, out);
+                }
+    }
+
+    template<class FUNC>
+    void visitCell(std::int64_t x, std::int64_t y, std::int64_t z, FUNC& func) const
+    {
+        auto i = cells.find(keyOf({ x, y, z }));
+        if (i != cells.end())
+            func(i->second);
+    }
+
+    //! Calls func(cell) for each occupied cell in the box [lo, hi]; walks the
+    //! occupied cells instead when there are fewer of them than in the box.
+    template<class FUNC>
+    void visitBox(const Coord& lo, const Coord& hi, FUNC func) const
+    {
+        auto span = [](std::int64_t a, std::int64_t b) { return (double)(b - a + 1); };
+        if (span(lo.x, hi.x) * span(lo.y, hi.y) * span(lo.z, hi.z) > (double)cells.size())
+        {
+            for (auto& [key, cell] : cells)
+            {
+                auto& c = cell.coord;
+                if (c.x >= lo.x && c.x <= hi.x && c.y >= lo.y && c.y <= hi.y && c.z >= lo.z && c.z <= hi.z)
+                    func(cell);
+            }
+            return;
+        }
+
+        for (auto x = lo.x; x <= hi.x; ++x)
+            for (auto y = lo.y; y <= hi.y; ++y)
+                for (auto z = lo.z; z <= hi.z; ++z)
+                    visitCell(x, y, z, func);
+    }
+
+    //! Calls func(cell) for each occupied cell at Chebyshev distance 'ring'
+    //! from c, within the occupied bounds.
+    template<class FUNC>
+    void visitShell(const Coord& c, std::int64_t ring, FUNC func) const
+    {
+        Coord lo = { std::max(c.x - ring, bounds_lo.x), std::max(c.y - ring, bounds_lo.y), std::max(c.z - ring, bounds_lo.z) };
+        Coord hi = { std::min(c.x + ring, bounds_hi.x), std::min(c.y + ring, bounds_hi.y), std::min(c.z + ring, bounds_hi.z) };
+        if (lo.x > hi.x || lo.y > hi.y || lo.z > hi.z)
+            return;
+
+        for (auto x = lo.x; x <= hi.x; ++x)
+        {
+            for (auto y = lo.y; y <= hi.y; ++y)
+            {
+                bool face = x == c.x - ring || x == c.x + ring || y == c.y - ring || y == c.y + ring;
+                if (face)
+                {
+                    for (auto z = lo.z; z <= hi.z; ++z)
+                        visitCell(x, y, z, func);
+                }
+                else
+                {
+                    if (c.z - ring >= lo.z)
+                        visitCell(x, y, c.z - ring, func);
+                    if (ring > 0 && c.z + ring <= hi.z)
+                        visitCell(x, y, c.z + ring, func);
+                }
+            }
+        }
+    }
+};
@@ -0,0 +1,95 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+
+//! Bounded lock-free ring buffer for exactly one producer thread and one
+//! consumer thread. Capacity is rounded up to a power of two.
+//!
+//! Each side only writes its own index and reads the other's with
+//! acquire/release ordering, so a push is visible to the consumer together
+//! with everything the producer wrote before it. Each side also caches the
+//! other's index and re-reads it only when the ring looks full (or empty),
+//! so the two cache lines are touched rarely.
+template<class T>
+class SpscRing
+{
+public:
+    SpscRing(std::size_t capacity_ = 65536u)
+    {
+        std::size_t capacity = 2u;
+        while (capacity < capacity_)
+            capacity <<= 1;
+        mask = capacity - 1u;
+        slots.reset(new T[capacity]);
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    //! Producer: appends a value unless the ring is full.
+    //! @return false if full (the value is left untouched)
+    bool push(T&& value)
+    {
+        auto t = tail.value.load(std::memory_order_relaxed);
+        if (t - cached_head >= capacity())
+        {
+            cached_head = head.value.load(std::memory_order_acquire);
+            if (t - cached_head >= capacity())
+                return false;
+        }
+        slots[t & mask] = std::move(value);
+        tail.value.store(t + 1u, std::memory_order_release);
+        return true;
+    }
+
+    //! Consumer: removes the oldest value, if there is one.
+    //! @return false if empty
+    bool pop(T& value)
+    {
+        auto h = head.value.load(std::memory_order_relaxed);
+        if (h == cached_tail)
+        {
+            cached_tail = tail.value.load(std::memory_order_acquire);
+            if (h == cached_tail)
+                return false;
+        }
+        value = std::move(slots[h & mask]);
+        head.value.store(h + 1u, std::memory_order_release);
+        return true;
+    }
+
+    //! Approximate number of queued values; exact when called by either side
+    //! while the other is idle.
+    std::size_t size() const
+    {
+        return tail.value.load(std::memory_order_acquire) - head.value.load(std::memory_order_acquire);
+    }
+
+    bool empty() const
+    {
+        return size() == 0u;
+    }
+
+    std::size_t capacity() const
+    {
+        return mask + 1u;
+    }
+
+private:
+    // keeps the indices on separate cache lines
+    struct alignas(64) Index
+    {
+        std::atomic<std::size_t> value = { 0u };
+    };
+
+    std::unique_ptr<T[]> slots;
+    std::size_t mask = 0u;
+
+    Index head;                     // next slot to read; written by the consumer
+    alignas(64) std::size_t cached_tail = 0u;   // consumer's copy of tail
+    Index tail;                     // next slot to write; written by the producer
+    alignas(64) std::size_t cached_head = 0u;   // producer's copy of head
+};
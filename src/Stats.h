@@ -0,0 +1,348 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+
+//! Per-stage timers and counters for the frame pipeline, kept for the last
+//! few hundred frames.
+//!
+//! Stages and counters accumulate into the open frame from any thread (with
+//! relaxed atomics); endFrame() closes it into a ring buffer. Each timed
+//! scope is also kept as a span (up to max_spans per frame) for the Chrome
+//! trace export. Frames can be exported as JSON, CSV or Chrome trace events
+//! (load the file in chrome://tracing or Perfetto).
+//!
+//! Stats are off by default. When disabled, a ScopedTimer or count() costs one
+//! relaxed load and a branch: no clock reads, no writes.
+class FrameStats
+{
+public:
+    enum Stage : unsigned
+    {
+        DATASTORE_UPDATE,   // data_store.update(), including listener callbacks
+        LISTENER,           // onTimeChange dirty-set collection
+        FLUSH_EVENTS,       // applying queued add/properties/prefs events
+        LOADED_ASSETS,      // swapping in icons and fonts loaded in the background
+        LOCK_WAIT,          // waiting for the registry write lock
+        SIM_APPLY,          // draining simulation thread deltas
+        PLATFORM_UPDATES,
+        BEAM_UPDATES,
+        GATE_UPDATES,
+        VISUALS,            // materializing and releasing visual components
+        GATE_GEOMETRY,
+        HOST_PROPAGATION,
+        TRACKS,             // track history budget and line sync
+        SNAPSHOT,
+        DECLUTTER,          // label declutter, after the frame's update
+        STAGE_COUNT
+    };
+
+    enum Counter : unsigned
+    {
+        ENTITIES_UPDATED,
+        TRANSFORMS_DIRTIED, // hosted transforms rebuilt by the host graph
+        GEOMETRY_REBUILDS,
+        EVENTS_RECEIVED,
+        EVENTS_COALESCED,
+        DELTAS_APPLIED,
+        UPDATES_DEFERRED,   // time updates left for later frames by the frame budget
+        EVENTS_DEFERRED,    // listener events left for later frames by the frame budget
+        VISUALS_BUILT,      // entities given their visual components
+        VISUALS_RELEASED,   // entities whose visual components were released
+        COUNTER_COUNT
+    };
+
+    static constexpr std::size_t max_spans = 64u;
+
+    //! One timed scope, for the trace export
+    struct Span
+    {
+        Stage stage;
+        std::uint32_t thread;
+        std::int64_t start_ns;      // since the FrameStats was created
+        std::int64_t duration_ns;
+    };
+
+    struct Frame
+    {
+        std::uint64_t number = 0u;
+        std::int64_t start_ns = 0;
+        std::int64_t end_ns = 0;
+        std::array<std::int64_t, STAGE_COUNT> stage_ns = {};
+        std::array<std::uint64_t, COUNTER_COUNT> counters = {};
+        std::vector<Span> spans;
+    };
+
+    FrameStats(std::size_t history = 600u) :
+        ring(history > 0u ? history : 1u),
+        origin(std::chrono::steady_clock::now())
+    {
+        //nop
+    }
+
+    //! Turns collection on or off. Turning it on starts a new frame.
+    void setEnabled(bool value)
+    {
+        if (value && !enabled())
+        {
+            resetOpenFrame(now());
+        }
+        on.store(value, std::memory_order_relaxed);
+    }
+
+    bool enabled() const
+    {
+        return on.load(std::memory_order_relaxed);
+    }
+
+    //! Adds time to a stage of the open frame.
+    void add(Stage stage, std::int64_t start_ns, std::int64_t duration_ns)
+    {
+        stage_ns[stage].fetch_add(duration_ns, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(span_mutex);
+        if (spans.size() < max_spans)
+            spans.push_back({ stage, threadIndex(), start_ns, duration_ns });
+    }
+
+    //! Adds to a counter of the open frame.
+    void count(Counter counter, std::uint64_t value = 1u)
+    {
+        if (enabled())
+            counters[counter].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    //! Closes the open frame into the history and starts the next one.
+    void endFrame()
+    {
+        if (!enabled())
+            return;
+
+        auto end = now();
+        std::lock_guard<std::mutex> lock(ring_mutex);
+
+        auto& frame = ring[(std::size_t)(frames % ring.size())];
+        frame.number = frames++;
+        frame.start_ns = frame_start;
+        frame.end_ns = end;
+        for (unsigned i = 0; i < STAGE_COUNT; ++i)
+            frame.stage_ns[i] = stage_ns[i].exchange(0, std::memory_order_relaxed);
+        for (unsigned i = 0; i < COUNTER_COUNT; ++i)
+            frame.counters[i] = counters[i].exchange(0u, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> span_lock(span_mutex);
+            frame.spans.swap(spans);
+            spans.clear();
+        }
+        frame_start = end;
+    }
+
+    //! Copies of the recorded frames, oldest first.
+    std::vector<Frame> history() const
+    {
+        std::lock_guard<std::mutex> lock(ring_mutex);
+        std::vector<Frame> result;
+        auto count = (std::size_t)std::min<std::uint64_t>(frames, ring.size());
+        result.reserve(count);
+        for (auto n = frames - count; n < frames; ++n)
+            result.push_back(ring[(std::size_t)(n % ring.size())]);
+        return result;
+    }
+
+    //! Nanoseconds since the FrameStats was created
+    std::int64_t now() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+    static const char* name(Stage stage)
+    {
+        static const char* names[STAGE_COUNT] = {
+            "datastore_update", "listener", "flush_events", "loaded_assets", "lock_wait", "sim_apply",
+            "platform_updates", "beam_updates", "gate_updates", "visuals", "gate_geometry", "host_propagation", "tracks", "snapshot",
+            "declutter" };
+        return names[stage];
+    }
+
+    static const char* name(Counter counter)
+    {
+        static const char* names[COUNTER_COUNT] = {
+            "entities_updated", "transforms_dirtied", "geometry_rebuilds", "events_received", "events_coalesced", "deltas_applied",
+            "updates_deferred", "events_deferred", "visuals_built", "visuals_released" };
+        return names[counter];
+    }
+
+    //! {"stages": [...], "counters": [...], "frames": [{"frame", "start_us",
+    //! "duration_us", "stages_us": [...], "counters": [...]}, ...]}
+    void writeJSON(std::ostream& out) const
+    {
+        out << "{\n  \"stages\": [";
+        for (unsigned i = 0; i < STAGE_COUNT; ++i)
+            out << (i ? ", " : "") << '"' << name((Stage)i) << '"';
+        out << "],\n  \"counters\": [";
+        for (unsigned i = 0; i < COUNTER_COUNT; ++i)
+            out << (i ? ", " : "") << '"' << name((Counter)i) << '"';
+        out << "],\n  \"frames\": [";
+
+        bool first = true;
+        for (auto& frame : history())
+        {
+            out << (first ? "\n" : ",\n") << "    { \"frame\": " << frame.number
+                << ", \"start_us\": " << micros(frame.start_ns)
+                << ", \"duration_us\": " << micros(frame.end_ns - frame.start_ns)
+                << ", \"stages_us\": [";
+            for (unsigned i = 0; i < STAGE_COUNT; ++i)
+                out << (i ? ", " : "") << micros(frame.stage_ns[i]);
+            out << "], \"counters\": [";
+            for (unsigned i = 0; i < COUNTER_COUNT; ++i)
+                out << (i ? ", " : "") << frame.counters[i];
+            out << "] }";
+            first = false;
+        }
+        out << "\n  ]\n}\n";
+    }
+
+    //! One row per frame: frame, start and duration, then each stage (us)
+    //! and each counter.
+    void writeCSV(std::ostream& out) const
+    {
+        out << "frame,start_us,duration_us";
+        for (unsigned i = 0; i < STAGE_COUNT; ++i)
+            out << ',' << name((Stage)i) << "_us";
+        for (unsigned i = 0; i < COUNTER_COUNT; ++i)
+            out << ',' << name((Counter)i);
+        out << '\n';
+
+        for (auto& frame : history())
+        {
+            out << frame.number << ',' << micros(frame.start_ns) << ',' << micros(frame.end_ns - frame.start_ns);
+            for (unsigned i = 0; i < STAGE_COUNT; ++i)
+                out << ',' << micros(frame.stage_ns[i]);
+            for (unsigned i = 0; i < COUNTER_COUNT; ++i)
+                out << ',' << frame.counters[i];
+            out << '\n';
+        }
+    }
+
+    //! Chrome trace event format: a complete ("X") event per frame and per
+    //! timed span, and a counter ("C") event per frame.
+    void writeChromeTrace(std::ostream& out) const
+    {
+        out << "{\"traceEvents\":[\n";
+        bool first = true;
+        auto separator = [&]() -> std::ostream&
+            {
+                out << (first ? "" : ",\n");
+                first = false;
+                return out;
+            };
+
+        for (auto& frame : history())
+        {
+            separator() << "{\"name\":\"frame " << frame.number << "\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":0"
+                << ",\"ts\":" << micros(frame.start_ns) << ",\"dur\":" << micros(frame.end_ns - frame.start_ns) << "}";
+
+            for (auto& span : frame.spans)
+            {
+                separator() << "{\"name\":\"" << name(span.stage) << "\",\"cat\":\"stage\",\"ph\":\"X\",\"pid\":1,\"tid\":" << span.thread
+                    << ",\"ts\":" << micros(span.start_ns) << ",\"dur\":" << micros(span.duration_ns) << "}";
+            }
+
+            separator() << "{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"ts\":" << micros(frame.end_ns) << ",\"args\":{";
+            for (unsigned i = 0; i < COUNTER_COUNT; ++i)
+                out << (i ? "," : "") << '"' << name((Counter)i) << "\":" << frame.counters[i];
+            out << "}}";
+        }
+        out << "\n]}\n";
+    }
+
+private:
+    std::atomic<bool> on = { false };
+    std::array<std::atomic<std::int64_t>, STAGE_COUNT> stage_ns = {};
+    std::array<std::atomic<std::uint64_t>, COUNTER_COUNT> counters = {};
+
+    std::mutex span_mutex;
+    std::vector<Span> spans;
+
+    mutable std::mutex ring_mutex;
+    std::vector<Frame> ring;
+    std::uint64_t frames = 0u;
+    std::int64_t frame_start = 0;
+    std::chrono::steady_clock::time_point origin;
+
+    void resetOpenFrame(std::int64_t start)
+    {
+        for (auto& value : stage_ns)
+            value.store(0, std::memory_order_relaxed);
+        for (auto& value : counters)
+            value.store(0u, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(span_mutex);
+            spans.clear();
+        }
+        std::lock_guard<std::mutex> lock(ring_mutex);
+        frame_start = start;
+    }
+
+    static double micros(std::int64_t ns)
+    {
+        return 1e-3 * (double)ns;
+    }
+
+    //! small per-thread number for the trace (0 is the frame row)
+    static std::uint32_t threadIndex()
+    {
+        static std::atomic<std::uint32_t> next = { 1u };
+        thread_local std::uint32_t index = next.fetch_add(1u, std::memory_order_relaxed);
+        return index;
+    }
+};
+
+
+//! Adds the time from construction to destruction to a stage, if stats are
+//! enabled (and not null).
+class ScopedTimer
+{
+public:
+    ScopedTimer(FrameStats* stats_, FrameStats::Stage stage_) :
+        stats(stats_ && stats_->enabled() ? stats_ : nullptr),
+        stage(stage_)
+    {
+        if (stats)
+            start = stats->now();
+    }
+
+    ScopedTimer(FrameStats& stats_, FrameStats::Stage stage_) :
+        ScopedTimer(&stats_, stage_)
+    {
+        //nop
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    ~ScopedTimer()
+    {
+        stop();
+    }
+
+    //! Ends the timed scope early.
+    void stop()
+    {
+        if (stats)
+            stats->add(stage, start, stats->now() - start);
+        stats = nullptr;
+    }
+
+private:
+    FrameStats* stats;
+    FrameStats::Stage stage;
+    std::int64_t start = 0;
+};
@@ -0,0 +1,414 @@
+#pragma once
+#include "ComponentPool.h"
+#include <rocky/vsg/ecs.h>
+#include <entt/entt.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+//! One point of a platform's history.
+struct TrackPoint
+{
+    vsg::dvec3 position;    // ECEF
+    double time = 0.0;
+};
+
+
+//! Blocks of track points in power-of-two sizes, recycled through a free list
+//! per size so tracks that grow, shrink or go away don't churn the heap.
+class TrackPointPool
+{
+public:
+    static constexpr std::uint32_t min_capacity = 16u;
+
+    //! Smallest block size holding n points
+    static std::uint32_t sizeClass(std::uint32_t n)
+    {
+        std::uint32_t capacity = min_capacity;
+        while (capacity < n && capacity < (1u << 31))
+            capacity <<= 1;
+        return capacity;
+    }
+
+    //! A block of 'capacity' points, which must be a size class
+    TrackPoint* allocate(std::uint32_t capacity)
+    {
+        auto& list = free_lists[slot(capacity)];
+        std::unique_ptr<TrackPoint[]> block;
+        if (!list.empty())
+        {
+            block = std::move(list.back());
+            list.pop_back();
+            pooled_points -= capacity;
+        }
+        else
+        {
+            block.reset(new TrackPoint[capacity]);
+        }
+        used_points += capacity;
+        return block.release();
+    }
+
+    //! Returns a block from allocate() to the pool
+    void release(TrackPoint* points, std::uint32_t capacity)
+    {
+        if (!points)
+            return;
+        free_lists[slot(capacity)].emplace_back(points);
+        used_points -= capacity;
+        pooled_points += capacity;
+    }
+
+    //! Frees pooled blocks, largest first, until no more than 'max_pooled'
+    //! points are held for reuse
+    void trim(std::size_t max_pooled)
+    {
+        for (auto i = free_lists.size(); i-- > 0 && pooled_points > max_pooled; )
+        {
+            auto& list = free_lists[i];
+            while (!list.empty() && pooled_points > max_pooled)
+            {
+                list.pop_back();
+                pooled_points -= (std::size_t)min_capacity << i;
+            }
+        }
+    }
+
+    //! Points in blocks handed out, and held for reuse
+    std::size_t used() const { return used_points; }
+    std::size_t pooled() const { return pooled_points; }
+
+private:
+    std::array<std::vector<std::unique_ptr<TrackPoint[]>>, 28> free_lists;
+    std::size_t used_points = 0u, pooled_points = 0u;
+
+    static unsigned slot(std::uint32_t capacity)
+    {
+        unsigned i = 0u;
+        while ((min_capacity << i) < capacity)
+            ++i;
+        return i;
+    }
+};
+
+
+//! History of one platform: a fixed-capacity ring of points from a
+//! TrackPointPool, oldest first. append() never allocates; the ring only
+//! changes size in TrackHistory::apply().
+struct Track
+{
+    TrackPoint* points = nullptr;
+    std::uint32_t capacity = 0u;    // a power of two
+    std::uint32_t head = 0u;        // index of the oldest point
+    std::uint32_t count = 0u;
+
+    //! seconds of history to keep; 0 keeps as many points as fit
+    double length = 0.0;
+
+    //! points ever appended
+    std::uint64_t appended = 0u;
+
+    //! bumped when points are reordered or thinned rather than appended or
+    //! aged out, so the line must be rebuilt
+    std::uint32_t revision = 0u;
+
+    //! 'appended' and 'revision' as of the last line sync
+    std::uint64_t synced = 0u;
+    std::uint32_t synced_revision = 0u;
+
+    //! entity carrying the track's rocky::Line (the platform's own Transform
+    //! would offset the ECEF points), while the track is shown
+    entt::entity line = entt::null;
+    bool shown = false;
+
+    //! line style
+    vsg::vec4 color;
+    float width = 2.0f;
+
+    //! i-th point, oldest first
+    const TrackPoint& operator[](std::uint32_t i) const
+    {
+        return points[(head + i) & (capacity - 1u)];
+    }
+
+    const TrackPoint& back() const
+    {
+        return (*this)[count - 1u];
+    }
+
+    bool full() const
+    {
+        return count == capacity;
+    }
+
+    //! Adds a point, overwriting the oldest one when full, and drops points
+    //! older than 'length'. O(1) (amortized for the aging). A point earlier
+    //! than the last one means time was moved back, so the history restarts.
+    void append(double time, const vsg::dvec3& position)
+    {
+        if (!points)
+            return;
+
+        auto mask = capacity - 1u;
+        if (count > 0u && time < back().time)
+        {
+            head = count = 0u;
+            ++revision;
+        }
+        if (count == capacity)
+        {
+            head = (head + 1u) & mask;
+            --count;
+        }
+        points[(head + count) & mask] = { position, time };
+        ++count;
+        ++appended;
+
+        if (length > 0.0)
+        {
+            while (count > 1u && points[head].time < time - length)
+            {
+                head = (head + 1u) & mask;
+                --count;
+            }
+        }
+    }
+};
+
+
+//! Track history for every platform that has one, within a total point budget.
+//!
+//! Points are appended to each platform's Track as its updates are applied
+//! (in parallel, since each ring is the platform's own). Once per frame,
+//! apply() keeps the rings within 'point_budget' and brings each track's line
+//! up to date:
+//!
+//! - Budget: every track is entitled to a fair share of the budget (a power
+//!   of two, at most 'max_points'). While the rings together exceed the
+//!   budget, rings larger than the share move to a smaller block, keeping
+//!   their newest points and thinning out the older ones. A full ring smaller
+//!   than the share doubles when the budget has room for it.
+//!
+//! - Lines: only the points appended since the last sync are copied from
+//!   the ring to the line. rocky can only re-upload a whole Line, so each
+//!   sync uploads every point of the line whatever changed; what is saved is
+//!   the copying on the CPU side. Points that aged out or were overwritten
+//!   are erased from the line's front in batches, once they make up more
+//!   than 'max_aged' of it, so the shift is amortized over many frames; until
+//!   then the drawn track runs up to that fraction past its length. A line
+//!   is rebuilt from the ring after the ring was resized or restarted. A track that is not
+//!   shown (its platform is out of view) keeps its ring current but has no
+//!   Line, and gets one rebuilt from the ring when shown again.
+class TrackHistory
+{
+public:
+    //! Most points held by all tracks together
+    std::size_t point_budget = 1000000u;
+
+    //! Most points held by any one track
+    std::uint32_t max_points = 4096u;
+
+    //! Fraction of a line that may be aged-out points before they are erased
+    double max_aged = 1.0 / 16.0;
+
+    //! Gives a platform a track, or restyles the one it has. 'length' is the
+    //! seconds of history to keep (0 for as much as fits). The track is not
+    //! drawn until show().
+    void enable(entt::entity entity, double length, const vsg::vec4& color, float width, entt::registry& registry)
+    {
+        auto* track = registry.try_get<Track>(entity);
+        if (!track)
+        {
+            track = &registry.emplace<Track>(entity);
+            track->capacity = std::min(fairShare(track_count + 1u), TrackPointPool::sizeClass(max_points));
+            track->points = pool.allocate(track->capacity);
+            track->line = registry.create();
+            ++track_count;
+        }
+
+        if (length != track->length)
+        {
+            track->length = length;
+            ++track->revision;
+        }
+
+        track->color = color;
+        track->width = width;
+        if (track->shown)
+        {
+            auto& line = registry.get<rocky::Line>(track->line);
+            line.style.color = color;
+            line.style.width = width;
+            line.dirty();
+        }
+    }
+
+    //! Removes a platform's track and its line, returning its points and its
+    //! line to their pools
+    void disable(entt::entity entity, ComponentPool& components, entt::registry& registry)
+    {
+        auto* track = registry.try_get<Track>(entity);
+        if (!track)
+            return;
+
+        pool.release(track->points, track->capacity);
+        if (registry.valid(track->line))
+        {
+            components.release(track->line, registry);
+            registry.destroy(track->line);
+        }
+        registry.remove<Track>(entity);
+        --track_count;
+    }
+
+    //! Draws a platform's track, if it has one; its line is built from the
+    //! ring at the next apply().
+    void show(entt::entity entity, ComponentPool& components, entt::registry& registry)
+    {
+        auto* track = registry.try_get<Track>(entity);
+        if (!track || track->shown)
+            return;
+
+        auto& line = components.emplace<rocky::Line>(track->line, registry);
+        line.topology = rocky::Line::Topology::Strip;
+        line.style.color = track->color;
+        line.style.width = track->width;
+        track->shown = true;
+        track->synced_revision = track->revision - 1u;
+    }
+
+    //! Stops drawing a platform's track, returning its line to the pool; the
+    //! ring keeps its points.
+    void hide(entt::entity entity, ComponentPool& components, entt::registry& registry)
+    {
+        auto* track = registry.try_get<Track>(entity);
+        if (!track || !track->shown)
+            return;
+
+        components.release(track->line, registry);
+        track->shown = false;
+    }
+
+    //! Enforces the budget and syncs the lines. Call once per frame with the
+    //! registry locked for writing, after the frame's updates.
+    void apply(entt::registry& registry)
+    {
+        auto share = std::min(fairShare(track_count), TrackPointPool::sizeClass(max_points));
+        rebuilt_count = copied_count = 0u;
+
+        for (auto [entity, track] : registry.view<Track>().each())
+        {
+            if (pool.used() > point_budget && track.capacity > share)
+            {
+                resize(track, share);
+            }
+            else if (track.full() && track.capacity < share && pool.used() + track.capacity <= point_budget)
+            {
+                resize(track, track.capacity * 2u);
+            }
+
+            if (track.shown)
+                sync(track, registry);
+        }
+
+        // blocks pooled for reuse count against the budget too
+        pool.trim(point_budget > pool.used() ? point_budget - pool.used() : 0u);
+    }
+
+    //! Number of tracks
+    std::size_t size() const { return track_count; }
+
+    //! Points reserved by the tracks' rings, and held in the pool for reuse
+    std::size_t reserved() const { return pool.used(); }
+    std::size_t pooled() const { return pool.pooled(); }
+
+    //! Lines rebuilt and points copied into lines by the last apply()
+    std::size_t rebuilt() const { return rebuilt_count; }
+    std::size_t copied() const { return copied_count; }
+
+private:
+    TrackPointPool pool;
+    std::size_t track_count = 0u;
+    std::size_t rebuilt_count = 0u, copied_count = 0u;
+
+    //! Largest power of two with 'tracks' of them fitting in the budget
+    std::uint32_t fairShare(std::size_t tracks) const
+    {
+        auto share = point_budget / std::max<std::size_t>(tracks, 1u);
+        std::uint32_t capacity = TrackPointPool::min_capacity;
+        while ((std::size_t)capacity * 2u <= share && capacity < (1u << 30))
+            capacity <<= 1;
+        return capacity;
+    }
+
+    //! Moves a ring into a block of another size. When shrinking below the
+    //! number of points held, the newest half of the new block is kept as is
+    //! and the older points are thinned to fill another quarter, leaving room
+    //! to append before the ring wraps.
+    void resize(Track& track, std::uint32_t capacity)
+    {
+        auto* points = pool.allocate(capacity);
+        std::uint32_t n = 0u;
+
+        if (track.count <= capacity)
+        {
+            for (std::uint32_t i = 0u; i < track.count; ++i)
+                points[n++] = track[i];
+        }
+        else
+        {
+            auto newest = capacity / 2u;
+            auto older = track.count - newest;
+            auto stride = (older + capacity / 4u - 1u) / (capacity / 4u);
+            for (std::uint32_t i = 0u; i < older; i += stride)
+                points[n++] = track[i];
+            for (std::uint32_t i = older; i < track.count; ++i)
+                points[n++] = track[i];
+        }
+
+        pool.release(track.points, track.capacity);
+        track.points = points;
+        track.capacity = capacity;
+        track.head = 0u;
+        track.count = n;
+        ++track.revision;
+    }
+
+    void sync(Track& track, entt::registry& registry)
+    {
+        auto added = track.appended - track.synced;
+        if (added == 0u && track.revision == track.synced_revision)
+            return;
+
+        auto& line = registry.get<rocky::Line>(track.line);
+
+        if (track.revision != track.synced_revision || added > track.count ||
+            line.points.size() + added < (std::size_t)track.count)
+        {
+            line.points.clear();
+            for (std::uint32_t i = 0u; i < track.count; ++i)
+                line.points.push_back(track[i].position);
+            ++rebuilt_count;
+            copied_count += track.count;
+        }
+        else
+        {
+            for (auto i = track.count - (std::uint32_t)added; i < track.count; ++i)
+                line.points.push_back(track[i].position);
+            copied_count += added;
+
+            // drop what aged out of the ring, a batch at a time
+            auto aged = line.points.size() - (std::size_t)track.count;
+            if ((double)aged > max_aged * (double)line.points.size())
+                line.points.erase(line.points.begin(), line.points.begin() + (std::ptrdiff_t)aged);
+        }
+
+        track.synced = track.appended;
+        track.synced_revision = track.revision;
+        line.dirty();
+    }
+};
@@ -0,0 +1,212 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+//! Fixed-size pool of worker threads that run queued tasks in FIFO order, and
+//! split loops across themselves with parallel_for().
+//! Threads start on the first dispatch and are joined on destruction.
+class WorkerPool
+{
+public:
+    using Task = std::function<void()>;
+
+    WorkerPool(unsigned concurrency_ = 2u) :
+        concurrency(concurrency_ > 0u ? concurrency_ : 1u)
+    {
+        //nop
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done = true;
+        }
+        condition.notify_all();
+        for (auto& thread : threads)
+            thread.join();
+    }
+
+    //! Queues a task to run on one of the workers.
+    void dispatch(Task task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (threads.empty())
+            {
+                for (unsigned i = 0; i < concurrency; ++i)
+                    threads.emplace_back([this]() { run(); });
+            }
+            tasks.emplace_back(std::move(task));
+        }
+        condition.notify_one();
+    }
+
+    //! Number of worker threads
+    unsigned size() const
+    {
+        return concurrency;
+    }
+
+    //! Calls func(begin, end) over consecutive chunks of [0, count), at most
+    //! 'grain' long, on the workers and the calling thread, and returns once
+    //! every chunk is done.
+    //!
+    //! Each participant starts with an equal share of the chunks and works
+    //! through it from the front; one that runs out steals chunks from the back
+    //! of the others' shares. Chunk boundaries depend only on count and grain,
+    //! so as long as func writes only to the elements of its own chunk, the
+    //! result does not depend on scheduling.
+    template<class FUNC>
+    void parallel_for(std::size_t count, std::size_t grain, FUNC&& func)
+    {
+        grain = grain > 0u ? grain : 1u;
+        auto chunks = (count + grain - 1u) / grain;
+        if (chunks <= 1u)
+        {
+            if (count > 0u)
+                func(std::size_t(0), count);
+            return;
+        }
+
+        auto job = std::make_shared<Job>(concurrency + 1u, chunks);
+        job->body = [&func, count, grain](std::size_t chunk)
+            {
+                auto begin = chunk * grain;
+                func(begin, begin + grain < count ? begin + grain : count);
+            };
+
+        unsigned helpers = (unsigned)(chunks - 1u < concurrency ? chunks - 1u : concurrency);
+        for (unsigned i = 1; i <= helpers; ++i)
+        {
+            dispatch([job, i]()
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(job->mutex);
+                        if (job->closed)
+                            return; // started too late; nothing left to do
+                        ++job->running;
+                    }
+                    job->work(i);
+                    {
+                        std::lock_guard<std::mutex> lock(job->mutex);
+                        --job->running;
+                    }
+                    job->finished.notify_all();
+                });
+        }
+
+        // the caller takes part too, then waits for helpers still finishing a chunk
+        job->work(0u);
+
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->closed = true;
+        job->finished.wait(lock, [&]() { return job->running == 0u; });
+    }
+
+private:
+    //! One parallel_for call. Each participant owns a range of chunk indices,
+    //! packed as (end << 32 | begin) so the owner (taking from the front) and
+    //! thieves (taking from the back) can claim chunks with a single CAS.
+    struct Job
+    {
+        std::vector<std::atomic<std::uint64_t>> shares;
+        std::function<void(std::size_t)> body;
+        std::mutex mutex;
+        std::condition_variable finished;
+        unsigned running = 0u;
+        bool closed = false;
+
+        Job(unsigned participants, std::size_t chunks) :
+            shares(participants)
+        {
+            for (unsigned i = 0; i < participants; ++i)
+            {
+                auto begin = (std::uint64_t)(chunks * i / participants);
+                auto end = (std::uint64_t)(chunks * (i + 1u) / participants);
+                shares[i].store(end << 32 | begin, std::memory_order_relaxed);
+            }
+        }
+
+        void work(unsigned self)
+        {
+            std::size_t chunk;
+            while (claim(self, true, chunk))
+                body(chunk);
+
+            for (unsigned n = 1; n < (unsigned)shares.size(); ++n)
+            {
+                auto victim = (self + n) % (unsigned)shares.size();
+                while (claim(victim, false, chunk))
+                    body(chunk);
+            }
+        }
+
+        bool claim(unsigned share, bool front, std::size_t& chunk)
+        {
+            auto packed = shares[share].load(std::memory_order_acquire);
+            for (;;)
+            {
+                auto begin = packed & 0xFFFFFFFFu;
+                auto end = packed >> 32;
+                if (begin >= end)
+                    return false;
+
+                auto claimed = front ? (end << 32 | (begin + 1u)) : ((end - 1u) << 32 | begin);
+                if (shares[share].compare_exchange_weak(packed, claimed, std::memory_order_acq_rel))
+                {
+                    chunk = (std::size_t)(front ? begin : end - 1u);
+                    return true;
+                }
+            }
+        }
+    };
+
+    const unsigned concurrency;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<Task> tasks;
+    std::vector<std::thread> threads;
+    bool done = false;
+
+    void run()
+    {
+        for (;;)
+        {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this]() { return done || !tasks.empty(); });
+                if (done && tasks.empty())
+                    return;
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+            task();
+        }
+    }
+};
+
+
+//! parallel_for() on a pool, or inline on the calling thread when there is none.
+template<class FUNC>
+void parallel_for(WorkerPool* pool, std::size_t count, std::size_t grain, FUNC&& func)
+{
+    if (pool)
+        pool->parallel_for(count, grain, std::forward<FUNC>(func));
+    else if (count > 0u)
+        func(std::size_t(0), count);
+}
@@ -1,7 +1,14 @@
 #include <rocky/rocky.h>
 #include <simCore/Calc/Angle.h>
 #include <simData/MemoryDataStore.h>
+#include "BulkIngest.h"
 #include "DataStoreAdapter.h"
+#include "Recording.h"
+#include "SimulationThread.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <utility>
 
 #define EXAMPLE_AIRPLANE_ICON "https://readymap.org/readymap/filemanager/download/public/icons/airport.png"
 
@@ -44,6 +51,9 @@ addPlatform(simData::DataStore& dataStore)
     prefs->mutable_commonprefs()->mutable_labelprefs()->set_alignment(simData::ALIGN_RIGHT_CENTER);
     prefs->mutable_commonprefs()->mutable_localgrid()->mutable_speedring()->set_timeformat(simData::ELAPSED_SECONDS);
     prefs->mutable_commonprefs()->mutable_localgrid()->mutable_speedring()->set_radius(2);
+    prefs->mutable_trackprefs()->set_trackdrawmode(simData::TrackPrefs::LINE);
+    prefs->mutable_trackprefs()->set_tracklength(60);
+    prefs->mutable_trackprefs()->set_trackcolor(0x00FFFFFF);
     xaction.complete(&prefs);
 
     return id;
@@ -99,6 +109,40 @@ main(int argc, char** argv)
         getchar();
     }
 
+    // --sim-thread runs the DataStore on its own thread
+    // --record <file> records the simulation; --replay <file> plays a recording back
+    // --stats <file> writes per-stage frame statistics on exit (.csv, .trace.json or .json)
+    // --no-declutter shows every label, even where they overlap
+    // --tick-rate <hz> sets the fixed rate of DataStore updates (default 100)
+    // --frame-budget <ms> caps the entity updates applied per frame (default 4, 0 for no cap)
+    // --visual-idle <seconds> keeps the visuals of entities out of view that long (default 5)
+    bool use_sim_thread = false;
+    bool declutter = true;
+    double tick_rate = 100.0;
+    double frame_budget = 4.0;
+    double visual_idle = 5.0;
+    std::string record_path, replay_path, stats_path;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--sim-thread")
+            use_sim_thread = true;
+        else if (arg == "--record" && i + 1 < argc)
+            record_path = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc)
+            replay_path = argv[++i];
+        else if (arg == "--stats" && i + 1 < argc)
+            stats_path = argv[++i];
+        else if (arg == "--no-declutter")
+            declutter = false;
+        else if (arg == "--tick-rate" && i + 1 < argc)
+            tick_rate = std::max(1.0, std::atof(argv[++i]));
+        else if (arg == "--frame-budget" && i + 1 < argc)
+            frame_budget = std::atof(argv[++i]);
+        else if (arg == "--visual-idle" && i + 1 < argc)
+            visual_idle = std::max(0.0, std::atof(argv[++i]));
+    }
+
     // Application object for the 3D map display.
     rocky::Application app(argc, argv);
     rocky::Log()->set_level(rocky::log::level::info);
@@ -113,48 +157,160 @@ main(int argc, char** argv)
 
     // The Controller creates and updates visualization objects from the data store stream
     auto adapter = std::make_shared<DataStoreAdapter>(app);
+    adapter->stats.setEnabled(!stats_path.empty());
+    adapter->frame_budget = frame_budget;
+    adapter->sim.visuals.idle_seconds = visual_idle;
 
-    // Connect the controller to the data store.
-    data_store.addListener(adapter);
+    // Connect the controller to the data store, directly or through the simulation thread.
+    std::shared_ptr<SimulationThread> simulation;
+    if (use_sim_thread)
+        simulation = SimulationThread::create(data_store);
+    else
+        data_store.addListener(adapter);
 
-    // Create and configure the sim objects:
-    simData::ObjectId plat_id = addPlatform(data_store);
-    simData::ObjectId beam_id = addBeam(plat_id, data_store);
-    simData::ObjectId gate_id = addGate(beam_id, data_store);
+    std::shared_ptr<Recorder> recorder;
+    if (!record_path.empty())
+    {
+        recorder = std::make_shared<Recorder>(record_path);
+        data_store.addListener(recorder);
+    }
 
-    // Build a simulation
-    auto LLA = vsg::dvec3{ 2.0, 35.0, 10000.0 };
-    auto geo_to_ecef = rocky::SRS::WGS84.to(rocky::SRS::ECEF);
-    simCore::Vec3 ecef;
-    for (double time = 0.0; time <= 60.0; time += 0.01)
+    // Replay a recording, or build a simulation
+    std::shared_ptr<Replayer> replayer;
+    double start_time = 0.0;
+    if (!replay_path.empty())
     {
-        LLA.x += 0.001;
-        geo_to_ecef.transform(LLA, ecef);
-
-        simData::DataStore::Transaction x;
-        auto platform_update = data_store.addPlatformUpdate(plat_id, &x);
-        platform_update->set_time(time);
-        platform_update->setPosition(ecef);
-        x.complete(&platform_update);
-
-        auto beam_update = data_store.addBeamUpdate(beam_id, &x);
-        beam_update->set_time(time);
-        beam_update->set_azimuth(0.5*sin(time));
-        beam_update->set_range(35000.0);
-        x.complete(&beam_update);
+        replayer = Replayer::open(replay_path, data_store);
+        if (!replayer)
+            return -1;
+        start_time = replayer->firstTime();
     }
+    else
+    {
+        // Create and configure the sim objects:
+        simData::ObjectId plat_id = addPlatform(data_store);
+        simData::ObjectId beam_id = addBeam(plat_id, data_store);
+        simData::ObjectId gate_id = addGate(beam_id, data_store);
 
-    auto start = std::chrono::steady_clock::now();
+        const std::size_t count = 6001;
+        PlatformSamples platform_samples;
+        BeamSamples beam_samples;
+        platform_samples.reserve(count);
+        beam_samples.reserve(count);
+
+        // positions are generated as longitude, latitude, altitude and
+        // converted to ECEF in one batch on insert
+        auto LLA = vsg::dvec3{ 2.0, 35.0, 10000.0 };
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            double time = 0.01 * (double)i;
+            LLA.x += 0.001;
+            platform_samples.add(plat_id, time, LLA.x, LLA.y, LLA.z);
+            beam_samples.add(beam_id, time, 0.5*sin(time), 0.0, 35000.0);
+        }
 
-    // Install a frame loop update function
-    app.updateFunction = [&]()
+        BulkIngest ingest(data_store);
+        ingest.insertGeodetic(std::move(platform_samples));
+        ingest.insert(beam_samples);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto elapsed = [start, start_time]()
         {
             auto now = std::chrono::steady_clock::now();
-            double time = 1e-6 * (double)std::chrono::duration_cast<std::chrono::microseconds>(now - start).count();
-            data_store.update(time);
-            adapter->update(&data_store, { plat_id, beam_id });
+            return start_time + 1e-6 * (double)std::chrono::duration_cast<std::chrono::microseconds>(now - start).count();
+        };
+
+    // Advances the data store, loading replayed data around the new time first
+    auto tick = [replayer, adapter](simData::DataStore& ds, double time)
+        {
+            ScopedTimer timer(adapter->stats, FrameStats::DATASTORE_UPDATE);
+            if (replayer)
+                replayer->update(time);
+            ds.update(time);
+        };
+
+    // Camera of the first view of the main window, and its viewport size
+    auto main_view = [&app](vsg::dmat4& view_projection, double& width, double& height)
+        {
+            if (app.display.windowsAndViews.empty())
+                return false;
+            auto& [window, views] = *app.display.windowsAndViews.begin();
+            if (views.empty() || !views.front()->camera)
+                return false;
+            auto& camera = views.front()->camera;
+            auto extent = window->extent2D();
+            view_projection = camera->projectionMatrix->transform() * camera->viewMatrix->transform();
+            width = (double)extent.width, height = (double)extent.height;
+            return true;
         };
 
+    // Install a frame loop update function. Labels are decluttered in the
+    // main view, only entities in that view get visual components, and when
+    // the frame budget runs short the entities in that view are updated first.
+    vsg::dmat4 view_projection;
+    double width = 0.0, height = 0.0;
+    if (simulation)
+    {
+        simulation->start([&](simData::DataStore& ds) { tick(ds, elapsed()); },
+            std::chrono::duration<double>(1.0 / tick_rate));
+        app.updateFunction = [&]()
+            {
+                auto has_view = main_view(view_projection, width, height);
+                if (has_view)
+                    adapter->setView(view_projection);
+
+                simulation->apply(*adapter);
+
+                if (has_view)
+                    adapter->declutterLabels(view_projection, width, height, declutter);
+            };
+    }
+    else
+    {
+        // the DataStore ticks at a fixed rate however fast frames come
+        auto clock = std::make_shared<FixedStepClock>(start_time, tick_rate);
+        app.updateFunction = [&, clock]()
+            {
+                auto has_view = main_view(view_projection, width, height);
+                if (has_view)
+                    adapter->setView(view_projection);
+
+                clock->advance(elapsed(), [&](double time) { tick(data_store, time); });
+                adapter->update(&data_store);
+
+                if (has_view)
+                    adapter->declutterLabels(view_projection, width, height, declutter);
+            };
+    }
+
     // Run until the user quits
-    return app.run();
+    auto result = app.run();
+
+    if (simulation)
+    {
+        simulation->stop();
+        data_store.removeListener(simulation);
+    }
+    if (recorder)
+    {
+        data_store.removeListener(recorder);
+        recorder->close();
+    }
+    if (!stats_path.empty())
+    {
+        auto ends_with = [&](const std::string& suffix)
+            {
+                return stats_path.size() >= suffix.size() && stats_path.compare(stats_path.size() - suffix.size(), suffix.size(), suffix) == 0;
+            };
+
+        std::ofstream out(stats_path);
+        if (ends_with(".csv"))
+            adapter->stats.writeCSV(out);
+        else if (ends_with(".trace.json"))
+            adapter->stats.writeChromeTrace(out);
+        else
+            adapter->stats.writeJSON(out);
+    }
+    return result;
 }